@@ -78,11 +78,13 @@ def ring_view(ring, header_transform):
 
 class Ring(BifrostObject):
     instance_count = 0
-    def __init__(self, space='system', name=None, owner=None, core=None):
+    def __init__(self, space='system', name=None, owner=None, core=None,
+                 shared=False, attach=False):
         # If this is non-None, then the object is wrapping a base Ring instance
         self.base = None
         self.space = space
         if name is None:
+            assert(not attach)
             name = 'ring_%i' % Ring.instance_count
             Ring.instance_count += 1
         name = _slugify(name)
@@ -91,8 +93,16 @@ class Ring(BifrostObject):
         except AttributeError:
             # Python2 catch
             pass
-        BifrostObject.__init__(self, _bf.bfRingCreate, _bf.bfRingDestroy,
-                               name, _string2space(self.space))
+        if attach:
+            # Read-only view of a shared ring owned by another process
+            BifrostObject.__init__(self, _bf.bfRingAttach, _bf.bfRingDestroy,
+                                   name)
+        elif shared:
+            BifrostObject.__init__(self, _bf.bfRingCreateShared, _bf.bfRingDestroy,
+                                   name, _string2space(self.space))
+        else:
+            BifrostObject.__init__(self, _bf.bfRingCreate, _bf.bfRingDestroy,
+                                   name, _string2space(self.space))
         if core is not None:
             try:
                 _check( _bf.bfRingSetAffinity(self.obj, 
@@ -125,6 +135,46 @@ class Ring(BifrostObject):
     @property
     def core(self):
         return _get(_bf.bfRingGetAffinity, self.obj)
+    @classmethod
+    def attach(cls, name, owner=None):
+        """Open a ring created with shared=True in another process"""
+        return cls(name=name, owner=owner, attach=True)
+    @property
+    def shared(self):
+        return bool(_get(_bf.bfRingGetShared, self.obj))
+    @property
+    def lockfree(self):
+        return bool(_get(_bf.bfRingGetLockFree, self.obj))
+    @lockfree.setter
+    def lockfree(self, enabled):
+        # Note: Only valid for single-writer rings with no open spans/readers
+        _check( _bf.bfRingSetLockFree(self.obj, enabled) )
+    @property
+    def mirrored(self):
+        return bool(_get(_bf.bfRingGetMirrored, self.obj))
+    @mirrored.setter
+    def mirrored(self, enabled):
+        # Note: Must be set before the ring is first resized
+        _check( _bf.bfRingSetMirrored(self.obj, enabled) )
+    _WAIT_POLICIES = {'block':           _bf.BF_RING_WAIT_BLOCK,
+                      'spin':            _bf.BF_RING_WAIT_SPIN,
+                      'spin_yield':      _bf.BF_RING_WAIT_SPIN_YIELD,
+                      'spin_then_block': _bf.BF_RING_WAIT_SPIN_THEN_BLOCK}
+    def set_wait_policy(self, policy, spin_count=0):
+        """Sets how threads wait for space/data in the ring; one of 'block',
+        'spin', 'spin_yield' or 'spin_then_block' (see bfRingSetWaitPolicy)."""
+        _check( _bf.bfRingSetWaitPolicy(self.obj,
+                                        self._WAIT_POLICIES[policy],
+                                        spin_count) )
+    @property
+    def wait_policy(self):
+        policy     = _bf.BFringwait()
+        spin_count = ctypes.c_ulong()
+        _check( _bf.bfRingGetWaitPolicy(self.obj, policy, spin_count) )
+        for name, value in self._WAIT_POLICIES.items():
+            if value == policy.value:
+                return name, spin_count.value
+        raise ValueError("Unknown wait policy: %i" % policy.value)
     def begin_writing(self):
         return RingWriter(self)
     def _begin_writing(self):
@@ -139,6 +189,16 @@ class Ring(BifrostObject):
         return ReadSequence(self, which='latest', guarantee=guarantee)
     def open_earliest_sequence(self, guarantee=True):
         return ReadSequence(self, which='earliest', guarantee=guarantee)
+    def dump(self, f, time_tag_begin, time_tag_end=None):
+        """Writes the sequences covering [time_tag_begin,time_tag_end) to the
+        file (or file descriptor) f while writing to the ring continues
+        (see bfRingDump)."""
+        if time_tag_end is None:
+            time_tag_end = 2**64 - 1
+        fd = f if isinstance(f, int) else f.fileno()
+        if not isinstance(f, int):
+            f.flush()
+        _check( _bf.bfRingDump(self.obj, time_tag_begin, time_tag_end, fd) )
     # TODO: Alternative name?
     def read(self, whence='earliest', guarantee=True):
         with ReadSequence(self, which=whence, guarantee=guarantee,
@@ -285,6 +345,8 @@ class ReadSequence(SequenceBase):
         self._ring = ring
         # A function for transforming the header before it's read
         self.header_transform = header_transform
+        # Slices of the ringlet and outermost frame axes (see set_view)
+        self._view = None
         self.obj = _bf.BFrsequence()
         if which == 'specific':
             _check(_bf.bfRingSequenceOpen(self.obj, ring.obj, name, guarantee))
@@ -310,12 +372,87 @@ class ReadSequence(SequenceBase):
         #   a new sequence.
         self._header = None
         self._tensor = None
+    def set_view(self, ringlets=None, frames=None):
+        """Restricts subsequent spans to a slice of the (single) ringlet axis
+        and/or of the outermost frame axis (e.g., a sub-band of channels),
+        without copying (see bfRingSequenceSetView). The header and tensor
+        of the sequence are updated to describe the view."""
+        self._view = None
+        self._header = None
+        self._tensor = None
+        tensor = self.tensor
+        ringlet_offset, nringlet = 0, 0
+        if ringlets is not None:
+            if len(tensor['ringlet_shape']) != 1:
+                raise ValueError("Ringlet views require a single ringlet axis")
+            start, stop, step = ringlets.indices(tensor['nringlet'])
+            if step != 1 or stop <= start:
+                raise ValueError("Invalid ringlet slice")
+            ringlet_offset, nringlet = start, stop - start
+        frame_offset, frame_width, frame_stride = 0, 0, 0
+        if frames is not None:
+            nouter = tensor['frame_shape'][0]
+            start, stop, step = frames.indices(nouter)
+            if step != 1 or stop <= start:
+                raise ValueError("Invalid frame slice")
+            inner_nbyte = tensor['frame_nbyte'] // nouter
+            frame_offset = start * inner_nbyte
+            frame_width  = (stop - start) * inner_nbyte
+            frame_stride = tensor['frame_nbyte']
+            frames = (start, stop)
+        if ringlets is not None:
+            ringlets = (ringlet_offset, ringlet_offset + nringlet)
+        _check(_bf.bfRingSequenceSetView(self.obj, ringlet_offset, nringlet,
+                                         frame_offset, frame_width,
+                                         frame_stride))
+        self._header = None
+        self._tensor = None
+        if ringlets is not None or frames is not None:
+            self._view = (ringlets, frames)
     def acquire(self, frame_offset, nframe):
         return ReadSpan(self, frame_offset, nframe)
-    def read(self, nframe, stride=None, begin=0):
+    def acquire_many(self, frame_offset, nframe, nspan):
+        """Acquires up to nspan consecutive spans of nframe frames each under
+        a single lock of the ring, waiting only for the first. The spans
+        should be released together via release_many."""
+        frame_nbyte = self.tensor['frame_nbyte']
+        objs = (_bf.BFrspan * nspan)()
+        nacquired = ctypes.c_ulong()
+        _check(_bf.bfRingSpanAcquireMany(objs, nacquired, self.obj,
+                                         frame_offset * frame_nbyte,
+                                         nspan, nframe * frame_nbyte))
+        return [ReadSpan(self, frame_offset + i * nframe, nframe, obj=objs[i])
+                for i in range(nacquired.value)]
+    def release_many(self, spans):
+        if not len(spans):
+            return
+        for span in spans:
+            if span._released:
+                raise ValueError("Span has already been released")
+            if span.sequence is not self:
+                raise ValueError("Span was not acquired from this sequence")
+        objs = (_bf.BFrspan * len(spans))(*[span.obj for span in spans])
+        _check(_bf.bfRingSpanReleaseMany(objs, len(spans)))
+        for span in spans:
+            span._released = True
+    def read(self, nframe, stride=None, begin=0, batch=1):
+        """Yields consecutive spans of nframe frames. If batch > 1 (and the
+        spans do not overlap), up to batch spans that are already available
+        are acquired and released with a single lock of the ring, which
+        allows readers of small gulps to quickly catch up on a backlog.
+        Note that each batch is held until all of its spans are consumed."""
         if stride is None:
             stride = nframe
         offset = begin
+        if batch > 1 and stride == nframe:
+            while True:
+                ispans = self.acquire_many(offset, nframe, batch)
+                try:
+                    for ispan in ispans:
+                        yield ispan
+                finally:
+                    self.release_many(ispans)
+                offset += len(ispans) * stride
         while True:
             with self.acquire(offset, nframe) as ispan:
                 yield ispan
@@ -335,6 +472,25 @@ class ReadSequence(SequenceBase):
             hdr = self.header_transform(deepcopy(hdr))
             if hdr is None:
                 raise ValueError("Header transform returned None")
+        if self._view is not None:
+            hdr = self._view_header(deepcopy(hdr))
+        return hdr
+    def _view_header(self, hdr):
+        # Slices the axes of the header's tensor to match the view
+        tensor = hdr['_tensor']
+        shape  = tensor['shape']
+        scales = tensor.get('scales', None)
+        ringlets, frames = self._view
+        axes = []
+        if ringlets is not None:
+            axes.append((0, ringlets))
+        if frames is not None:
+            axes.append((shape.index(-1) + 1, frames))
+        for axis, (start, stop) in axes:
+            shape[axis] = stop - start
+            if (scales is not None and axis < len(scales) and
+                isinstance(scales[axis], list) and len(scales[axis]) == 2):
+                scales[axis][0] += start * scales[axis][1]
         return hdr
 
 def accumulate(vals, op='+', init=None, reverse=False):
@@ -406,6 +562,10 @@ class SpanBase(object):
         # **TODO: Change back-end to use long instead of uint64_t
         return int(self._info.nringlet)
     @property
+    def _frame_stride_bytes(self):
+        # Non-zero only for views (see ReadSequence.set_view)
+        return int(self._info.frame_stride)
+    @property
     def _data_ptr(self):
         return self._info.data
     @property
@@ -426,6 +586,8 @@ class SpanBase(object):
         strides = [tensor['dtype_nbyte']]
         for dim in reversed(tensor['frame_shape']):
             strides.append(dim * strides[-1])
+        if self._frame_stride_bytes:
+            strides[-1] = self._frame_stride_bytes # Time dimension
         if len(tensor['ringlet_shape']) > 0:
             strides.append(self._stride_bytes) # First ringlet dimension
         for dim in reversed(tensor['ringlet_shape'][1:]):
@@ -486,15 +648,20 @@ class WriteSpan(SpanBase):
         _check(_bf.bfRingSpanCommit(self.obj, commit_nbyte))
 
 class ReadSpan(SpanBase):
-    def __init__(self, sequence, frame_offset, nframe):
+    def __init__(self, sequence, frame_offset, nframe, obj=None):
         SpanBase.__init__(self, sequence.ring, sequence, writeable=False)
         tensor = sequence.tensor
-        self.obj = _bf.BFrspan()
-        _check(_bf.bfRingSpanAcquire(
-            self.obj,
-            sequence.obj,
-            frame_offset * tensor['frame_nbyte'],
-            nframe * tensor['frame_nbyte']))
+        self._released = False
+        if obj is not None:
+            # Already acquired (see ReadSequence.acquire_many)
+            self.obj = obj
+        else:
+            self.obj = _bf.BFrspan()
+            _check(_bf.bfRingSpanAcquire(
+                self.obj,
+                sequence.obj,
+                frame_offset * tensor['frame_nbyte'],
+                nframe * tensor['frame_nbyte']))
         self._set_base_obj(self.obj)
         self.nframe_skipped = min(self.frame_offset - frame_offset, nframe)
         self.requested_frame_offset = frame_offset
@@ -510,4 +677,7 @@ class ReadSpan(SpanBase):
     def __exit__(self, type, value, tb):
         self.release()
     def release(self):
+        if self._released:
+            return
+        self._released = True
         _check(_bf.bfRingSpanRelease(self.obj))
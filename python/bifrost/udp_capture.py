@@ -28,21 +28,145 @@
 # **TODO: Write tests for this class
 
 from bifrost.libbifrost import _bf, _check, _get, BifrostObject
+import ctypes
 
 class UDPCapture(BifrostObject):
+    """Captures packets from sock into ring.
+
+    sock may also be a list of sockets (e.g., bound to the same port with
+    SO_REUSEPORT), in which case each is captured from by its own thread,
+    bound to the corresponding entry in the list of cores.
+
+    batch_size is the max no. packets received per syscall (0 for default).
+
+    sock may also be a file (e.g., a pcap file), from which packets are then
+    replayed (see set_replay).
+    """
     def __init__(self, fmt, sock, ring, nsrc, src0, max_payload_size,
-                 buffer_ntime, slot_ntime, sequence_callback, core=None):
+                 buffer_ntime, slot_ntime, sequence_callback, core=None,
+                 batch_size=0):
+        if not isinstance(sock, (list, tuple)) and not batch_size:
+            if core is None:
+                core = -1
+            BifrostObject.__init__(
+                self, _bf.bfUdpCaptureCreate, _bf.bfUdpCaptureDestroy,
+                fmt, sock.fileno(), ring.obj, nsrc, src0,
+                max_payload_size, buffer_ntime, slot_ntime,
+                sequence_callback, core)
+            return
+        if not isinstance(sock, (list, tuple)):
+            sock = [sock]
+        nfd = len(sock)
         if core is None:
-            core = -1
+            core = [-1] * nfd
+        elif not isinstance(core, (list, tuple)):
+            core = [core] * nfd
+        if len(core) != nfd:
+            raise ValueError("Number of cores must match number of sockets")
+        array_type = ctypes.c_int * nfd
+        fds   = array_type(*[s.fileno() for s in sock])
+        cores = array_type(*core)
         BifrostObject.__init__(
-            self, _bf.bfUdpCaptureCreate, _bf.bfUdpCaptureDestroy,
-            fmt, sock.fileno(), ring.obj, nsrc, src0,
+            self, _bf.bfUdpCaptureCreateMulti, _bf.bfUdpCaptureDestroy,
+            fmt, nfd, fds, cores, ring.obj, nsrc, src0,
             max_payload_size, buffer_ntime, slot_ntime,
-            sequence_callback, core)
+            sequence_callback, batch_size)
     def __enter__(self):
         return self
     def __exit__(self, type, value, tb):
+        self.stop()
         self.end()
+    def set_mask_ring(self, ring):
+        """Also write a bitmask of the received (seq, src) packets to ring"""
+        _check(_bf.bfUdpCaptureSetMaskRing(self.obj, ring.obj))
+    def set_time_ring(self, ring):
+        """Also write the packet arrival times of each buffer to ring"""
+        _check(_bf.bfUdpCaptureSetTimeRing(self.obj, ring.obj))
+    def buffer_times(self):
+        """Returns the arrival times (ns) of the last committed buffer"""
+        times = _bf.BFudpcapture_buf_times()
+        _check(_bf.bfUdpCaptureGetBufferTimes(self.obj, times))
+        return times
+    def set_replay(self, speed=0, drop_prob=0, reorder_prob=0,
+                   reorder_depth=0, seed=0):
+        """Configures the replay of packets from files passed in place of
+        sockets (pcap, pcapng or payload dumps).
+
+        speed is relative to the original timing (0 for as fast as possible),
+        and packets may be randomly dropped or held back for reorder_depth
+        packets to simulate network conditions.
+        """
+        config = _bf.BFudpcapture_replay()
+        config.speed         = speed
+        config.drop_prob     = drop_prob
+        config.reorder_prob  = reorder_prob
+        config.reorder_depth = reorder_depth
+        config.seed          = seed
+        _check(_bf.bfUdpCaptureSetReplay(self.obj, config))
+    def set_poll_mode(self, busy=True, busy_poll_usec=0, backoff_npoll=1000,
+                      backoff_max_usec=0):
+        """Configures the capture threads to busy-poll their sockets.
+
+        After backoff_npoll empty polls, the threads sleep between polls for
+        exponentially longer, up to backoff_max_usec (0 to always spin).
+        If busy_poll_usec > 0, SO_BUSY_POLL is also set on the sockets.
+        """
+        config = _bf.BFudpcapture_poll()
+        config.busy             = busy
+        config.busy_poll_usec   = busy_poll_usec
+        config.backoff_npoll    = backoff_npoll
+        config.backoff_max_usec = backoff_max_usec
+        _check(_bf.bfUdpCaptureSetPoll(self.obj, config))
+    def set_source_sizes(self, payload_sizes):
+        """Sets the payload size of each source, for sources that carry
+        different amounts of data (whose payloads are then stored back to
+        back for each time). Only for the "simple" and "spead" formats.
+        """
+        nsrc = len(payload_sizes)
+        sizes = (_bf.BFsize * nsrc)(*payload_sizes)
+        _check(_bf.bfUdpCaptureSetSourceSizes(self.obj, nsrc, sizes))
+    def set_reorder_window(self, nbuf):
+        """Keep nbuf buffers open at once to capture out-of-order packets"""
+        _check(_bf.bfUdpCaptureSetReorderWindow(self.obj, nbuf))
+    def source_stats_name(self):
+        """Name of the shared-memory table of per-source stats
+
+        The table is /dev/shm/bifrost_udp_capture.<pid>.<n>. Tables left
+        behind by crashed processes are removed by the next process to
+        create a capture.
+        """
+        name = ctypes.c_char_p()
+        _check(_bf.bfUdpCaptureGetSourceStatsName(self.obj,
+                                                  ctypes.byref(name)))
+        return name.value
+    def source_stats(self, nsrc):
+        """Returns a snapshot of the stats of the first nsrc sources"""
+        stats = (_bf.BFudpcapture_src_stats * nsrc)()
+        _check(_bf.bfUdpCaptureGetSourceStats(self.obj, nsrc, stats))
+        return [dict((key, getattr(s, key)) for key, _ in s._fields_)
+                for s in stats]
+    def start(self):
+        """Captures continuously on an internal (C++) thread until stop.
+
+        The thread runs independently of Python (and the GIL), and reports
+        the start, change and end of each sequence as events (see poll_event).
+        If it is interrupted or fails, it commits its open buffers, reports
+        that as its final event and exits by itself.
+        """
+        _check(_bf.bfUdpCaptureStart(self.obj))
+    def stop(self):
+        _check(_bf.bfUdpCaptureStop(self.obj))
+    def poll_event(self):
+        """Returns the next event from the internal thread, or None if there
+        is none yet. Raises StopIteration once the thread has exited (or was
+        stopped) and all of its events have been read.
+        """
+        event = _bf.BFudpcapture_event()
+        status = _bf.bfUdpCapturePollEvent(self.obj, event)
+        if status == _bf.BF_STATUS_WOULD_BLOCK:
+            return None
+        _check(status)
+        return event
     def recv(self):
         status = _bf.BFudpcapture_status()
         _check(_bf.bfUdpCaptureRecv(self.obj, status))
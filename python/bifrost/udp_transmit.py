@@ -26,8 +26,6 @@
 # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
-# **TODO: Write tests for this class
-
 from bifrost.libbifrost import _bf, _check, _get, BifrostObject
 
 import ctypes
@@ -39,7 +37,7 @@ def _packet2pointer(packet):
 
 def _packets2pointer(packets):
     count = ctypes.c_uint( len(packets) )
-    buf = ctypes.c_char_p("".join(packets))
+    buf = ctypes.c_char_p(b"".join(packets))
     siz = ctypes.c_uint( len(packets[0]) )
     return buf, siz, count
 
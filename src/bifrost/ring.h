@@ -72,6 +72,27 @@ typedef struct BFwspan_impl*       BFwspan;
 
 // Ring
 BFstatus bfRingCreate(BFring* ring, const char* name, BFspace space);
+/*! \p bfRingCreateShared creates a ring whose state and data live in POSIX
+ *       shared memory under the given name, so that other processes can read
+ *       from it (with zero copies) via \p bfRingAttach. The calling process
+ *       owns the ring and is the only one that may write to or resize it.
+ * \note Shared rings are always mirrored (see \p bfRingSetMirrored), are
+ *         limited to BF_SPACE_SYSTEM, and cannot use lock-free mode.
+ * \note Sequence names are limited to 255 characters and headers to 64 kB.
+ *         There is no limit on the no. sequences in the ring; the shared
+ *         table of them grows as needed, using roughly one page of shared
+ *         memory (plus its header) per sequence still in the ring.
+ */
+BFstatus bfRingCreateShared(BFring* ring, const char* name, BFspace space);
+/*! \p bfRingAttach opens a ring created in another process by
+ *       \p bfRingCreateShared. The returned ring supports only reading.
+ * \param name The name passed to \p bfRingCreateShared.
+ */
+BFstatus bfRingAttach(BFring* ring, const char* name);
+/*! \p bfRingGetShared returns whether the ring lives in shared memory (i.e.,
+ *       was created by \p bfRingCreateShared or \p bfRingAttach).
+ */
+BFstatus bfRingGetShared(BFring ring, BFbool* shared);
 BFstatus bfRingDestroy(BFring ring);
 /*! \p bfRingResize requests allocation of memory for the ring
  * 
@@ -83,6 +104,9 @@ BFstatus bfRingDestroy(BFring ring);
  * \p BIFROST_STATUS_SUCCESS, 
  * \note This function is thread-safe and can be called multiple times; reallocation
  * will occur only when necessary.
+ * \note Mirrored single-ringlet rings (see \p bfRingSetMirrored) are grown in
+ *         place, copying at most half of the buffered data; other rings are
+ *         copied to a new allocation.
  */
 BFstatus bfRingResize(BFring ring,
                       BFsize contiguous_bytes,
@@ -104,6 +128,55 @@ BFstatus bfRingSetAffinity(BFring ring, int  core);
  *        set to a value of -1.
  */
 BFstatus bfRingGetAffinity(BFring ring, int* core);
+/*! \p bfRingSetLockFree enables a lock-free fast path for rings with a single
+ *       writer thread. Spans that do not touch the ghost region are then
+ *       reserved, committed, acquired and released using atomics only, and
+ *       the ring's mutex is taken just for sequence operations, resizing and
+ *       blocking waits.
+ * \param lockfree Whether to enable (1) or disable (0) lock-free mode.
+ * \note Must be called while the ring has no open spans.
+ */
+BFstatus bfRingSetLockFree(BFring ring, BFbool  lockfree);
+/*! \p bfRingGetLockFree returns whether lock-free mode is enabled.
+ */
+BFstatus bfRingGetLockFree(BFring ring, BFbool* lockfree);
+/*! \p bfRingSetMirrored causes subsequent ring memory allocations to map the
+ *       buffer twice, back to back, in virtual memory. Spans that wrap around
+ *       the end of the ring are then contiguous without any ghost-region
+ *       copies, at the cost of rounding the ring span up to the page size.
+ * \param mirrored Whether to enable (1) or disable (0) mirrored allocation.
+ * \note Only supported for BF_SPACE_SYSTEM rings on Linux, and must be called
+ *         before the ring is first resized.
+ */
+BFstatus bfRingSetMirrored(BFring ring, BFbool  mirrored);
+/*! \p bfRingGetMirrored returns whether mirrored allocation is enabled.
+ */
+BFstatus bfRingGetMirrored(BFring ring, BFbool* mirrored);
+
+typedef enum BFringwait_ {
+	// Park the thread on a condition variable straight away (the default)
+	BF_RING_WAIT_BLOCK           = 0,
+	// Busy-wait without ever parking
+	BF_RING_WAIT_SPIN            = 1,
+	// Busy-wait for spin_count iterations, then yield the CPU between checks
+	BF_RING_WAIT_SPIN_YIELD      = 2,
+	// Busy-wait for spin_count iterations, then park the thread
+	BF_RING_WAIT_SPIN_THEN_BLOCK = 3
+} BFringwait;
+/*! \p bfRingSetWaitPolicy sets how threads wait for space (writers) or data
+ *       (readers) in the ring. Spinning avoids the wake-up latency of
+ *       parking a thread at the cost of burning a CPU core while waiting.
+ *       The time spent spinning and blocked is reported in the ring's
+ *       ProcLog entry.
+ * \param policy     One of the BF_RING_WAIT_* values.
+ * \param spin_count The number of spin-loop iterations (each a CPU pause) before
+ *                   yielding/parking (ignored for BF_RING_WAIT_BLOCK and
+ *                   BF_RING_WAIT_SPIN).
+ */
+BFstatus bfRingSetWaitPolicy(BFring ring, BFringwait policy, BFsize spin_count);
+/*! \p bfRingGetWaitPolicy returns the values set by \p bfRingSetWaitPolicy.
+ */
+BFstatus bfRingGetWaitPolicy(BFring ring, BFringwait* policy, BFsize* spin_count);
 
 //BFsize   bfRingGetNRinglet(BFring ring);
 // TODO: BFsize bfRingGetSizeBytes
@@ -143,6 +216,10 @@ BFstatus bfRingSequenceEnd(BFwsequence sequence,
                            BFoffset    offset_from_head);
 
 // Sequence read
+// Note: The first 64 guaranteed readers of a ring are tracked without
+//         locking; any more make the writer take the ring's lock. Readers of
+//         a shared ring in other processes are limited to those 64, and
+//         opening another returns BF_STATUS_INSUFFICIENT_STORAGE.
 BFstatus bfRingSequenceOpen(BFrsequence* sequence,
                             BFring       ring,
                             const char*  name,
@@ -169,6 +246,28 @@ BFstatus bfRingSequenceOpenEarliest(BFrsequence* sequence,
 BFstatus bfRingSequenceNext(BFrsequence sequence);
 //BFstatus bfRingSequenceOpenSame(BFrsequence* sequence, BFrsequence existing);
 BFstatus bfRingSequenceClose(BFrsequence sequence);
+/*! \p bfRingSequenceSetView makes the spans subsequently acquired from
+ *       \p sequence refer to a subset of its data in place (i.e., without
+ *       copying), such as a single ringlet or a sub-band of each frame.
+ * \param ringlet_offset,nringlet Select ringlets [ringlet_offset,
+ *        ringlet_offset+nringlet). Pass nringlet=0 to select all ringlets.
+ * \param frame_offset,frame_width,frame_stride Treat the data as frames of
+ *        frame_stride bytes and select bytes [frame_offset,
+ *        frame_offset+frame_width) of each. Pass frame_stride=0 to select
+ *        whole frames.
+ * \note With a frame selection, the offsets and sizes passed to
+ *         \p bfRingSpanAcquire(Many) and returned by the span are in bytes of
+ *         the view (frame_width per frame, and must be multiples of it), and
+ *         the frames of the returned spans lie \p bfRingSpanGetFrameStride
+ *         bytes apart in the parent buffer.
+ * \note The view stays in effect across \p bfRingSequenceNext.
+ */
+BFstatus bfRingSequenceSetView(BFrsequence sequence,
+                               BFsize      ringlet_offset,
+                               BFsize      nringlet,
+                               BFsize      frame_offset,
+                               BFsize      frame_width,
+                               BFsize      frame_stride);
 
 // Sequence common
 BFstatus bfRingSequenceGetRing(BFsequence sequence, BFring* ring);
@@ -202,6 +301,72 @@ BFstatus bfRingSpanAcquire(BFrspan*    span,
                            BFoffset    offset,
                            BFsize      size);
 BFstatus bfRingSpanRelease(BFrspan span);
+/*! \p bfRingSpanAcquireMany acquires up to \p nspan consecutive read spans
+ *       of \p span_size bytes each, starting at \p offset, under a single
+ *       lock of the ring. Only the first span is waited for; the rest are
+ *       returned only if they are already available, so a reader that has
+ *       fallen behind can drain its backlog in one call.
+ * \param spans Array of at least \p nspan spans to be filled.
+ * \param nacquired The number of spans actually acquired (at least 1 on
+ *        success). The final span may be short (or overwritten) exactly as
+ *        with \p bfRingSpanAcquire, in which case no further spans follow it.
+ * \note The spans should be released together via \p bfRingSpanReleaseMany,
+ *         which takes the ring's lock just once. The reader's guarantee
+ *         (if any) is moved only to the start of the first span, so it
+ *         protects the whole batch until it is released.
+ */
+BFstatus bfRingSpanAcquireMany(BFrspan*    spans,
+                               BFsize*     nacquired,
+                               BFrsequence sequence,
+                               BFoffset    offset,
+                               BFsize      nspan,
+                               BFsize      span_size);
+/*! \p bfRingSpanReleaseMany releases \p nspan spans under a single lock of
+ *       the ring. The spans must all have been acquired from the same
+ *       sequence handle and each may appear only once; otherwise
+ *       BF_STATUS_INVALID_ARGUMENT is returned and none are released.
+ */
+BFstatus bfRingSpanReleaseMany(BFrspan* spans,
+                               BFsize   nspan);
+
+// Triggered dumps
+#define BF_RING_DUMP_MAGIC "BFRDUMP1"
+#define BF_RING_DUMP_ALIGN 4096
+// Each dumped sequence is written as a record that begins with this struct,
+//   followed by the sequence header and then the data. Both the header and
+//   the data are zero-padded to a multiple of BF_RING_DUMP_ALIGN bytes.
+typedef struct BFringdumprecord_ {
+	char     magic[8];     // BF_RING_DUMP_MAGIC (without the terminator)
+	BFsize   record_size;  // Total size of the record including padding
+	BFsize   data_offset;  // Offset of the data from the start of the record
+	BFoffset time_tag;
+	BFoffset offset;       // Offset within the sequence of the first byte dumped
+	BFsize   size;         // No. bytes dumped (per ringlet)
+	BFsize   nringlet;
+	BFsize   chunk_size;   // Ringlets are interleaved in blocks of this size
+	BFsize   header_size;
+	char     name[256];
+} BFringdumprecord;
+/*! \p bfRingDump writes the data and headers of the sequences in \p ring
+ *       covering [\p time_tag_begin, \p time_tag_end) to the file \p fd
+ *       while writing to the ring continues.
+ * \param time_tag_begin A time_tag within the first sequence to dump (see
+ *        \p bfRingSequenceOpenAt).
+ * \param time_tag_end Sequences with a time_tag at or after this are not
+ *        dumped. Pass BFoffset(-1) to dump up to the latest sequence.
+ * \note Data is written from the oldest byte that has not yet been
+ *         overwritten, up to the head of the ring at the time of the call.
+ *         The range is pinned by a temporary guarantee, which follows the
+ *         dump forwards so that the writer is held up as little as possible.
+ * \note Writes are made in large blocks of BF_RING_DUMP_ALIGN-aligned
+ *         memory, using O_DIRECT where the file allows it (the file's
+ *         flags are restored afterwards). The file position must be a
+ *         multiple of BF_RING_DUMP_ALIGN to make use of O_DIRECT.
+ */
+BFstatus bfRingDump(BFring   ring,
+                    BFoffset time_tag_begin,
+                    BFoffset time_tag_end,
+                    int      fd);
 
 // Returns in *val the number of bytes in the span that have been overwritten
 //   at the time of the call (always zero for guaranteed sequences).
@@ -215,6 +380,10 @@ BFstatus bfRingSpanGetSize(BFspan  span, BFsize* val);
 BFstatus bfRingSpanGetStride(BFspan span, BFsize* val);
 BFstatus bfRingSpanGetOffset(BFspan span, BFsize* val);
 BFstatus bfRingSpanGetNRinglet(BFspan span, BFsize* val);
+// Returns in *val the distance in bytes between consecutive frames of a span
+//   acquired through a view (see bfRingSequenceSetView), or 0 if the span is
+//   contiguous.
+BFstatus bfRingSpanGetFrameStride(BFspan span, BFsize* val);
 
 typedef struct BFspan_info_ {
 	BFring      ring;
@@ -223,6 +392,7 @@ typedef struct BFspan_info_ {
 	BFsize      stride;
 	BFsize      offset;
 	BFsize      nringlet;
+	BFsize      frame_stride;
 } BFspan_info;
 BFstatus bfRingSpanGetInfo(BFspan span, BFspan_info* span_info);
 
@@ -51,6 +51,19 @@ typedef enum BFudpcapture_status_ {
 	BF_CAPTURE_ERROR
 } BFudpcapture_status;
 
+/*! \p bfUdpCaptureCreate creates a capture object that receives packets
+ *       of the given \p format from the socket \p fd into \p ring.
+ * \param format One of "chips", "simple" (a 16-byte big-endian header of
+ *        seq, src, nchan, chan0 and padding) or "spead" (SPEAD-64-48 packets
+ *        that each carry a whole heap, with the heap counter, source id
+ *        (0x4101) and first channel (0x4103) as immediate items).
+ * \note \p fd may also be an AF_PACKET socket (e.g., bound to an interface
+ *         and filtered to the desired UDP port), in which case packets are
+ *         read directly from a TPACKET_V3 memory-mapped RX ring rather than
+ *         copied out of the kernel one batch at a time. Only the UDP payloads
+ *         of unfragmented IPv4 packets are captured. (To shard between
+ *         several such sockets, join them to a PACKET_FANOUT group.)
+ */
 BFstatus bfUdpCaptureCreate(BFudpcapture* obj,
                             const char*   format,
                             int           fd,
@@ -62,8 +75,234 @@ BFstatus bfUdpCaptureCreate(BFudpcapture* obj,
                             BFsize        slot_ntime,
                             BFudpcapture_sequence_callback sequence_callback,
                             int           core);
+/*! \p bfUdpCaptureCreateMulti is like \p bfUdpCaptureCreate, but captures
+ *       from \p nfd sockets at once (typically bound to the same port with
+ *       SO_REUSEPORT, so that the kernel shards the incoming flows between
+ *       them).
+ * \param fds,cores The socket to capture from with each thread, and the core
+ *        to bind it to. The first socket is read by the thread that calls
+ *        \p bfUdpCaptureRecv, and the rest by worker threads.
+ * \param batch_size The max no. packets each thread receives per syscall
+ *        (via recvmmsg), or 0 to use the default.
+ * \note All threads decode and scatter packets directly into the same pair
+ *         of open spans; each call to \p bfUdpCaptureRecv returns once every
+ *         thread has finished with the current buffer (or timed out).
+ */
+BFstatus bfUdpCaptureCreateMulti(BFudpcapture* obj,
+                                 const char*   format,
+                                 BFsize        nfd,
+                                 const int*    fds,
+                                 const int*    cores,
+                                 BFring        ring,
+                                 BFsize        nsrc,
+                                 BFsize        src0,
+                                 BFsize        max_payload_size,
+                                 BFsize        buffer_ntime,
+                                 BFsize        slot_ntime,
+                                 BFudpcapture_sequence_callback sequence_callback,
+                                 BFsize        batch_size);
+/*! \p bfUdpCaptureSetMaskRing makes the capture write a mask of which
+ *       packets were received to \p mask_ring, alongside the data.
+ * \note Each buffer of data gets a matching span in the mask ring, holding
+ *         one bit per (seq, src) slot (bit (seq - seq0)*nsrc + src, in
+ *         little-endian 64-bit words), padded to a whole no. words. Mask
+ *         sequences have the same name and time tag as the data, and an
+ *         empty header.
+ * \note With a mask, only the missing packets are zeroed in the data, rather
+ *         than whole sources that are more than half missing.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetMaskRing(BFudpcapture obj, BFring mask_ring);
+/*! \p bfUdpCaptureSetSourceSizes sets the payload size of each of the
+ *       \p nsrc sources, for streams whose sources carry different amounts
+ *       of data (e.g., different numbers of channels).
+ * \note Each time in the buffers then holds the sources' payloads back to
+ *         back, with source src starting after the payloads of sources
+ *         0..src-1. A source with a size of 0 is not expected to send any
+ *         packets. Missing data are counted (and blanked out) per source
+ *         relative to its own size.
+ * \note Packets whose payload size differs from their source's are
+ *         counted as invalid.
+ * \note Only supported by the "simple" and "spead" formats.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetSourceSizes(BFudpcapture  obj,
+                                    BFsize        nsrc,
+                                    const BFsize* payload_sizes);
+/*! \p bfUdpCaptureSetReorderWindow sets how many buffers (each of
+ *       buffer_ntime) are kept open for writing at once (default 2).
+ *       Packets arriving up to (nbuf-1)*buffer_ntime behind the newest
+ *       are still captured, at the cost of that much extra latency.
+ * \note Packets older than the window are counted as late, and histogrammed
+ *         by how late they were in the udp_capture/late ProcLog.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetReorderWindow(BFudpcapture obj, BFsize nbuf);
+
+typedef struct BFudpcapture_poll_ {
+	int busy;             // Poll without blocking rather than sleeping in recv
+	int busy_poll_usec;   // If > 0, also set SO_BUSY_POLL (see socket(7))
+	int backoff_npoll;    // No. empty polls to spin for before backing off
+	int backoff_max_usec; // Max sleep between empty polls (0 to always spin)
+} BFudpcapture_poll;
+
+/*! \p bfUdpCaptureSetPoll sets how the capture threads wait for packets.
+ * \note When busy, each thread polls its socket (with MSG_DONTWAIT, or by
+ *         checking the packet ring directly for AF_PACKET sockets) on its
+ *         own core instead of sleeping, which avoids scheduler wake-up
+ *         latency. After \p backoff_npoll empty polls, it sleeps between
+ *         polls for exponentially longer, up to \p backoff_max_usec. The
+ *         socket's SO_RCVTIMEO still sets when a recv times out.
+ * \note The fraction of polls that found packets is given by recv_hit_ratio
+ *         in the udp_capture/perf ProcLog.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetPoll(BFudpcapture             obj,
+                             const BFudpcapture_poll* config);
+
+/*! Files that start with this are dumps of UDP payloads for replay, with
+ *    each payload preceded by a 16-byte little-endian header of its
+ *    arrival time (u64, ns since the Unix epoch), its size (u32) and a
+ *    reserved (zero) u32.
+ */
+#define BF_UDP_CAPTURE_DUMP_MAGIC "BFPKTDMP"
+
+typedef struct BFudpcapture_replay_ {
+	double   speed;         // Relative to the original timing (0 = no pacing)
+	double   drop_prob;     // Probability of dropping each packet
+	double   reorder_prob;  // Probability of holding back each packet
+	BFsize   reorder_depth; // No. later packets a held-back packet waits for
+	BFoffset seed;          // Seed for the drop and reorder injection
+} BFudpcapture_replay;
+
+/*! \p bfUdpCaptureSetReplay configures the replay of packets from files.
+ * \note A capture replays packets from each of its fds that is a regular
+ *         file (pcap, pcapng or a payload dump), rather than a socket. By
+ *         default the packets are replayed as fast as possible, in order.
+ *         Replay stops at the end of the file, which appears as a timeout.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetReplay(BFudpcapture               obj,
+                               const BFudpcapture_replay* config);
+
+/*! The arrival times of a capture buffer's packets, which are timestamped by
+ *    the kernel as they are received (SO_TIMESTAMPNS, or the packet ring's
+ *    own timestamps for AF_PACKET sockets). All times are in ns since the
+ *    Unix epoch (i.e., CLOCK_REALTIME).
+ */
+typedef struct BFudpcapture_buf_times_ {
+	BFoffset seq0;          // First seq in the buffer
+	BFoffset first_arrival; // Earliest packet arrival (0 if none arrived)
+	BFoffset last_arrival;  // Latest packet arrival (0 if none arrived)
+	BFoffset commit_time;   // When the buffer was committed to the ring
+} BFudpcapture_buf_times;
+
+/*! \p bfUdpCaptureSetTimeRing makes the capture write the arrival times
+ *       of each buffer it commits to \p time_ring, as one
+ *       \p BFudpcapture_buf_times per span. Span i of a time sequence
+ *       describes span i of the data sequence with the same time tag.
+ * \note Must be called before the first call to \p bfUdpCaptureRecv.
+ */
+BFstatus bfUdpCaptureSetTimeRing(BFudpcapture obj, BFring time_ring);
+/*! \p bfUdpCaptureGetBufferTimes returns the arrival times of the last
+ *       committed buffer (also summarised in the udp_capture/perf ProcLog).
+ * \note May be called while the internal thread is running (see
+ *         \p bfUdpCaptureStart); the times returned are always those of a
+ *         single buffer.
+ */
+BFstatus bfUdpCaptureGetBufferTimes(BFudpcapture            obj,
+                                    BFudpcapture_buf_times* times);
+
+#define BF_UDP_CAPTURE_STATS_MAGIC "BFUDPST1"
+
+typedef struct BFudpcapture_src_stats_ {
+	BFoffset nvalid;
+	BFoffset nvalid_bytes;
+	BFoffset nlate;
+	BFoffset nlate_bytes;
+	BFoffset ngood_bytes;    // Received in committed buffers
+	BFoffset nmissing_bytes; // Missing from committed buffers
+} BFudpcapture_src_stats;
+
+/*! The header of a capture's shared-memory table of per-source stats, which
+ *    is followed by nsrc \p BFudpcapture_src_stats entries.
+ * \note The table is updated after every gulp. To take a consistent
+ *         snapshot, wait for \p seqlock to be even, copy the table, and
+ *         retry if \p seqlock has changed in the meantime.
+ */
+typedef struct BFudpcapture_stats_header_ {
+	char     magic[8];       // BF_UDP_CAPTURE_STATS_MAGIC
+	BFoffset seqlock;        // Odd while an update is in progress
+	BFoffset nsrc;
+	BFoffset src0;
+	double   update_time;    // Unix time of the last update
+	BFoffset ninvalid;       // Note: Invalid packets have no known source
+	BFoffset ninvalid_bytes;
+	BFoffset reserved;
+} BFudpcapture_stats_header;
+
+/*! \p bfUdpCaptureGetSourceStatsName returns the POSIX shared-memory name
+ *       of the capture's per-source stats table (also given in its
+ *       udp_capture/src_stats ProcLog), for other processes to map.
+ * \note Tables are named /bifrost_udp_capture.<pid>.<n> (i.e., the files
+ *         /dev/shm/bifrost_udp_capture.<pid>.<n>) and are removed when the
+ *         capture is destroyed. Those left behind by a process that crashed
+ *         are removed once a capture is created by any later process (or
+ *         may simply be deleted by hand).
+ */
+BFstatus bfUdpCaptureGetSourceStatsName(BFudpcapture obj, const char** name);
+/*! \p bfUdpCaptureGetSourceStats copies a snapshot of the stats of the
+ *       first \p nsrc sources.
+ */
+BFstatus bfUdpCaptureGetSourceStats(BFudpcapture            obj,
+                                    BFsize                  nsrc,
+                                    BFudpcapture_src_stats* stats);
 BFstatus bfUdpCaptureDestroy(BFudpcapture obj);
 BFstatus bfUdpCaptureRecv(BFudpcapture obj, BFudpcapture_status* result);
+
+/*! An event reported by a capture's internal thread (see \p bfUdpCaptureStart).
+ */
+typedef struct BFudpcapture_event_ {
+	BFudpcapture_status status;   // STARTED, CHANGED, ENDED, INTERRUPTED or ERROR
+	BFoffset            seq;      // First seq of the sequence (or, for ENDED,
+	                              //   the seq after its last buffer)
+	BFoffset            time_tag; // Time tag of the sequence
+	int                 chan0;
+	int                 nchan;
+	BFoffset            time;     // When the event occurred (ns since the epoch)
+	BFoffset            nlost;    // No. events dropped before this one because
+	                              //   the queue was full
+} BFudpcapture_event;
+
+/*! \p bfUdpCaptureStart starts capturing continuously on an internal thread,
+ *       bound to the first core, so that the capture does not depend on
+ *       how quickly \p bfUdpCaptureRecv is called (e.g., from Python).
+ * \note The thread reports the start, change and end of each sequence
+ *         (and any interruption or error, after which it exits) through a
+ *         lock-free queue, which is read with \p bfUdpCapturePollEvent.
+ * \note The sequence callback is called from the internal thread.
+ * \note While running, \p bfUdpCaptureRecv, \p bfUdpCaptureFlush,
+ *         \p bfUdpCaptureEnd and the setters fail with
+ *         BF_STATUS_INVALID_STATE.
+ * \note A thread that exits by itself (after an interruption or error)
+ *         first commits its open buffers, and then no longer counts as
+ *         running, so the capture may be used (or started) again without
+ *         calling \p bfUdpCaptureStop.
+ */
+BFstatus bfUdpCaptureStart(BFudpcapture obj);
+/*! \p bfUdpCaptureStop stops the internal thread once it has finished its
+ *       current gulp (which may take up to the socket's timeout), leaving
+ *       any open buffers to a later \p bfUdpCaptureFlush or
+ *       \p bfUdpCaptureEnd.
+ */
+BFstatus bfUdpCaptureStop(BFudpcapture obj);
+/*! \p bfUdpCapturePollEvent pops the next event from the internal thread
+ *       without blocking.
+ * \return BF_STATUS_WOULD_BLOCK if there is no event yet, or
+ *          BF_STATUS_END_OF_DATA if there is none and the thread has exited
+ *          or is not running.
+ */
+BFstatus bfUdpCapturePollEvent(BFudpcapture obj, BFudpcapture_event* event);
 BFstatus bfUdpCaptureFlush(BFudpcapture obj);
 BFstatus bfUdpCaptureEnd(BFudpcapture obj);
 // TODO: bfUdpCaptureGetXX
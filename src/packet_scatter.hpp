@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Scatter kernels for packet capture, with runtime dispatch between scalar,
+//   AVX2 and AVX-512 versions. When a payload lands contiguously in the
+//   output (i.e., a single source), the SIMD versions write it with
+//   non-temporal (streaming) stores, as it is written once and not read again
+//   by the capture core, so there is no point caching it there.
+// Note: Strided chunks only fill part of each cache line, and streaming
+//         those turns out to be much slower than ordinary stores (see
+//         test/benchmarks/general/backend/packet_scatter.cpp), so they are
+//         not streamed.
+// Note: Streaming stores are weakly ordered; call scatter_fence() before the
+//         output is handed on to another thread (e.g., committed).
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BF_SCATTER_X86 1
+#include <immintrin.h>
+#else
+#define BF_SCATTER_X86 0
+#endif
+
+enum {
+	SCATTER_CHUNK_SIZE = 32 // Bytes per channel in a CHIPS payload
+};
+
+enum ScatterISA {
+	SCATTER_SCALAR,
+	SCATTER_AVX2,
+	SCATTER_AVX512
+};
+
+// Copies nchan 32-byte chunks from in (contiguous, any alignment) to out,
+//   with the chunks separated by stride bytes in the output
+// Note: The SIMD versions require out and stride to be 32-byte aligned
+typedef void (*scatter_func)(uint8_t*       out,
+                             const uint8_t* in,
+                             int            nchan,
+                             size_t         stride);
+
+inline void scatter_scalar(uint8_t*       out,
+                           const uint8_t* in,
+                           int            nchan,
+                           size_t         stride) {
+	for( int chan=0; chan<nchan; ++chan ) {
+		::memcpy(out + chan*stride, in + chan*SCATTER_CHUNK_SIZE,
+		         SCATTER_CHUNK_SIZE);
+	}
+}
+
+#if BF_SCATTER_X86
+__attribute__((target("avx2")))
+inline void scatter_avx2(uint8_t*       out,
+                         const uint8_t* in,
+                         int            nchan,
+                         size_t         stride) {
+	if( stride == SCATTER_CHUNK_SIZE ) {
+		for( int chan=0; chan<nchan; ++chan ) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(in + chan*SCATTER_CHUNK_SIZE));
+			_mm256_stream_si256((__m256i*)(out + chan*SCATTER_CHUNK_SIZE), v);
+		}
+	} else {
+		for( int chan=0; chan<nchan; ++chan ) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(in + chan*SCATTER_CHUNK_SIZE));
+			_mm256_store_si256((__m256i*)(out + chan*stride), v);
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+inline void scatter_avx512(uint8_t*       out,
+                           const uint8_t* in,
+                           int            nchan,
+                           size_t         stride) {
+	if( stride != SCATTER_CHUNK_SIZE || ((uintptr_t)out & 63) ) {
+		return scatter_avx2(out, in, nchan, stride);
+	}
+	int chan = 0;
+	for( ; chan+1<nchan; chan+=2 ) {
+		__m512i v = _mm512_loadu_si512(in + chan*SCATTER_CHUNK_SIZE);
+		_mm512_stream_si512((__m512i*)(out + chan*SCATTER_CHUNK_SIZE), v);
+	}
+	if( chan < nchan ) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + chan*SCATTER_CHUNK_SIZE));
+		_mm256_stream_si256((__m256i*)(out + chan*SCATTER_CHUNK_SIZE), v);
+	}
+}
+#endif // BF_SCATTER_X86
+
+// Returns the best ISA supported by this CPU
+inline ScatterISA scatter_isa_detect() {
+#if BF_SCATTER_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx512f") ) {
+		return SCATTER_AVX512;
+	} else if( __builtin_cpu_supports("avx2") ) {
+		return SCATTER_AVX2;
+	}
+#endif
+	return SCATTER_SCALAR;
+}
+inline const char* scatter_isa_name(ScatterISA isa) {
+	switch( isa ) {
+	case SCATTER_AVX512: return "avx512";
+	case SCATTER_AVX2:   return "avx2";
+	default:             return "scalar";
+	}
+}
+inline scatter_func scatter_select(ScatterISA isa) {
+#if BF_SCATTER_X86
+	switch( isa ) {
+	case SCATTER_AVX512: return &scatter_avx512;
+	case SCATTER_AVX2:   return &scatter_avx2;
+	default: break;
+	}
+#endif
+	return &scatter_scalar;
+}
+inline void scatter_fence() {
+#if BF_SCATTER_X86
+	_mm_sfence();
+#endif
+}
@@ -33,6 +33,8 @@
 #include "ring_impl.hpp"
 #include "assert.hpp"
 #include <cstring> // For ::memset
+#include <vector>
+#include <algorithm>
 
 BFstatus bfRingCreate(BFring* ring, char const* name, BFspace space) {
 	BF_ASSERT(ring, BF_STATUS_INVALID_POINTER);
@@ -40,6 +42,27 @@ BFstatus bfRingCreate(BFring* ring, char const* name, BFspace space) {
 	BF_TRY_RETURN_ELSE(*ring = new BFring_impl(name, space),
 	                   *ring = 0);
 }
+BFstatus bfRingCreateShared(BFring* ring, char const* name, BFspace space) {
+	BF_ASSERT(ring, BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(name, BF_STATUS_INVALID_POINTER);
+	*ring = 0;
+	BF_TRY_RETURN_ELSE(*ring = new BFring_impl(name, space);
+	                   (*ring)->open_shared(true),
+	                   delete *ring; *ring = 0);
+}
+BFstatus bfRingAttach(BFring* ring, char const* name) {
+	BF_ASSERT(ring, BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(name, BF_STATUS_INVALID_POINTER);
+	*ring = 0;
+	BF_TRY_RETURN_ELSE(*ring = new BFring_impl(name, BF_SPACE_SYSTEM);
+	                   (*ring)->open_shared(false),
+	                   delete *ring; *ring = 0);
+}
+BFstatus bfRingGetShared(BFring ring, BFbool* shared) {
+	BF_ASSERT(ring,   BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(shared, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(*shared = ring->shared());
+}
 BFstatus bfRingDestroy(BFring ring) {
 	BF_ASSERT(ring, BF_STATUS_INVALID_HANDLE);
 	delete ring;
@@ -76,6 +99,35 @@ BFstatus bfRingGetAffinity(BFring ring, int* core) {
 	BF_ASSERT(core,  BF_STATUS_INVALID_POINTER);
 	BF_TRY_RETURN(*core = ring->core());
 }
+BFstatus bfRingSetLockFree(BFring ring, BFbool  lockfree) {
+	BF_ASSERT(ring, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(ring->set_lockfree(lockfree));
+}
+BFstatus bfRingGetLockFree(BFring ring, BFbool* lockfree) {
+	BF_ASSERT(ring,     BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(lockfree, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(*lockfree = ring->lockfree());
+}
+BFstatus bfRingSetMirrored(BFring ring, BFbool  mirrored) {
+	BF_ASSERT(ring, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(ring->set_mirrored(mirrored));
+}
+BFstatus bfRingGetMirrored(BFring ring, BFbool* mirrored) {
+	BF_ASSERT(ring,     BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(mirrored, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(*mirrored = ring->mirrored());
+}
+BFstatus bfRingSetWaitPolicy(BFring ring, BFringwait policy, BFsize spin_count) {
+	BF_ASSERT(ring, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(ring->set_wait_policy(policy, spin_count));
+}
+BFstatus bfRingGetWaitPolicy(BFring ring, BFringwait* policy, BFsize* spin_count) {
+	BF_ASSERT(ring,       BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(policy,     BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(spin_count, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(*policy     = ring->wait_policy();
+	              *spin_count = ring->wait_spin_count());
+}
 BFstatus bfRingLock(BFring ring) {
 	BF_ASSERT(ring, BF_STATUS_INVALID_HANDLE);
 	BF_TRY_RETURN(ring->lock());
@@ -202,6 +254,21 @@ BFstatus bfRingSequenceClose(BFrsequence sequence) {
 	delete sequence;
 	return BF_STATUS_SUCCESS;
 }
+BFstatus bfRingSequenceSetView(BFrsequence sequence,
+                               BFsize      ringlet_offset,
+                               BFsize      nringlet,
+                               BFsize      frame_offset,
+                               BFsize      frame_width,
+                               BFsize      frame_stride) {
+	BF_ASSERT(sequence, BF_STATUS_INVALID_HANDLE);
+	BFrsequence_impl::View view;
+	view.ringlet_offset = ringlet_offset;
+	view.nringlet       = nringlet;
+	view.frame_offset   = frame_offset;
+	view.frame_width    = frame_width;
+	view.frame_stride   = frame_stride;
+	BF_TRY_RETURN(sequence->set_view(view));
+}
 
 BFstatus    bfRingSequenceGetRing(BFsequence sequence, BFring* ring) {
 	BF_ASSERT(sequence, BF_STATUS_INVALID_HANDLE);
@@ -272,6 +339,90 @@ BFstatus   bfRingSpanRelease(BFrspan span) {
 	delete span;
 	return BF_STATUS_SUCCESS;
 }
+static BFsize acquire_rspans(BFrspan*    spans,
+                             BFrsequence sequence,
+                             BFoffset    offset,
+                             BFsize      nspan,
+                             BFsize      span_size) {
+	std::vector<BFsize>   sizes(nspan);
+	std::vector<BFoffset> begins(nspan);
+	std::vector<void*>    datas(nspan);
+	BFsize n = sequence->ring()->acquire_spans(sequence,
+	                                           sequence->view_to_sequence(offset),
+	                                           nspan,
+	                                           sequence->view_to_sequence(span_size),
+	                                           &sizes[0], &begins[0], &datas[0]);
+	BFsize i = 0;
+	try {
+		for( ; i<n; ++i ) {
+			spans[i] = new BFrspan_impl(sequence, span_size,
+			                            sizes[i], begins[i], datas[i]);
+		}
+	} catch( ... ) {
+		// Note: All n spans are held by the ring, but only the first i
+		//         have wrappers
+		sequence->ring()->release_spans(n);
+		for( BFsize j=0; j<i; ++j ) {
+			spans[j]->set_released();
+			delete spans[j];
+			spans[j] = 0;
+		}
+		throw;
+	}
+	return n;
+}
+static void release_rspans(BFrspan* spans,
+                           BFsize   nspan) {
+	spans[0]->ring()->release_spans(nspan);
+	for( BFsize i=0; i<nspan; ++i ) {
+		spans[i]->set_released();
+		delete spans[i];
+		spans[i] = 0;
+	}
+}
+BFstatus   bfRingSpanAcquireMany(BFrspan*    spans,
+                                 BFsize*     nacquired,
+                                 BFrsequence sequence,
+                                 BFoffset    offset,
+                                 BFsize      nspan,
+                                 BFsize      span_size) {
+	BF_ASSERT(spans,     BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(nacquired, BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(sequence,  BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(nspan > 0, BF_STATUS_INVALID_ARGUMENT);
+	BF_TRY_RETURN_ELSE(*nacquired = acquire_rspans(spans, sequence, offset,
+	                                               nspan, span_size),
+	                   *nacquired = 0);
+}
+BFstatus   bfRingSpanReleaseMany(BFrspan* spans,
+                                 BFsize   nspan) {
+	if( !nspan ) {
+		return BF_STATUS_SUCCESS;
+	}
+	BF_ASSERT(spans, BF_STATUS_INVALID_POINTER);
+	for( BFsize i=0; i<nspan; ++i ) {
+		BF_ASSERT(spans[i], BF_STATUS_INVALID_HANDLE);
+		BF_ASSERT(!spans[i]->released(), BF_STATUS_INVALID_HANDLE);
+		BF_ASSERT(spans[i]->sequence() == spans[0]->sequence(),
+		          BF_STATUS_INVALID_ARGUMENT);
+	}
+	// Each span must appear only once, otherwise the ring's count of open
+	//   reads would be decremented more than once for it.
+	std::vector<BFrspan> sorted(spans, spans + nspan);
+	std::sort(sorted.begin(), sorted.end());
+	BF_ASSERT(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end(),
+	          BF_STATUS_INVALID_ARGUMENT);
+	BF_TRY_RETURN(release_rspans(spans, nspan));
+}
+BFstatus bfRingDump(BFring   ring,
+                    BFoffset time_tag_begin,
+                    BFoffset time_tag_end,
+                    int      fd) {
+	BF_ASSERT(ring,                          BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(fd >= 0,                       BF_STATUS_INVALID_ARGUMENT);
+	BF_ASSERT(time_tag_begin < time_tag_end, BF_STATUS_INVALID_ARGUMENT);
+	BF_TRY_RETURN(ring->dump(time_tag_begin, time_tag_end, fd));
+}
 
 // Returns in *val the number of bytes in the span that have been overwritten
 //   at the time of the call (always zero for guaranteed sequences).
@@ -326,6 +477,12 @@ BFstatus bfRingSpanGetNRinglet(BFspan span, BFsize* val) {
 	BF_TRY_RETURN_ELSE(*val = span->nringlet(),
 	                   *val = 0);
 }
+BFstatus bfRingSpanGetFrameStride(BFspan span, BFsize* val) {
+	BF_ASSERT(span, BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(val,  BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN_ELSE(*val = span->frame_stride(),
+	                   *val = 0);
+}
 BFstatus bfRingSpanGetInfo(BFspan span, BFspan_info* span_info) {
 	BF_ASSERT(span,      BF_STATUS_INVALID_HANDLE);
 	BF_ASSERT(span_info, BF_STATUS_INVALID_POINTER);
@@ -334,6 +491,7 @@ BFstatus bfRingSpanGetInfo(BFspan span, BFspan_info* span_info) {
 	                   span_info->size     = span->size();
 	                   span_info->stride   = span->stride();
 	                   span_info->offset   = span->offset();
-	                   span_info->nringlet = span->nringlet(),
+	                   span_info->nringlet = span->nringlet();
+	                   span_info->frame_stride = span->frame_stride(),
 	                   ::memset(span_info, 0, sizeof(BFspan_info)));
 }
@@ -57,6 +57,42 @@
 #include <numa.h>
 #endif
 
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cerrno>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#if BF_RING_MIRROR_SUPPORTED
+// Note: span must be a multiple of the page size
+// Note: The memfd is returned in *fd so that the buffer can later be grown
+//         in place (see BFring_impl::_grow_mirrored).
+static void* mirrored_malloc(BFsize span, BFsize nringlet, int* fd) {
+	*fd = syscall(__NR_memfd_create, "bifrost_ring", 0);
+	if( *fd == -1 ) {
+		return nullptr;
+	}
+	void* ptr = nullptr;
+	if( ftruncate(*fd, span*nringlet) == 0 ) {
+		ptr = ring_map_mirrored(*fd, span, nringlet);
+	}
+	if( !ptr ) {
+		::close(*fd);
+		*fd = -1;
+	}
+	return ptr;
+}
+static void mirrored_free(void* ptr, BFsize span, BFsize nringlet, int fd) {
+	::munmap(ptr, 2*span*nringlet);
+	if( fd != -1 ) {
+		::close(fd);
+	}
+}
+#endif
+
 // This implements a lock with the condition that no reads or writes
 //   can be open while it is held.
 class RingReallocLock {
@@ -75,7 +111,7 @@ public:
 		++_ring->_nrealloc_pending;
 		_ring->_realloc_condition.wait(_lock, [this]() {
 			return (_ring->_nwrite_open == 0 &&
-			        _ring->_nread_open == 0);
+			        _ring->_nread_open_total() == 0);
 		});
 	}
 	inline ~RingReallocLock() {
@@ -91,8 +127,29 @@ BFring_impl::BFring_impl(const char* name, BFspace space)
 	  _tail(0), _head(0), _reserve_head(0),
 	  _ghost_dirty_beg(_ghost_span),
 	  _writing_begun(false), _writing_ended(false), _eod(0),
+	  _lockfree(false), _mirrored(false), _mirror_fd(-1), _mutex(this),
 	  _nread_open(0), _nwrite_open(0), _nrealloc_pending(0),
-	  _core(-1), _size_log(std::string("rings/")+name) {
+	  _nread_waiting(0), _nwrite_waiting(0), _nwrite_close_waiting(0),
+	  _wait_policy(BF_RING_WAIT_BLOCK), _wait_spin_count(0),
+	  _nbyte_committed(0), _fill_high_water(0), _ncommit(0),
+	  _proclog_time(clock_type::now()),
+	  _core(-1), _size_log(std::string("rings/")+name),
+	  _sequence_first(0), _nsequence(0),
+	  _nsequence_untagged(0), _nsequence_unsorted(0), _last_time_tag(0),
+	  _earliest_sequence_end(BFsequence_impl::BF_SEQUENCE_OPEN),
+	  _local_guarantee_slot_mask(0),
+	  _local_guarantee_min(0),
+	  _guarantee_slot_mask(&_local_guarantee_slot_mask),
+	  _guarantee_slots(_local_guarantee_slots),
+	  _guarantee_min(&_local_guarantee_min),
+	  _noverflow_guarantees(0),
+	  _shm(nullptr), _shm_owner(false), _shm_generation(0),
+	  _shm_seq_first(0), _shm_seq_next(0),
+	  _shm_seqs(nullptr), _shm_seq_capacity(0), _shm_seq_generation(0),
+	  _shm_reader(-1) {
+	for( int slot=0; slot<MAX_GUARANTEES; ++slot ) {
+		_local_guarantee_slots[slot] = 0;
+	}
 
 #if defined BF_CUDA_ENABLED && BF_CUDA_ENABLED
 	BF_ASSERT_EXCEPTION(space==BF_SPACE_SYSTEM       ||
@@ -106,13 +163,43 @@ BFring_impl::BFring_impl(const char* name, BFspace space)
 #endif
 	
 	// Create the ProcLog entry for this ring
+	lock_guard_type lock(_mutex);
 	_write_proclog_entry();
 }
 BFring_impl::~BFring_impl() {
 	// TODO: Should check if anything is still open here?
 	if( _buf ) {
-		bfFree(_buf, _space);
+		this->_free_buf();
 	}
+	if( _shm ) {
+		this->_shm_close();
+	}
+}
+void BFring_impl::_free_buf() {
+#if BF_RING_MIRROR_SUPPORTED
+	if( _mirrored ) {
+		mirrored_free(_buf, _span, _nringlet, _mirror_fd);
+		_mirror_fd = -1;
+		if( _shm_owner ) {
+			::shm_unlink(this->_shm_name(_shm_generation, "data").c_str());
+		}
+		return;
+	}
+#endif
+	bfFree(_buf, _space);
+}
+void BFring_impl::set_mirrored(bool mirrored) {
+	lock_guard_type lock(_mutex);
+	BF_ASSERT_EXCEPTION(!mirrored || BF_RING_MIRROR_SUPPORTED,
+	                    BF_STATUS_UNSUPPORTED);
+	BF_ASSERT_EXCEPTION(!mirrored || _space == BF_SPACE_SYSTEM,
+	                    BF_STATUS_UNSUPPORTED_SPACE);
+	// Note: The buffer cannot change allocation mode once it exists
+	BF_ASSERT_EXCEPTION(!_buf || mirrored == _mirrored, BF_STATUS_INVALID_STATE);
+	_mirrored = mirrored;
+	
+	// Update the ProcLog entry for this ring
+	_write_proclog_entry();
 }
 void BFring_impl::resize(BFsize contiguous_span,
                          BFsize total_span,
@@ -124,6 +211,8 @@ void BFring_impl::resize(BFsize contiguous_span,
 	    nringlet        <= _nringlet) {
 		return;
 	}
+	// Note: Only the owner of a shared ring can (re)allocate it
+	BF_ASSERT_EXCEPTION(!_shm || _shm_owner, BF_STATUS_UNSUPPORTED);
 	realloc_lock_type realloc_lock(lock, this);
 	// Check if reallocation is still actually necessary
 	if( contiguous_span <= _ghost_span &&
@@ -138,16 +227,24 @@ void BFring_impl::resize(BFsize contiguous_span,
 	//new_ghost_span = round_up(new_ghost_span, bfGetAlignment());
 	//new_span       = round_up(new_span,       bfGetAlignment());
 	new_span = std::max(new_span, bfGetAlignment());
-	// **TODO: See if can avoid doing this, so that ghost-region memcpys can
-	//           be avoided if user chooses gulp sizes in whole multiplies
-	//           regardless of whether they are powers of two or not.
-	// Note: This is critical to enable safe overflowing/wrapping of offsets
-	new_span = round_up_pow2(new_span);
+	// Note: The span is deliberately _not_ rounded up to a power of two, so
+	//         that gulp sizes in whole multiples of the span never need
+	//         ghost-region copies. Wrapping of offsets is instead handled by
+	//         the signed arithmetic in _buf_offset and the rebasing of
+	//         _offset0 in _pull_tail.
 	// This is just to ensure nice indexing
 	// TODO: Not sure if this is a good idea or not
 	//new_ghost_span = round_up_pow2(new_ghost_span);
 	new_ghost_span = round_up(new_ghost_span, bfGetAlignment());
-	BFsize  new_stride = new_span + new_ghost_span;
+	if( _mirrored ) {
+		// The second mapping of the span serves as the ghost region, so the
+		//   whole span is contiguous and the mappings must be page-aligned.
+		new_span       = round_up(std::max(new_span, new_ghost_span),
+		                          (BFsize)sysconf(_SC_PAGESIZE));
+		new_ghost_span = new_span;
+	}
+	// Note: Ringlets must still start on aligned boundaries
+	BFsize  new_stride = round_up(new_span + new_ghost_span, bfGetAlignment());
 	BFsize  new_nbyte  = new_stride*new_nringlet;
 	//pointer new_buf    = (pointer)bfMalloc(new_nbyte, _space);
 	//std::cout << "new_buf = " << (void*)new_buf << std::endl; // HACK TESTING
@@ -159,6 +256,26 @@ void BFring_impl::resize(BFsize contiguous_span,
 	//std::cout << "new_nringlet:   " << new_nringlet << std::endl;
 	//std::cout << "new_stride:     " << new_stride << std::endl;
 	//std::cout << "Allocating " << new_nbyte << std::endl;
+	int new_mirror_fd = -1;
+#if BF_RING_MIRROR_SUPPORTED
+	if( _buf && _mirrored && !_shm && _nringlet == 1 && new_nringlet == 1 &&
+	    this->_grow_mirrored(new_span) ) {
+		// The buffer was grown in place
+		_stride = new_stride;
+		
+		// Update the ProcLog entry for this ring
+		_write_proclog_entry();
+		return;
+	}
+	if( _shm ) {
+		new_buf = this->_shm_map_buf(_shm_generation + 1, new_span, new_nringlet);
+		// Note: On failure, _shm_map_buf has already unlinked the new segment
+		BF_ASSERT_EXCEPTION(new_buf, BF_STATUS_MEM_ALLOC_FAILED);
+	} else if( _mirrored ) {
+		new_buf = (pointer)mirrored_malloc(new_span, new_nringlet, &new_mirror_fd);
+		BF_ASSERT_EXCEPTION(new_buf, BF_STATUS_MEM_ALLOC_FAILED);
+	} else
+#endif
 	BF_ASSERT_EXCEPTION(bfMalloc((void**)&new_buf, new_nbyte, _space) == BF_STATUS_SUCCESS,
 	                    BF_STATUS_MEM_ALLOC_FAILED);
 #if BF_NUMA_ENABLED
@@ -169,14 +286,23 @@ void BFring_impl::resize(BFsize contiguous_span,
 		numa_tonode_memory(new_buf, new_nbyte, node);
 	}
 #endif
-	if( _buf ) {
+	if( _buf && _mirrored ) {
+		// The live data are always contiguous, so just move them to the
+		//   beginning and let the mirror take care of the ghost region.
+		bfMemcpy2D(new_buf,                   new_stride, _space,
+		           _buf + _buf_offset(_tail),    _stride, _space,
+		           BFoffset(_head - _tail), _nringlet);
+		_offset0 = _tail.load();
+		this->_free_buf();
+	}
+	else if( _buf ) {
 		// Must move existing data and delete old buf
 		if( _buf_offset(_tail) < _buf_offset(_head) ) {
 			// Copy middle to beginning
 			bfMemcpy2D(new_buf,                   new_stride, _space,
 			           _buf + _buf_offset(_tail),    _stride, _space,
 			           BFoffset(_head - _tail), _nringlet);
-			_offset0 = _tail;
+			_offset0 = _tail.load();
 		}
 		else {
 			// Copy beg to beg and end to end, with larger gap between
@@ -199,20 +325,81 @@ void BFring_impl::resize(BFsize contiguous_span,
 		//_ghost_dirty = true; // TODO: Is this the right thing to do?
 		//_ghost_dirty_beg = new_ghost_span; // TODO: Is this the right thing to do?
 		_ghost_dirty_beg = 0; // TODO: Is this the right thing to do?
-		bfFree(_buf, _space);
+		this->_free_buf();
 		bfStreamSynchronize();
 	}
 	_buf        = new_buf;
+	_mirror_fd  = new_mirror_fd;
 	_ghost_span = new_ghost_span;
 	_span       = new_span;
 	_stride     = new_stride;
 	_nringlet   = new_nringlet;
+	if( _shm ) {
+		++_shm_generation;
+	}
 	
 	// Update the ProcLog entry for this ring
 	_write_proclog_entry();
 }
+#if BF_RING_MIRROR_SUPPORTED
+bool BFring_impl::_grow_mirrored(BFsize new_span) {
+	// Note: The data stay where they are in the memfd (which is simply
+	//         extended and mapped again) except for the smaller of the two
+	//         parts of the live region [tail, head) that wrap around the end
+	//         of the old span, which is moved to sit next to the larger part.
+	//         The cost is thus at most half of the live data, and zero if it
+	//         does not wrap.
+	if( _mirror_fd == -1 || new_span <= _span ||
+	    ::ftruncate(_mirror_fd, new_span) != 0 ) {
+		return false;
+	}
+	pointer new_buf = (pointer)ring_map_mirrored(_mirror_fd, new_span, 1);
+	if( !new_buf ) {
+		return false;
+	}
+#if BF_NUMA_ENABLED
+	if( _core != -1 ) {
+		numa_tonode_memory(new_buf, new_span, numa_node_of_cpu(_core));
+	}
+#endif
+	BFoffset tail     = _tail;
+	BFsize   nlive    = _head - tail;
+	BFsize   tail_off = _buf_offset(tail);
+	BFsize   nend     = std::min(nlive, _span - tail_off); // In [tail_off,span)
+	BFsize   nbeg     = nlive - nend;                      // In [0,nbeg)
+	BFsize   grow     = new_span - _span;
+	if( nbeg <= nend ) {
+		// Move the beginning to follow the end (i.e., to [span,span+nbeg)).
+		// Note: If nbeg > grow this wraps around onto data that have already
+		//         been moved, so it is done in chunks of at most grow bytes.
+		for( BFsize i=0; i<nbeg; i+=grow ) {
+			::memcpy(new_buf + _span + i, new_buf + i, std::min(grow, nbeg - i));
+		}
+		_offset0 = tail - tail_off;
+	} else {
+		// Move the end up to the end of the new span
+		::memmove(new_buf + tail_off + grow, new_buf + tail_off, nend);
+		_offset0 = tail - (tail_off + grow);
+	}
+	mirrored_free(_buf, _span, 1, -1);
+	_buf        = new_buf;
+	_ghost_span = new_span;
+	_span       = new_span;
+	return true;
+}
+#endif
+void BFring_impl::set_lockfree(bool lockfree) {
+	lock_guard_type lock(_mutex);
+	// Note: Shared rings publish their state when unlocking, so they
+	//         cannot bypass the lock.
+	BF_ASSERT_EXCEPTION(!lockfree || !_shm, BF_STATUS_UNSUPPORTED);
+	BF_ASSERT_EXCEPTION(!_nread_open && !_nwrite_open, BF_STATUS_INVALID_STATE);
+	_lockfree = lockfree;
+}
 void BFring_impl::begin_writing() {
 	lock_guard_type lock(_mutex);
+	// Note: Only the owner of a shared ring can write to it
+	BF_ASSERT_EXCEPTION(!_shm || _shm_owner, BF_STATUS_UNSUPPORTED);
 	BF_ASSERT_EXCEPTION(!_writing_begun, BF_STATUS_INVALID_STATE);
 	BF_ASSERT_EXCEPTION(!_writing_ended, BF_STATUS_INVALID_STATE);
 	_writing_begun = true;
@@ -244,12 +431,38 @@ BFoffset BFring_impl::_buf_offset(BFoffset offset) const {
 	//while( offset < _offset0 ) {
 	//	offset += _span;
 	//}
-	return (offset - _offset0) % _span;
+	// Note: The difference is taken as signed because offsets can legitimately
+	//         lie before _offset0 (e.g., the tail after a resize), and
+	//         unsigned wrapping only commutes with % when _span is a power
+	//         of two.
+	BFdelta buf_offset = BFdelta(offset - _offset0) % BFdelta(_span);
+	return (buf_offset < 0) ? buf_offset + _span : buf_offset;
 }
 BFring_impl::pointer BFring_impl::_buf_pointer(BFoffset offset) const {
 	return _buf + _buf_offset(offset);
 }
+bool BFring_impl::_ghost_write_needed(BFoffset offset, BFsize span) const {
+	if( _mirrored ) {
+		return false;
+	}
+	BFoffset buf_offset_beg = _buf_offset(offset);
+	BFoffset buf_offset_end = _buf_offset(offset + span);
+	return (buf_offset_end < buf_offset_beg ||
+	        buf_offset_beg < (BFoffset)_ghost_span);
+}
+bool BFring_impl::_ghost_read_needed(BFoffset offset, BFsize span) const {
+	if( _mirrored ) {
+		return false;
+	}
+	BFoffset buf_offset_beg = _buf_offset(offset);
+	BFoffset buf_offset_end = _buf_offset(offset + span);
+	return buf_offset_end < buf_offset_beg;
+}
 void BFring_impl::_ghost_write(BFoffset offset, BFsize span) {
+	if( _mirrored ) {
+		// The ghost region is a mapping of the front of the buffer
+		return;
+	}
 	BFoffset buf_offset_beg = _buf_offset(offset);
 	BFoffset buf_offset_end = _buf_offset(offset + span);
 	if( buf_offset_end < buf_offset_beg ) {
@@ -262,6 +475,9 @@ void BFring_impl::_ghost_write(BFoffset offset, BFsize span) {
 	}
 }
 void BFring_impl::_ghost_read(BFoffset offset, BFsize span) {
+	if( _mirrored ) {
+		return;
+	}
 	BFoffset buf_offset_beg = _buf_offset(offset);
 	BFoffset buf_offset_end = _buf_offset(offset + span);
 	if( buf_offset_end < buf_offset_beg ) {
@@ -299,34 +515,142 @@ BFsequence_sptr BFring_impl::begin_sequence(const char* name,
 	BF_ASSERT_EXCEPTION(header || !header_size, BF_STATUS_INVALID_ARGUMENT);
 	lock_guard_type lock(_mutex);
 	//unique_lock_type lock(_mutex);
+	BF_ASSERT_EXCEPTION(!_shm || _shm_owner,    BF_STATUS_UNSUPPORTED);
 	BF_ASSERT_EXCEPTION(nringlet <= _nringlet,  BF_STATUS_INVALID_ARGUMENT);
 	// Cannot have the previous sequence still open
-	BF_ASSERT_EXCEPTION(_sequence_queue.empty() ||
-	                    _sequence_queue.back()->is_finished(),
+	BF_ASSERT_EXCEPTION(!_nsequence ||
+	                    _back_sequence()->is_finished(),
 	                    BF_STATUS_INVALID_STATE);
 	BFoffset seq_begin = _head + offset_from_head;
 	// Cannot have existing sequence with same name
-	BF_ASSERT_EXCEPTION(_sequence_map.count(name)==0,              BF_STATUS_INVALID_ARGUMENT);
-	BF_ASSERT_EXCEPTION(_sequence_time_tag_map.count(time_tag)==0, BF_STATUS_INVALID_ARGUMENT);
-	BFsequence_sptr sequence(new BFsequence_impl(this, name, time_tag, header_size,
-	                                             header, nringlet, seq_begin));
-	if( _sequence_queue.size() ) {
-		_sequence_queue.back()->set_next(sequence);
-	}
-	_sequence_queue.push(sequence);
-	_sequence_condition.notify_all();
-	if( !std::string(name).empty() ) {
-		_sequence_map.insert(std::make_pair(std::string(name),sequence));
-	}
+	BF_ASSERT_EXCEPTION(!name[0] || !this->_find_sequence_by_name(name), BF_STATUS_INVALID_ARGUMENT);
+	// Cannot have existing sequence with same time_tag
 	if( time_tag != BFoffset(-1) ) {
-		_sequence_time_tag_map.insert(std::make_pair(time_tag,sequence));
+		BFsequence_sptr prev = this->_find_sequence_by_time_tag(time_tag);
+		BF_ASSERT_EXCEPTION(!prev || prev->time_tag() != time_tag, BF_STATUS_INVALID_ARGUMENT);
+	}
+	BFsequence_sptr sequence = this->_new_sequence(name, time_tag, header_size,
+	                                               header, nringlet, seq_begin);
+	if( _shm ) {
+		this->_shm_publish_sequence(sequence);
+	}
+	this->_push_sequence(sequence);
+	this->_update_earliest_sequence_end();
+	_sequence_condition.notify_all();
+	return sequence;
+}
+BFsequence_sptr BFring_impl::_new_sequence(const char* name,
+                                           BFoffset    time_tag,
+                                           BFsize      header_size,
+                                           const void* header,
+                                           BFsize      nringlet,
+                                           BFoffset    begin) {
+	if( _sequence_pool.empty() ) {
+		return std::make_shared<BFsequence_impl>(this, name, time_tag,
+		                                         header_size, header,
+		                                         nringlet, begin);
 	}
+	// Reuse an expired sequence (and its control block, name and header
+	//   storage) rather than going to the heap.
+	BFsequence_sptr sequence = std::move(_sequence_pool.back());
+	_sequence_pool.pop_back();
+	sequence->_assign(name, time_tag, header_size, header, nringlet, begin);
 	return sequence;
 }
+void BFring_impl::_push_sequence(BFsequence_sptr sequence) {
+	if( _nsequence == _sequences.size() ) {
+		// Grow the circular buffer (to a power of two), unwrapping it
+		std::vector<BFsequence_sptr> sequences(std::max(_sequences.size()*2,
+		                                                BFsize(16)));
+		for( BFsize i=0; i<_nsequence; ++i ) {
+			sequences[i] = std::move(_sequence_at_index(i));
+		}
+		_sequences.swap(sequences);
+		_sequence_first = 0;
+	}
+	BFoffset time_tag = sequence->_time_tag;
+	if( time_tag == BFoffset(-1) ) {
+		++_nsequence_untagged;
+	} else {
+		sequence->_time_tag_unsorted = (_nsequence && time_tag <= _last_time_tag);
+		_nsequence_unsorted += sequence->_time_tag_unsorted;
+		_last_time_tag = time_tag;
+	}
+	if( _nsequence ) {
+		_back_sequence()->set_next(sequence);
+	}
+	++_nsequence;
+	_back_sequence() = std::move(sequence);
+}
+void BFring_impl::_pop_sequence() {
+	BFsequence_sptr& slot = _front_sequence();
+	if( slot->_time_tag == BFoffset(-1) ) {
+		--_nsequence_untagged;
+	} else {
+		_nsequence_unsorted -= slot->_time_tag_unsorted;
+	}
+	++_sequence_first;
+	--_nsequence;
+	BFsequence_sptr sequence = std::move(slot);
+	// Recycle the sequence if nobody else (e.g., a reader, or the previous
+	//   sequence's _next) still refers to it.
+	if( sequence.use_count() == 1 &&
+	    _sequence_pool.size() < SEQUENCE_POOL_MAX ) {
+		// Note: Synchronises with the last other owner dropping its reference
+		std::atomic_thread_fence(std::memory_order_acquire);
+		sequence->_next.reset();
+		_sequence_pool.push_back(std::move(sequence));
+	}
+}
+BFsequence_sptr BFring_impl::_find_sequence_by_name(const char* name) {
+	uint64_t hash = BFsequence_impl::_hash_name(name);
+	for( BFsize i=0; i<_nsequence; ++i ) {
+		BFsequence_sptr const& sequence = _sequence_at_index(i);
+		if( sequence->_name_hash == hash &&
+		    sequence->_name == name ) {
+			return sequence;
+		}
+	}
+	return BFsequence_sptr();
+}
+BFsequence_sptr BFring_impl::_find_sequence_by_time_tag(BFoffset time_tag) {
+	// Returns the last sequence whose time_tag is <= time_tag
+	if( !_nsequence_untagged && !_nsequence_unsorted ) {
+		// Time tags are increasing in ring order, so binary search them
+		//   (after first checking the common case of the latest sequence).
+		if( !_nsequence ) {
+			return BFsequence_sptr();
+		}
+		if( _back_sequence()->_time_tag <= time_tag ) {
+			return _back_sequence();
+		}
+		BFsize lo = 0, hi = _nsequence - 1;
+		while( lo < hi ) {
+			BFsize mid = lo + (hi - lo) / 2;
+			if( _sequence_at_index(mid)->_time_tag <= time_tag ) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo ? _sequence_at_index(lo-1) : BFsequence_sptr();
+	}
+	BFsequence_sptr best;
+	for( BFsize i=0; i<_nsequence; ++i ) {
+		BFsequence_sptr const& sequence = _sequence_at_index(i);
+		if( sequence->_time_tag != BFoffset(-1) &&
+		    sequence->_time_tag <= time_tag &&
+		    (!best || sequence->_time_tag > best->_time_tag) ) {
+			best = sequence;
+		}
+	}
+	return best;
+}
 
 BFsequence_sptr BFring_impl::_get_sequence_by_name(const char* name) {
-	BF_ASSERT_EXCEPTION(_sequence_map.count(name), BF_STATUS_INVALID_ARGUMENT);
-	return _sequence_map.find(name)->second;
+	BFsequence_sptr sequence = this->_find_sequence_by_name(name);
+	BF_ASSERT_EXCEPTION(sequence, BF_STATUS_INVALID_ARGUMENT);
+	return sequence;
 }
 BFsequence_sptr BFring_impl::open_sequence_by_name(const char* name,
                                                    bool with_guarantee,
@@ -361,10 +685,9 @@ BFsequence_sptr BFring_impl::_get_sequence_at(BFoffset time_tag) {
 	//         TLDR; only use time_tag values representing times that have
 	//           already happened, and be careful not to call this function
 	//           before the very first sequence has been created.
-	auto iter = _sequence_time_tag_map.upper_bound(time_tag);
-	BF_ASSERT_EXCEPTION(iter != _sequence_time_tag_map.begin(),
-	                    BF_STATUS_INVALID_ARGUMENT);
-	return (--iter)->second;
+	BFsequence_sptr sequence = this->_find_sequence_by_time_tag(time_tag);
+	BF_ASSERT_EXCEPTION(sequence, BF_STATUS_INVALID_ARGUMENT);
+	return sequence;
 }
 BFsequence_sptr BFring_impl::open_sequence_at(BFoffset time_tag,
                                               bool with_guarantee,
@@ -391,16 +714,16 @@ bool BFring_impl::_sequence_still_within_ring(BFsequence_sptr sequence) const {
 	        BFoffset(_head - sequence->end()) <= BFoffset(_head - _tail));
 }
 
-BFsequence_sptr BFring_impl::_get_earliest_or_latest_sequence(unique_lock_type& lock, bool latest) const {
+BFsequence_sptr BFring_impl::_get_earliest_or_latest_sequence(unique_lock_type& lock, bool latest) {
 	// Wait until a sequence has been opened or writing has ended
 	_sequence_condition.wait(lock, [this]() {
-			return !_sequence_queue.empty() || _writing_ended;
+			return _nsequence || _writing_ended;
 		});
-	BF_ASSERT_EXCEPTION(!(_sequence_queue.empty() && !_writing_ended), BF_STATUS_INVALID_STATE);
-	BF_ASSERT_EXCEPTION(!(_sequence_queue.empty() &&  _writing_ended), BF_STATUS_END_OF_DATA);
+	BF_ASSERT_EXCEPTION(!(!_nsequence && !_writing_ended), BF_STATUS_INVALID_STATE);
+	BF_ASSERT_EXCEPTION(!(!_nsequence &&  _writing_ended), BF_STATUS_END_OF_DATA);
 	BFsequence_sptr sequence = (latest ?
-	                            _sequence_queue.back() :
-	                            _sequence_queue.front());
+	                            _back_sequence() :
+	                            _front_sequence());
 	// Check that the sequence is still within the ring
 	BF_ASSERT_EXCEPTION(this->_sequence_still_within_ring(sequence),
 	                    BF_STATUS_INVALID_ARGUMENT);
@@ -468,27 +791,154 @@ void BFring_impl::finish_sequence(BFsequence_sptr sequence,
                                   BFoffset offset_from_head) {
 	lock_guard_type lock(_mutex);
 	// Must have the sequence still open
-	BF_ASSERT_EXCEPTION(!_sequence_queue.empty() &&
-	                    !_sequence_queue.back()->is_finished(),
+	BF_ASSERT_EXCEPTION(_nsequence &&
+	                    !_back_sequence()->is_finished(),
 	                    BF_STATUS_INVALID_STATE);
 	// This marks the sequence as finished
 	sequence->_end = _head + offset_from_head;
+	this->_update_earliest_sequence_end();
+	if( _shm ) {
+		this->_shm_finish_sequence(sequence);
+	}
 	_read_condition.notify_all();
 }
+void BFring_impl::_update_earliest_sequence_end() {
+	_earliest_sequence_end = (!_nsequence ?
+	                          BFoffset(BFsequence_impl::BF_SEQUENCE_OPEN) :
+	                          _front_sequence()->end());
+}
 
 void BFring_impl::_write_proclog_entry() {
+	ProcLogEntry& entry = _proclog_entry;
+	entry.time              = clock_type::now();
+	entry.core              = _core;
+	entry.ghost_span        = _ghost_span;
+	entry.span              = _span;
+	entry.stride            = _stride;
+	entry.nringlet          = _nringlet;
+	entry.mirrored          = _mirrored;
+	entry.shared            = (_shm != nullptr);
+	entry.wait_policy       = _wait_policy;
+	entry.wait_spin_count   = _wait_spin_count;
+	entry.nbyte_committed   = _nbyte_committed.load();
+	BFoffset head = _head;
+	entry.fill              = head - _tail;
+	entry.fill_high_water   = _fill_high_water.load();
+	entry.read_wait_stats   = _read_wait_stats;
+	entry.write_wait_stats  = _write_wait_stats;
+	entry.commit_wait_stats = _commit_wait_stats;
+	entry.guarantees.clear();
+	for( size_t i=0; i<_guarantee_objs.size(); ++i ) {
+		entry.guarantees.push_back(std::make_pair(BFsize(head - _guarantee_objs[i]->offset()),
+		                                          BFsize(_guarantee_objs[i]->nbyte_read())));
+	}
+	_proclog_time = entry.time;
+	_mutex.log_on_unlock();
+}
+void BFring_impl::_log_proclog_entry(ProcLogEntry const& entry) {
 	char cinfo[32]="";
 	#if BF_NUMA_ENABLED
-	snprintf(cinfo, 31, "binding   : %i\n", _core);
+	snprintf(cinfo, 31, "binding   : %i\n", entry.core);
 	#endif
+	// Per-reader lines for each guaranteed reader in this process
+	std::string ginfo;
+	for( size_t i=0; i<entry.guarantees.size(); ++i ) {
+		char line[128];
+		snprintf(line, 127,
+		         "guarantee%lu_lag       : %llu\n"
+		         "guarantee%lu_nbyte_read: %llu\n",
+		         (unsigned long)i, (unsigned long long)entry.guarantees[i].first,
+		         (unsigned long)i, (unsigned long long)entry.guarantees[i].second);
+		ginfo += line;
+	}
+	WaitStats const& rstats = entry.read_wait_stats;
+	WaitStats const& wstats = entry.write_wait_stats;
+	WaitStats const& cstats = entry.commit_wait_stats;
 	_size_log.update("space     : %s\n"
 	                 "%s"
 	                 "alignment : %llu\n"
 	                 "ghost     : %llu\n"
 	                 "span      : %llu\n"
 	                 "stride    : %llu\n"
-	                 "nringlet  : %llu\n", 
-	                 bfGetSpaceString(_space), cinfo, bfGetAlignment(), _span, _ghost_span, _stride, _nringlet);
+	                 "nringlet  : %llu\n"
+	                 "mirrored  : %i\n"
+	                 "shared    : %i\n"
+	                 "wait_policy    : %i\n"
+	                 "wait_spin_count: %llu\n"
+	                 "nbyte_committed: %llu\n"
+	                 "fill           : %llu\n"
+	                 "fill_high_water: %llu\n"
+	                 "read_nwait_spun      : %llu\n"
+	                 "read_nwait_blocked   : %llu\n"
+	                 "read_wait_spin_secs  : %f\n"
+	                 "read_wait_block_secs : %f\n"
+	                 "read_wait_current_secs  : %f\n"
+	                 "write_nwait_spun     : %llu\n"
+	                 "write_nwait_blocked  : %llu\n"
+	                 "write_wait_spin_secs : %f\n"
+	                 "write_wait_block_secs: %f\n"
+	                 "write_wait_current_secs : %f\n"
+	                 "commit_nwait_blocked : %llu\n"
+	                 "commit_wait_secs     : %f\n"
+	                 "commit_wait_current_secs: %f\n"
+	                 "nguarantee     : %lu\n"
+	                 "%s", 
+	                 bfGetSpaceString(_space), cinfo, bfGetAlignment(),
+	                 entry.ghost_span, entry.span, entry.stride, entry.nringlet,
+	                 (int)entry.mirrored, (int)entry.shared,
+	                 (int)entry.wait_policy, entry.wait_spin_count,
+	                 entry.nbyte_committed, entry.fill, entry.fill_high_water,
+	                 rstats.nspun, rstats.nblocked,
+	                 rstats.spin_secs, rstats.block_secs,
+	                 rstats.current_secs(entry.time),
+	                 wstats.nspun, wstats.nblocked,
+	                 wstats.spin_secs, wstats.block_secs,
+	                 wstats.current_secs(entry.time),
+	                 cstats.nspun + cstats.nblocked,
+	                 cstats.spin_secs + cstats.block_secs,
+	                 cstats.current_secs(entry.time),
+	                 (unsigned long)entry.guarantees.size(),
+	                 ginfo.c_str());
+}
+bool BFring_impl::_update_proclog_entry() {
+	if( clock_type::now() - _proclog_time >=
+	    std::chrono::milliseconds(PROCLOG_INTERVAL_MS) ) {
+		_write_proclog_entry();
+		return true;
+	}
+	return false;
+}
+void BFring_impl::_note_commit(BFsize commit_size, bool locked) {
+	// Note: Only the (single) writer updates these
+	_nbyte_committed.store(_nbyte_committed.load(std::memory_order_relaxed) + commit_size,
+	                       std::memory_order_relaxed);
+	BFsize fill = _head - _tail;
+	if( fill > _fill_high_water.load(std::memory_order_relaxed) ) {
+		_fill_high_water.store(fill, std::memory_order_relaxed);
+	}
+	BFsize ncommit = _ncommit.load(std::memory_order_relaxed) + 1;
+	_ncommit.store(ncommit, std::memory_order_relaxed);
+	if( ncommit % PROCLOG_NCOMMIT == 0 ) {
+		if( locked ) {
+			this->_update_proclog_entry();
+		} else if( _mutex.try_lock() ) {
+			this->_update_proclog_entry();
+			_mutex.unlock();
+		}
+	}
+}
+void BFring_impl::set_wait_policy(BFringwait policy, BFsize spin_count) {
+	BF_ASSERT_EXCEPTION(policy == BF_RING_WAIT_BLOCK      ||
+	                    policy == BF_RING_WAIT_SPIN       ||
+	                    policy == BF_RING_WAIT_SPIN_YIELD ||
+	                    policy == BF_RING_WAIT_SPIN_THEN_BLOCK,
+	                    BF_STATUS_INVALID_ARGUMENT);
+	lock_guard_type lock(_mutex);
+	_wait_policy     = policy;
+	_wait_spin_count = spin_count;
+	
+	// Update the ProcLog entry for this ring
+	_write_proclog_entry();
 }
 
 BFsequence_impl::BFsequence_impl(BFring      ring,
@@ -503,12 +953,207 @@ BFsequence_impl::BFsequence_impl(BFring      ring,
 	  _end(BF_SEQUENCE_OPEN),
 	  _header((const char*)header,
 	          (const char*)header+header_size),
-	  _next(nullptr) {
+	  _next(nullptr),
+	  _name_hash(_hash_name(name)),
+	  _time_tag_unsorted(false) {
+}
+void BFsequence_impl::_assign(const char* name,
+                              BFoffset    time_tag,
+                              BFsize      header_size,
+                              const void* header,
+                              BFsize      nringlet,
+                              BFoffset    begin) {
+	// Note: assign() reuses the existing capacity where possible
+	_name.assign(name);
+	_time_tag = time_tag;
+	_nringlet = nringlet;
+	_begin    = begin;
+	_end      = BF_SEQUENCE_OPEN;
+	_header.assign((const char*)header,
+	               (const char*)header+header_size);
+	_next.reset();
+	_name_hash = _hash_name(name);
+	_time_tag_unsorted = false;
+}
+uint64_t BFsequence_impl::_hash_name(const char* name) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for( ; *name; ++name ) {
+		hash = (hash ^ (uint8_t)*name) * 0x100000001b3ull;
+	}
+	return hash;
 }
 
 void BFsequence_impl::set_next(BFsequence_sptr next) {
 	_next = next;
 }
+int BFring_impl::_add_guarantee(BFoffset offset) {
+	uint64_t mask = *_guarantee_slot_mask;
+	int slot;
+	if( ~mask ) {
+		slot = __builtin_ctzll(~mask);
+		_guarantee_slots[slot] = offset;
+		if( _shm ) {
+			_shm->guarantee_pids[slot] = ::getpid();
+		}
+		*_guarantee_slot_mask |= uint64_t(1) << slot;
+	} else {
+		// Note: Only the writer checks guarantees, so those of readers in
+		//         other processes must all fit in the shared slots.
+		BF_ASSERT_EXCEPTION(!_shm || _shm_owner, BF_STATUS_INSUFFICIENT_STORAGE);
+		// Take the lowest free overflow slot
+		slot = MAX_GUARANTEES;
+		for( guarantee_map::const_iterator it=_overflow_guarantees.begin();
+		     it!=_overflow_guarantees.end() && it->first == slot; ++it ) {
+			++slot;
+		}
+		_overflow_guarantees[slot] = offset;
+		++_noverflow_guarantees;
+	}
+	// Note: A lock-free writer may have published a new reserve head without
+	//         seeing this guarantee, so it is only effective from where that
+	//         reservation leaves off.
+	BFoffset reserve_head = _reserve_head;
+	if( BFoffset(reserve_head - offset) > _span &&
+	    BFdelta(reserve_head - offset) > 0 ) {
+		if( slot < MAX_GUARANTEES ) {
+			_guarantee_slots[slot] = reserve_head - _span;
+		} else {
+			_overflow_guarantees[slot] = reserve_head - _span;
+		}
+	}
+	if( slot >= MAX_GUARANTEES ) {
+		return slot;
+	}
+	// Keep the cached minimum a lower bound
+	// Note: This must be a CAS loop because the writer may be concurrently
+	//         raising it (see _rescan_guarantee_min).
+	BFoffset min_offset = *_guarantee_min;
+	while( BFdelta(offset - min_offset) < 0 &&
+	       !_guarantee_min->compare_exchange_weak(min_offset, offset) ) {}
+	return slot;
+}
+BFoffset BFring_impl::_move_guarantee(int slot, BFoffset old_offset,
+                                      BFoffset new_offset, bool locked) {
+	// Note: Guarantees never move backwards, which is what makes it safe for
+	//         readers to move them without the lock in lock-free mode, and
+	//         what keeps _guarantee_min a lower bound.
+	if( slot >= MAX_GUARANTEES ) {
+		unique_lock_type lock(_mutex, std::defer_lock);
+		if( !locked ) {
+			lock.lock();
+		}
+		BFoffset& cur_offset = _overflow_guarantees.at(slot);
+		if( BFdelta(new_offset - cur_offset) > 0 ) {
+			cur_offset = new_offset;
+			_write_condition.notify_all();
+		}
+		return cur_offset;
+	}
+	BFoffset cur_offset = _guarantee_slots[slot];
+	if( BFdelta(new_offset - cur_offset) <= 0 ) {
+		return cur_offset;
+	}
+	_guarantee_slots[slot] = new_offset;
+	if( locked ) {
+		_write_condition.notify_all();
+	} else {
+		this->_notify_if_waiting(_write_condition, _nwrite_waiting);
+	}
+	return new_offset;
+}
+void BFring_impl::_remove_guarantee(int slot) {
+	if( slot >= MAX_GUARANTEES ) {
+		_overflow_guarantees.erase(slot);
+		--_noverflow_guarantees;
+	} else {
+		*_guarantee_slot_mask &= ~(uint64_t(1) << slot);
+	}
+	_write_condition.notify_all();
+}
+BFoffset BFring_impl::_guarantee_offset(int slot) const {
+	if( slot >= MAX_GUARANTEES ) {
+		return _overflow_guarantees.at(slot);
+	}
+	return _guarantee_slots[slot];
+}
+bool BFring_impl::_overflow_guarantees_allow(BFoffset reserve_head) const {
+	for( guarantee_map::const_iterator it=_overflow_guarantees.begin();
+	     it!=_overflow_guarantees.end(); ++it ) {
+		if( BFoffset(reserve_head - it->second) > _span ) {
+			return false;
+		}
+	}
+	return true;
+}
+BFoffset BFring_impl::_rescan_guarantee_min(BFoffset reserve_head) {
+	BFoffset old_min = *_guarantee_min;
+	// Note: Guarantees are never more than a span behind the reserve head
+	//         (or the writer would not have got there), so this is an upper
+	//         bound on the minimum.
+	BFoffset min_offset = reserve_head;
+	uint64_t mask = *_guarantee_slot_mask;
+	while( mask ) {
+		int slot = __builtin_ctzll(mask);
+		mask &= mask - 1;
+		BFoffset offset = _guarantee_slots[slot];
+		if( BFoffset(reserve_head - offset) > _span &&
+		    _shm && ::kill(_shm->guarantee_pids[slot], 0) == -1 &&
+		    errno == ESRCH ) {
+			// The reader's process has died, so its guarantee is void
+			*_guarantee_slot_mask &= ~(uint64_t(1) << slot);
+			continue;
+		}
+		if( BFdelta(offset - min_offset) < 0 ) {
+			min_offset = offset;
+		}
+	}
+	// Note: If a guarantee was added (lowering the minimum) during the scan
+	//         then this fails and the lower value is kept.
+	if( !_guarantee_min->compare_exchange_strong(old_min, min_offset) ) {
+		return old_min;
+	}
+	return min_offset;
+}
+bool BFring_impl::_guarantees_allow(BFoffset reserve_head) {
+	if( !*_guarantee_slot_mask ||
+	    BFoffset(reserve_head - *_guarantee_min) <= _span ) {
+		return true;
+	}
+	BFoffset min_offset = this->_rescan_guarantee_min(reserve_head);
+	return (!*_guarantee_slot_mask ||
+	        BFoffset(reserve_head - min_offset) <= _span);
+}
+void BFring_impl::_pull_tail(BFoffset reserve_head) {
+	BFoffset cur_span = reserve_head - _tail;
+	if( cur_span > _span ) {
+		_tail += cur_span - _span;
+	}
+	// Keep _offset0 within a few spans of the tail so that the signed
+	//   difference in _buf_offset can never overflow. Moving it by whole
+	//   spans leaves every buffer offset unchanged, so this is safe for
+	//   concurrent readers, and doing it often keeps the path well exercised.
+	// Note: The tail may lie before _offset0 after a resize of wrapped data
+	//         (hence the signed check).
+	BFoffset lag = _tail - _offset0;
+	if( BFdelta(lag) > BFdelta(OFFSET0_MAX_LAG_NSPAN*_span) ) {
+		_offset0 += lag - lag % _span;
+	}
+}
+void BFring_impl::_expire_sequences() {
+	// Delete (recycle) old sequences
+	while( _nsequence &&
+	       //_front_sequence()->_end != BFsequence_impl::BF_SEQUENCE_OPEN &&
+	       _front_sequence()->is_finished() &&
+	       //_front_sequence()->_end <= _tail ) {
+	       BFoffset(_head - _front_sequence()->_end) >= BFoffset(_head - _tail) ) {
+		this->_pop_sequence();
+		if( _shm_owner ) {
+			++_shm->seq_first;
+		}
+	}
+	this->_update_earliest_sequence_end();
+}
 bool BFring_impl::_advance_reserve_head(unique_lock_type& lock, BFsize size,
                                         bool nonblocking) {
 	// This waits until all guarantees have caught up to the new valid
@@ -520,46 +1165,74 @@ bool BFring_impl::_advance_reserve_head(unique_lock_type& lock, BFsize size,
 	// TODO: This enables guaranteed reads to "cover for" unguaranteed
 	//         siblings that would be too slow on their own. Is this actually
 	//         a problem, and if so is there any way around it?
-	_reserve_head += size;
-	auto postcondition_predicate = [this]() {
-		return ((_guarantees.empty() ||
-		         BFoffset(_reserve_head - _get_earliest_guarantee()) <= _span) &&
+	// Note: In lock-free mode guarantees are only ever created while holding
+	//         the lock, so the new reserve head need not be published until
+	//         the reservation has been granted (see _add_guarantee).
+	BFoffset new_reserve_head = _reserve_head + size;
+	if( !_lockfree ) {
+		_reserve_head = new_reserve_head;
+	}
+	auto postcondition_predicate = [&]() {
+		return (this->_guarantees_allow(new_reserve_head) &&
+		        this->_overflow_guarantees_allow(new_reserve_head) &&
 		        _nrealloc_pending == 0);
 	};
 	if( !nonblocking ) {
-		_write_condition.wait(lock, postcondition_predicate);
+		this->_wait(_write_condition, _nwrite_waiting, _write_wait_stats, lock,
+		            postcondition_predicate);
 	} else if( !postcondition_predicate() ) {
 		// Revert and return failure
-		_reserve_head -= size;
+		_reserve_head = new_reserve_head - size;
 		return false;
 	}
+	_reserve_head = new_reserve_head;
 	
 	BFoffset cur_span = _reserve_head - _tail;
 	if( cur_span > _span ) {
 		// Pull the tail
-		_tail += cur_span - _span;
-		// Delete old sequences
-		while( !_sequence_queue.empty() &&
-		       //_sequence_queue.front()->_end != BFsequence_impl::BF_SEQUENCE_OPEN &&
-		       _sequence_queue.front()->is_finished() &&
-		       //_sequence_queue.front()->_end <= _tail ) {
-		       BFoffset(_head - _sequence_queue.front()->_end) >= BFoffset(_head - _tail) ) {
-			if( !_sequence_queue.front()->_name.empty() ) {
-				_sequence_map.erase(_sequence_queue.front()->_name);
-			}
-			if( _sequence_queue.front()->_time_tag != BFoffset(-1) ) {
-				_sequence_time_tag_map.erase(_sequence_queue.front()->_time_tag);
-			}
-			//delete _sequence_queue.front();
-			_sequence_queue.pop();
-		}
+		this->_pull_tail(_reserve_head);
+		this->_expire_sequences();
 	}
 	return true;
 }
 
+bool BFring_impl::_reserve_span_nolock(BFsize size, BFoffset* begin, void** data) {
+	// Note: Opening the span first prevents a resize from starting under us
+	++_nwrite_open;
+	if( _nrealloc_pending || size > _ghost_span ) {
+		this->_close_nolock(_nwrite_open);
+		return false;
+	}
+	BFoffset reserve_begin = _reserve_head;
+	BFoffset reserve_end   = reserve_begin + size;
+	// Note: The new reserve head is published _before_ checking the
+	//         guarantees so that a concurrently-created guarantee cannot
+	//         miss it (see _add_guarantee).
+	_reserve_head = reserve_end;
+	if( _noverflow_guarantees || !this->_guarantees_allow(reserve_end) ) {
+		// Revert and fall back to waiting under the lock
+		_reserve_head = reserve_begin;
+		this->_close_nolock(_nwrite_open);
+		return false;
+	}
+	this->_pull_tail(reserve_end);
+	BFoffset seq_end = _earliest_sequence_end;
+	if( seq_end != BFoffset(BFsequence_impl::BF_SEQUENCE_OPEN) &&
+	    BFoffset(_head - seq_end) >= BFoffset(_head - _tail) ) {
+		lock_guard_type lock(_mutex);
+		this->_expire_sequences();
+	}
+	*begin = reserve_begin;
+	*data  = _buf_pointer(reserve_begin);
+	return true;
+}
 void BFring_impl::reserve_span(BFsize size, BFoffset* begin, void** data,
                                bool nonblocking) {
+	if( _lockfree && this->_reserve_span_nolock(size, begin, data) ) {
+		return;
+	}
 	unique_lock_type lock(_mutex);
+	BF_ASSERT_EXCEPTION(!_shm || _shm_owner,  BF_STATUS_UNSUPPORTED);
 	BF_ASSERT_EXCEPTION(size <= _ghost_span, BF_STATUS_INVALID_ARGUMENT);
 	*begin = _reserve_head;
 	BF_ASSERT_EXCEPTION(this->_advance_reserve_head(lock, size, nonblocking),
@@ -567,7 +1240,36 @@ void BFring_impl::reserve_span(BFsize size, BFoffset* begin, void** data,
 	++_nwrite_open;
 	*data = _buf_pointer(*begin);
 }
+bool BFring_impl::_commit_span_nolock(BFoffset begin, BFsize reserve_size, BFsize commit_size) {
+	// Note: Out-of-order commits and those that touch the ghost region
+	//         take the slow path.
+	if( begin != _head ||
+	    this->_ghost_write_needed(begin, commit_size) ) {
+		return false;
+	}
+	if( commit_size == 0 &&
+	    _reserve_head == begin + reserve_size ) {
+		// Cancel the span by pulling back the reserve head
+		_reserve_head = begin;
+	} else {
+		if( _reserve_head == begin + reserve_size ) {
+			_reserve_head = begin + commit_size;
+		} else if( commit_size < reserve_size ) {
+			// Let the slow path report the error
+			return false;
+		}
+		_head += commit_size;
+		this->_note_commit(commit_size, false);
+		this->_notify_if_waiting(_read_condition,        _nread_waiting);
+		this->_notify_if_waiting(_write_close_condition, _nwrite_close_waiting);
+	}
+	this->_close_nolock(_nwrite_open);
+	return true;
+}
 void BFring_impl::commit_span(BFoffset begin, BFsize reserve_size, BFsize commit_size) {
+	if( _lockfree && this->_commit_span_nolock(begin, reserve_size, commit_size) ) {
+		return;
+	}
 	unique_lock_type lock(_mutex);
 	_ghost_write(begin, commit_size);
 
@@ -591,7 +1293,7 @@ void BFring_impl::commit_span(BFoffset begin, BFsize reserve_size, BFsize commit
 	//         in order (i.e., they will automatically synchronise).
 	//         This is useful for multithreading with OpenMP
 	//std::cout << "(1) begin, head, rhead: " << begin << ", " << _head << ", " << _reserve_head << std::endl;
-	_write_close_condition.wait(lock, [&]() {
+	this->_wait(_write_close_condition, _nwrite_close_waiting, _commit_wait_stats, lock, [&]() {
 			return (begin == _head);
 		});
 	_write_close_condition.notify_all();
@@ -610,6 +1312,7 @@ void BFring_impl::commit_span(BFoffset begin, BFsize reserve_size, BFsize commit
 		BF_ASSERT_EXCEPTION(false, BF_STATUS_INVALID_STATE);
 	}
 	_head += commit_size;
+	this->_note_commit(commit_size, true);
 	
 	_read_condition.notify_all();
 	--_nwrite_open;
@@ -633,6 +1336,53 @@ BFwspan_impl::~BFwspan_impl() {
 	this->ring()->commit_span(_begin, this->size(), _commit_size);
 }
 
+bool BFring_impl::_acquire_span_nolock(BFrsequence rsequence,
+                                       BFoffset    offset, // Relative to sequence beg
+                                       BFsize*     size_,
+                                       BFoffset*   begin_,
+                                       void**      data_,
+                                       bool        batched) {
+	// Note: Opening the span first prevents a resize from starting under us
+	++_nread_open;
+	if( _nrealloc_pending || *size_ > _ghost_span ) {
+		this->_close_nolock(_nread_open);
+		return false;
+	}
+	BFsequence_sptr sequence = rsequence->sequence();
+	BFoffset requested_begin = sequence->begin() + offset;
+	BFoffset requested_end   = requested_begin + *size_;
+	std::unique_ptr<Guarantee>& guarantee = rsequence->guarantee();
+	if( guarantee && !batched &&
+	    BFdelta(requested_begin - guarantee->offset()) > 0 ) {
+		guarantee->move_lockfree(requested_begin);
+	}
+	BFoffset head = _head;
+	bool finished = sequence->is_finished();
+	BFoffset begin = std::max(requested_begin, _tail.load());
+	if( guarantee && BFdelta(guarantee->offset() - begin) > 0 ) {
+		// Data before the guarantee may still be overwritten
+		begin = guarantee->offset();
+	}
+	if( !(BFdelta(head - begin) >= BFdelta(requested_end - begin) ||
+	      finished) ||
+	    (finished && !(begin < sequence->end())) ) {
+		// Must wait for data (or report end of data) under the lock
+		this->_close_nolock(_nread_open);
+		return false;
+	}
+	BFsize size = std::max(BFdelta(requested_end - begin), BFdelta(0));
+	if( finished ) {
+		size = std::min(size, BFsize(sequence->end() - begin));
+	}
+	if( this->_ghost_read_needed(begin, size) ) {
+		this->_close_nolock(_nread_open);
+		return false;
+	}
+	*begin_ = begin;
+	*size_  = size;
+	*data_  = _buf_pointer(begin);
+	return true;
+}
 void BFring_impl::acquire_span(BFrsequence rsequence,
                                BFoffset    offset, // Relative to sequence beg
                                BFsize*     size_,
@@ -644,8 +1394,81 @@ void BFring_impl::acquire_span(BFrsequence rsequence,
 	BF_ASSERT_EXCEPTION(data_,                 BF_STATUS_INVALID_POINTER);
 	// Cannot go back beyond the start of the sequence
 	BF_ASSERT_EXCEPTION(offset >= 0,           BF_STATUS_INVALID_ARGUMENT);
-	BFsequence_sptr sequence = rsequence->sequence();
+	if( _lockfree &&
+	    this->_acquire_span_nolock(rsequence, offset, size_, begin_, data_) ) {
+		return;
+	}
 	unique_lock_type lock(_mutex);
+	this->_acquire_span_locked(lock, rsequence, offset, size_, begin_, data_);
+}
+BFsize BFring_impl::acquire_spans(BFrsequence rsequence,
+                                  BFoffset    offset, // Relative to sequence beg
+                                  BFsize      nspan,
+                                  BFsize      span_size,
+                                  BFsize*     sizes,
+                                  BFoffset*   begins,
+                                  void**      datas) {
+	BF_ASSERT_EXCEPTION(rsequence,             BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT_EXCEPTION(sizes,                 BF_STATUS_INVALID_POINTER);
+	BF_ASSERT_EXCEPTION(begins,                BF_STATUS_INVALID_POINTER);
+	BF_ASSERT_EXCEPTION(datas,                 BF_STATUS_INVALID_POINTER);
+	BF_ASSERT_EXCEPTION(offset >= 0,           BF_STATUS_INVALID_ARGUMENT);
+	BF_ASSERT_EXCEPTION(nspan > 0,             BF_STATUS_INVALID_ARGUMENT);
+	BFsize n = 0;
+	if( _lockfree ) {
+		for( ; n<nspan; ++n ) {
+			sizes[n] = span_size;
+			if( !this->_acquire_span_nolock(rsequence, offset + n*span_size,
+			                                &sizes[n], &begins[n], &datas[n],
+			                                /*batched=*/n > 0) ) {
+				break;
+			}
+			if( sizes[n] < span_size ) {
+				// Partially overwritten or end of sequence
+				return n+1;
+			}
+		}
+		if( n == nspan ) {
+			return n;
+		}
+	}
+	unique_lock_type lock(_mutex);
+	if( n == 0 ) {
+		// Wait for (at least) the first span exactly as acquire_span does
+		sizes[0] = span_size;
+		this->_acquire_span_locked(lock, rsequence, offset,
+		                           &sizes[0], &begins[0], &datas[0]);
+		++n;
+		if( sizes[0] < span_size ) {
+			return n;
+		}
+	}
+	// Then take whatever subsequent spans are already available
+	for( ; n<nspan; ++n ) {
+		sizes[n] = span_size;
+		if( !this->_acquire_span_locked(lock, rsequence, offset + n*span_size,
+		                                &sizes[n], &begins[n], &datas[n],
+		                                /*batched=*/true) ) {
+			break;
+		}
+		if( sizes[n] < span_size ) {
+			return n+1;
+		}
+	}
+	return n;
+}
+// Note: When batched is true, this does not wait, does not move the
+//         guarantee (which must keep protecting the spans acquired earlier
+//         in the batch), and returns false instead of throwing if the span is
+//         not (yet) available.
+bool BFring_impl::_acquire_span_locked(unique_lock_type& lock,
+                                       BFrsequence rsequence,
+                                       BFoffset    offset, // Relative to sequence beg
+                                       BFsize*     size_,
+                                       BFoffset*   begin_,
+                                       void**      data_,
+                                       bool        batched) {
+	BFsequence_sptr sequence = rsequence->sequence();
 	BF_ASSERT_EXCEPTION(*size_ <= _ghost_span, BF_STATUS_INVALID_ARGUMENT);
 	
 	BFoffset requested_begin = sequence->begin() + offset;
@@ -655,7 +1478,7 @@ void BFring_impl::acquire_span(BFrsequence rsequence,
 	//         This would be straightforward to implement using a scoped
 	//           guarantee.
 	
-	if( rsequence->guarantee() ) {
+	if( rsequence->guarantee() && !batched ) {
 		BFoffset guarantee_begin = rsequence->guarantee()->offset();
 		BFdelta distance_from_guarantee = BFdelta(requested_begin -
 		                                          guarantee_begin);
@@ -680,20 +1503,36 @@ void BFring_impl::acquire_span(BFrsequence rsequence,
 	//   after the end of the sequence.
 	
 	// Wait until requested span has been written or sequence has ended
-	_read_condition.wait(lock, [&]() {
-			return ((BFdelta(_head         - std::max(requested_begin, _tail)) >=
-			         BFdelta(requested_end - std::max(requested_begin, _tail)) ||
-			         sequence->is_finished()) &&
-			        _nrealloc_pending == 0);
-		});
+	auto span_ready = [&]() {
+		return ((BFdelta(_head         - std::max(requested_begin, _tail.load())) >=
+		         BFdelta(requested_end - std::max(requested_begin, _tail.load())) ||
+		         sequence->is_finished()) &&
+		        _nrealloc_pending == 0);
+	};
+	if( batched ) {
+		if( !span_ready() ) {
+			return false;
+		}
+	} else {
+		this->_wait(_read_condition, _nread_waiting, _read_wait_stats, lock, span_ready);
+	}
 	
 	// Constrain to what is in the buffer (i.e., what hasn't been overwritten)
-	BFoffset begin = std::max(requested_begin, _tail);
+	BFoffset begin = std::max(requested_begin, _tail.load());
+	if( _lockfree && rsequence->guarantee() &&
+	    BFdelta(rsequence->guarantee()->offset() - begin) > 0 ) {
+		// Data before the guarantee may still be overwritten
+		//   (see _add_guarantee).
+		begin = rsequence->guarantee()->offset();
+	}
 	// Note: This results in size being 0 if the requested span has been
 	//         completely overwritten.
 	BFsize   size  = std::max(BFdelta(requested_end - begin), BFdelta(0));
 	
 	if( sequence->is_finished() ) {
+		if( batched && !(begin < sequence->end()) ) {
+			return false;
+		}
 		BF_ASSERT_EXCEPTION(begin < sequence->end(),
 		                    BF_STATUS_END_OF_DATA);
 		size = std::min(size, BFsize(sequence->end() - begin));
@@ -702,27 +1541,294 @@ void BFring_impl::acquire_span(BFrsequence rsequence,
 	*size_  = size;
 	
 	++_nread_open;
+	if( _shm && !_shm_owner ) {
+		++_shm->readers[_shm_reader].nread_open;
+	}
 	_ghost_read(begin, size);
 	*data_ = _buf_pointer(begin);
+	return true;
+}
+BFsize BFring_impl::_nread_open_total() {
+	BFsize total = _nread_open;
+	if( !_shm ) {
+		return total;
+	}
+	for( int slot=0; slot<BF_RING_SHM_MAX_READERS; ++slot ) {
+		RingShmReader& reader = _shm->readers[slot];
+		pid_t pid = reader.pid;
+		if( !pid || !reader.nread_open ) {
+			continue;
+		}
+		if( ::kill(pid, 0) == -1 && errno == ESRCH ) {
+			// The reader's process has died, so its open spans are void
+			reader.nread_open = 0;
+			reader.pid        = 0;
+			continue;
+		}
+		total += reader.nread_open;
+	}
+	return total;
 }
 void BFring_impl::release_span(BFrsequence sequence,
                                BFoffset    begin,
                                BFsize      size) {
+	if( _lockfree ) {
+		this->_close_nolock(_nread_open);
+		return;
+	}
 	unique_lock_type lock(_mutex);
 	--_nread_open;
+	if( _shm && !_shm_owner ) {
+		--_shm->readers[_shm_reader].nread_open;
+	}
+	_realloc_condition.notify_all();
+}
+void BFring_impl::release_spans(BFsize nspan) {
+	if( _lockfree ) {
+		this->_close_nolock(_nread_open, nspan);
+		return;
+	}
+	unique_lock_type lock(_mutex);
+	_nread_open -= nspan;
+	if( _shm && !_shm_owner ) {
+		_shm->readers[_shm_reader].nread_open -= nspan;
+	}
 	_realloc_condition.notify_all();
 }
 
+// Writes to a file in large, aligned blocks (using O_DIRECT if possible)
+//   via an aligned staging buffer.
+class RingDumpFile {
+	enum { ALIGN = BF_RING_DUMP_ALIGN };
+	int     _fd;
+	int     _flags;
+	bool    _direct;
+	char*   _buf;
+	BFsize  _capacity;
+	BFsize  _size;
+	BFsize  _nbyte_written;
+	void _write_all(const char* data, BFsize size) {
+		while( size ) {
+			ssize_t n = ::write(_fd, data, size);
+			if( n < 0 && errno == EINTR ) {
+				continue;
+			}
+#ifdef O_DIRECT
+			if( n < 0 && errno == EINVAL && _direct ) {
+				// The file system does not support O_DIRECT after all
+				::fcntl(_fd, F_SETFL, _flags);
+				_direct = false;
+				continue;
+			}
+#endif
+			if( n < 0 ) {
+				throw std::runtime_error(std::string("Ring dump write failed: ")+
+				                         ::strerror(errno));
+			}
+			data += n;
+			size -= n;
+			_nbyte_written += n;
+		}
+	}
+	RingDumpFile(RingDumpFile const& )            = delete;
+	RingDumpFile& operator=(RingDumpFile const& ) = delete;
+public:
+	RingDumpFile(int fd, BFsize capacity)
+		: _fd(fd), _flags(::fcntl(fd, F_GETFL)), _direct(false),
+		  _buf(nullptr), _capacity(capacity), _size(0), _nbyte_written(0) {
+		BF_ASSERT_EXCEPTION(_flags != -1, BF_STATUS_INVALID_ARGUMENT);
+		void* buf;
+		if( ::posix_memalign(&buf, ALIGN, _capacity) != 0 ) {
+			throw std::bad_alloc();
+		}
+		_buf = (char*)buf;
+#ifdef O_DIRECT
+		off_t pos = ::lseek(_fd, 0, SEEK_CUR);
+		if( pos != -1 && pos % ALIGN == 0 ) {
+			_direct = (::fcntl(_fd, F_SETFL, _flags | O_DIRECT) == 0);
+		}
+#endif
+	}
+	~RingDumpFile() {
+		if( _direct ) {
+			::fcntl(_fd, F_SETFL, _flags);
+		}
+		::free(_buf);
+	}
+	// Copies size bytes from data (in space) to the file
+	void append(const void* data, BFsize size, BFspace space=BF_SPACE_SYSTEM) {
+		const char* src = (const char*)data;
+		while( size ) {
+			BFsize n = std::min(size, _capacity - _size);
+			if( space == BF_SPACE_SYSTEM ) {
+				::memcpy(_buf + _size, src, n);
+			} else {
+				BF_ASSERT_EXCEPTION(bfMemcpy(_buf + _size, BF_SPACE_SYSTEM,
+				                             src, space, n) == BF_STATUS_SUCCESS,
+				                    BF_STATUS_MEM_OP_FAILED);
+			}
+			_size += n;
+			src   += n;
+			size  -= n;
+			if( _size == _capacity ) {
+				this->flush();
+			}
+		}
+	}
+	// Zero-pads the file out to a multiple of ALIGN
+	void pad() {
+		BFsize npad = round_up(_nbyte_written + _size, (BFsize)ALIGN)
+		              - (_nbyte_written + _size);
+		::memset(_buf + _size, 0, npad);
+		_size += npad;
+		if( _size == _capacity ) {
+			this->flush();
+		}
+	}
+	// Note: Must only be called when padded (to keep O_DIRECT writes aligned)
+	void flush() {
+		this->_write_all(_buf, _size);
+		_size = 0;
+	}
+};
+void BFring_impl::dump(BFoffset time_tag_begin, BFoffset time_tag_end, int fd) {
+	enum { DUMP_BUFSIZE = 4*1024*1024 };
+	BFsize ghost_span;
+	BFsize dump_end;
+	{
+		lock_guard_type lock(_mutex);
+		ghost_span = _ghost_span;
+		// Note: Data written after this point is not included
+		dump_end   = _head;
+	}
+	// Opening the sequence with a guarantee pins everything from its start
+	//   (or the oldest byte not yet overwritten) onwards.
+	BFrsequence_impl rsequence = BFrsequence_impl::at(this, time_tag_begin, true);
+	std::unique_ptr<RingDumpFile> file;
+	while( true ) {
+		BFsequence_sptr sequence = rsequence.sequence();
+		BFoffset seq_begin = sequence->begin();
+		BFoffset seq_end   = sequence->end();
+		if( !sequence->is_finished() ||
+		    BFdelta(seq_end - dump_end) > 0 ) {
+			seq_end = dump_end;
+		}
+		BFoffset offset = 0;
+		BFoffset pinned = rsequence.guarantee()->offset();
+		if( BFdelta(pinned - seq_begin) > 0 ) {
+			// The start of the sequence has already been overwritten
+			offset = pinned - seq_begin;
+		}
+		BFsize size     = std::max(BFdelta(seq_end - seq_begin - offset), BFdelta(0));
+		BFsize nringlet = sequence->nringlet();
+		if( !file ) {
+			file.reset(new RingDumpFile(fd, std::max(BFsize(DUMP_BUFSIZE),
+			                                         BFsize(nringlet*BF_RING_DUMP_ALIGN))));
+		}
+		BFsize chunk_size = std::min(ghost_span, DUMP_BUFSIZE / std::max(nringlet, BFsize(1)));
+		chunk_size = std::max(chunk_size, BFsize(1));
+		BFringdumprecord record;
+		::memset(&record, 0, sizeof(record));
+		::memcpy(record.magic, BF_RING_DUMP_MAGIC, sizeof(record.magic));
+		record.data_offset = round_up(sizeof(record) + sequence->header_size(),
+		                              (BFsize)BF_RING_DUMP_ALIGN);
+		record.record_size = record.data_offset + round_up(size*nringlet,
+		                                                   (BFsize)BF_RING_DUMP_ALIGN);
+		record.time_tag    = sequence->time_tag();
+		record.offset      = offset;
+		record.size        = size;
+		record.nringlet    = nringlet;
+		record.chunk_size  = chunk_size;
+		record.header_size = sequence->header_size();
+		::strncpy(record.name, sequence->name(), sizeof(record.name)-1);
+		file->append(&record, sizeof(record));
+		file->append(sequence->header(), sequence->header_size());
+		file->pad();
+		for( BFsize done=0; done<size; ) {
+			BFsize   nbyte = std::min(chunk_size, size - done);
+			BFsize   got   = nbyte;
+			BFoffset begin;
+			void*    data;
+			// Note: This moves the guarantee up to the chunk
+			this->acquire_span(&rsequence, offset + done, &got, &begin, &data);
+			try {
+				for( BFsize r=0; r<nringlet; ++r ) {
+					file->append((char*)data + r*_stride, got, _space);
+				}
+			} catch( ... ) {
+				this->release_span(&rsequence, begin, got);
+				throw;
+			}
+			this->release_span(&rsequence, begin, got);
+			// Note: The guarantee means that none of the data can have been
+			//         overwritten.
+			BF_ASSERT_EXCEPTION(got == nbyte, BF_STATUS_INTERNAL_ERROR);
+			done += nbyte;
+		}
+		file->pad();
+		// Move on to the next sequence if it is in range
+		bool more;
+		{
+			lock_guard_type lock(_mutex);
+			BFsequence_sptr next = sequence->_next;
+			more = (next &&
+			        BFdelta(next->begin() - dump_end) < 0 &&
+			        (next->time_tag() == BFoffset(-1) ||
+			         next->time_tag() < time_tag_end));
+		}
+		if( !more ) {
+			break;
+		}
+		rsequence.increment_to_next();
+	}
+	file->flush();
+}
+
 BFrspan_impl::BFrspan_impl(BFrsequence sequence,
                            BFoffset    offset, // Relative to sequence beg
                            BFsize      requested_size)
 	: BFspan_impl(sequence->ring(), requested_size),
 	  _sequence(sequence), _begin(0),
-	  _data(nullptr) {
-	BFsize returned_size = requested_size;
-	this->ring()->acquire_span(sequence, offset, &returned_size, &_begin, &_data);
-	this->set_base_size(returned_size);
+	  _data(nullptr), _released(false) {
+	BFsize returned_size = sequence->view_to_sequence(requested_size);
+	this->ring()->acquire_span(sequence, sequence->view_to_sequence(offset),
+	                           &returned_size, &_begin, &_data);
+	this->_apply_view(returned_size);
+}
+BFrspan_impl::BFrspan_impl(BFrsequence sequence,
+                           BFsize      requested_size,
+                           BFsize      size,
+                           BFoffset    begin,
+                           void*       data)
+	: BFspan_impl(sequence->ring(), requested_size),
+	  _sequence(sequence), _begin(begin),
+	  _data(data), _released(false) {
+	this->_apply_view(size);
+}
+void BFrspan_impl::_apply_view(BFsize size) {
+	BFrsequence_impl::View const& view = _sequence->view();
+	_nringlet     = view.nringlet;
+	_frame_width  = view.frame_width;
+	_frame_stride = view.frame_stride;
+	if( _frame_stride ) {
+		// Skip to the first whole frame (the start of the span may have been
+		//   overwritten) and drop any partial frame at the end.
+		BFoffset offset = _begin - _sequence->begin();
+		BFsize   skip   = std::min(BFsize((_frame_stride - offset % _frame_stride) %
+		                                  _frame_stride),
+		                           size);
+		BFsize   nframe = (size - skip) / _frame_stride;
+		_begin += skip;
+		_data   = (uint8_t*)_data + skip + view.frame_offset;
+		size    = nframe * _frame_width;
+	}
+	if( view.ringlet_offset ) {
+		_data = (uint8_t*)_data + view.ringlet_offset*this->stride();
+	}
+	this->set_base_size(size);
 }
 BFrspan_impl::~BFrspan_impl() {
-	this->ring()->release_span(_sequence, _begin, this->size());
+	if( !_released ) {
+		this->ring()->release_span(_sequence, _begin, this->size());
+	}
 }
@@ -32,16 +32,20 @@
 #include <bifrost/ring.h>
 #include "assert.hpp"
 #include "proclog.hpp"
+#include "ring_shm.hpp"
 
 #include <stdexcept>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <string>
-#include <map>
-#include <queue>
 #include <set>
+#include <map>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <thread>
 
 #ifndef BF_NUMA_ENABLED
 #define BF_NUMA_ENABLED 0
@@ -60,6 +64,7 @@ class BFring_impl {
 	friend class BFwsequence_impl;
 	friend class RingReallocLock;
 	friend class Guarantee;
+	friend class RingMutex;
 	
 	std::string    _name;
 	BFspace        _space;
@@ -72,11 +77,18 @@ class BFring_impl {
 	BFsize         _span;
 	BFsize         _stride;
 	BFsize         _nringlet;
-	BFoffset       _offset0;
+	// Note: Atomic because it is periodically rebased by whole spans
+	//         (see _pull_tail).
+	std::atomic<BFoffset> _offset0;
+	enum { OFFSET0_MAX_LAG_NSPAN = 4 };
 	
-	BFoffset       _tail;
-	BFoffset       _head;
-	BFoffset       _reserve_head;
+	// Note: These are atomic so that the lock-free mode can move them
+	//         without holding _mutex (see reserve/commit/acquire_span).
+	typedef std::atomic<BFoffset> atomic_offset;
+	typedef std::atomic<BFsize>   atomic_size;
+	atomic_offset  _tail;
+	atomic_offset  _head;
+	atomic_offset  _reserve_head;
 	
 	BFoffset       _ghost_dirty_beg;
 	
@@ -84,10 +96,21 @@ class BFring_impl {
 	bool     _writing_ended;
 	BFoffset _eod;
 	
-	typedef std::mutex                   mutex_type;
+	// In lock-free mode a single writer and any number of readers move the
+	//   head, tail and guarantees with atomics, and _mutex is only taken for
+	//   sequence begin/end, resize, ghost-region copies and blocking waits.
+	bool           _lockfree;
+	// The buffer is mapped twice in a row in virtual memory, which removes the
+	//   need for (and the cost of) copies to/from the ghost region.
+	bool           _mirrored;
+	int            _mirror_fd; // The memfd backing a (non-shared) mirrored buffer
+	
+	// Note: These are pthread-based so that they can be placed in shared
+	//         memory (see ring_shm.hpp).
+	typedef RingMutex                    mutex_type;
 	typedef std::lock_guard<mutex_type>  lock_guard_type;
 	typedef std::unique_lock<mutex_type> unique_lock_type;
-	typedef std::condition_variable      condition_type;
+	typedef RingCondition                condition_type;
 	typedef RingReallocLock              realloc_lock_type;
 	mutable mutex_type     _mutex;
 	condition_type _read_condition;
@@ -96,54 +119,303 @@ class BFring_impl {
 	condition_type _realloc_condition;
 	mutable condition_type _sequence_condition;
 	
-	BFsize         _nread_open;
-	BFsize         _nwrite_open;
-	BFsize         _nrealloc_pending;
+	atomic_size    _nread_open;
+	atomic_size    _nwrite_open;
+	atomic_size    _nrealloc_pending;
 
+	// No. threads blocked on each condition (lets lock-free paths skip
+	//   taking the mutex to notify when nobody is waiting).
+	atomic_size    _nread_waiting;
+	atomic_size    _nwrite_waiting;
+	atomic_size    _nwrite_close_waiting;
+	
+	// How threads wait on the conditions above (see bfRingSetWaitPolicy)
+	BFringwait     _wait_policy;
+	BFsize         _wait_spin_count;
+	// Wait statistics (updated under the lock)
+	typedef std::chrono::steady_clock clock_type;
+	struct WaitStats {
+		uint64_t nspun;    // Waits satisfied while spinning
+		uint64_t nblocked; // Waits that had to park the thread
+		double   spin_secs;
+		double   block_secs;
+		// Waits still in progress, and when the first of them began
+		uint64_t               ncurrent;
+		clock_type::time_point current_begin;
+		WaitStats() : nspun(0), nblocked(0), spin_secs(0), block_secs(0),
+		              ncurrent(0) {}
+		// How long threads have been waiting (continuously) so far
+		inline double current_secs(clock_type::time_point now) const {
+			return ncurrent ? std::chrono::duration<double>(now - current_begin).count() : 0;
+		}
+	};
+	// The values published to the ring's ProcLog entry, snapshotted under
+	//   the lock and formatted and written once it has been released
+	struct ProcLogEntry {
+		clock_type::time_point time;
+		int        core;
+		BFsize     ghost_span;
+		BFsize     span;
+		BFsize     stride;
+		BFsize     nringlet;
+		bool       mirrored;
+		bool       shared;
+		BFringwait wait_policy;
+		BFsize     wait_spin_count;
+		BFsize     nbyte_committed;
+		BFsize     fill;
+		BFsize     fill_high_water;
+		WaitStats  read_wait_stats;
+		WaitStats  write_wait_stats;
+		WaitStats  commit_wait_stats;
+		// The lag and no. bytes read of each guarantee in this process
+		std::vector<std::pair<BFsize, BFsize> > guarantees;
+	};
+	WaitStats      _read_wait_stats;   // Readers waiting for data
+	WaitStats      _write_wait_stats;  // Writers waiting for space (guarantees)
+	WaitStats      _commit_wait_stats; // Writers waiting for earlier commits
+	// Occupancy statistics (updated by the writer, possibly without the lock)
+	atomic_size    _nbyte_committed;
+	atomic_size    _fill_high_water;
+	atomic_size    _ncommit;
+	clock_type::time_point _proclog_time;
+	ProcLogEntry           _proclog_entry;
+	enum { PROCLOG_INTERVAL_MS = 100,
+	       PROCLOG_NCOMMIT     = 64, // No. commits between checks of the time
+	       WAIT_SPIN_RECHECK   = 256 };
+	
 	int            _core;    	
 	ProcLog        _size_log;
 	
-	std::queue<BFsequence_sptr>           _sequence_queue;
-	std::map<std::string,BFsequence_sptr> _sequence_map;
-	std::map<BFoffset,BFsequence_sptr>    _sequence_time_tag_map;
+	// Live sequences in ring order, held in a circular buffer that only ever
+	//   grows so that beginning/expiring sequences does not allocate.
+	// Note: Lookups by name and time_tag search this directly (see
+	//         _find_sequence_by_name and _get_sequence_at).
+	std::vector<BFsequence_sptr>          _sequences;
+	BFsize                                _sequence_first;
+	BFsize                                _nsequence;
+	// No. live sequences without a time_tag, or whose time_tag is not greater
+	//   than that of the previous one (while both are zero, the time_tags are
+	//   sorted and can be binary searched).
+	BFsize                                _nsequence_untagged;
+	BFsize                                _nsequence_unsorted;
+	BFoffset                              _last_time_tag;
+	// Expired sequences that nobody else references, kept for reuse
+	std::vector<BFsequence_sptr>          _sequence_pool;
+	enum { SEQUENCE_POOL_MAX = 64 };
+	// End of the earliest sequence if it has finished, else BF_SEQUENCE_OPEN
+	//   (lets the lock-free writer know when sequences need expiring).
+	atomic_offset                         _earliest_sequence_end;
 	
-	typedef std::map<BFoffset,BFsize> guarantee_set; // offset-->count
-	guarantee_set _guarantees;
+	// Guarantees live in fixed slots (one per guaranteed reader) that can be
+	//   moved without allocating and that the writer can scan without taking
+	//   the lock. These point either to the local storage or into the shared
+	//   control block.
+	enum { MAX_GUARANTEES = BF_RING_SHM_MAX_GUARANTEES };
+	// All live guarantees in this process (for monitoring only)
+	std::vector<Guarantee*> _guarantee_objs;
+	std::atomic<uint64_t>  _local_guarantee_slot_mask;
+	atomic_offset          _local_guarantee_slots[MAX_GUARANTEES];
+	atomic_offset          _local_guarantee_min;
+	std::atomic<uint64_t>* _guarantee_slot_mask;
+	atomic_offset*         _guarantee_slots;
+	// A lower bound on the earliest guarantee. Guarantees only move forwards,
+	//   so this only needs to be lowered when one is added and is recomputed
+	//   from the slots only when the writer would otherwise have to wait.
+	atomic_offset*         _guarantee_min;
+	BFoffset _rescan_guarantee_min(BFoffset reserve_head);
+	// Guarantees beyond MAX_GUARANTEES (slot-->offset, with slots numbered
+	//   from MAX_GUARANTEES) are kept here instead. These are only checked
+	//   and moved under the lock, and while there are any the lock-free
+	//   writer always takes the lock (see _reserve_span_nolock).
+	typedef std::map<int,BFoffset> guarantee_map;
+	guarantee_map          _overflow_guarantees;
+	atomic_size            _noverflow_guarantees;
+	bool _overflow_guarantees_allow(BFoffset reserve_head) const;
+	
+	// Shared-memory state (see ring_shm.hpp)
+	RingShmHeader* _shm;
+	bool           _shm_owner;
+	uint64_t       _shm_generation;
+	BFoffset       _shm_seq_first; // Serials of the sequences in _sequences
+	BFoffset       _shm_seq_next;
+	RingShmSequence* _shm_seqs;    // The shared table of sequences
+	BFsize           _shm_seq_capacity;
+	uint64_t         _shm_seq_generation;
+	int              _shm_reader;  // This process's slot in _shm->readers
+	std::string _shm_name(uint64_t generation=0, const char* kind=nullptr) const;
+	pointer _shm_map_buf(uint64_t generation, BFsize span, BFsize nringlet);
+	RingShmSequence* _shm_map_seqs(uint64_t generation, BFsize capacity);
+	void _shm_unmap_seqs();
+	void _shm_grow_seqs();
+	inline RingShmSequence& _shm_seq_record(BFoffset serial) {
+		return _shm_seqs[serial % _shm_seq_capacity];
+	}
+	void _shm_on_lock();
+	void _shm_on_unlock();
+	void _shm_pull_sequences();
+	void _shm_publish_sequence(BFsequence_sptr sequence);
+	void _shm_finish_sequence(BFsequence_sptr sequence);
+	void _shm_add_reader();
+	void _shm_close();
+	BFsize _nread_open_total();
 	
+	void _free_buf();
+	bool _grow_mirrored(BFsize new_span);
 	//BFoffset _wrap_offset(BFoffset offset) const;
 	BFoffset _buf_offset( BFoffset offset) const;
 	pointer  _buf_pointer(BFoffset offset) const;
+	bool _ghost_write_needed(BFoffset offset, BFsize size) const;
+	bool _ghost_read_needed( BFoffset offset, BFsize size) const;
 	void _ghost_write(BFoffset offset, BFsize size);
 	void _ghost_read( BFoffset offset, BFsize size);
 	void _copy_to_ghost(  BFoffset buf_offset, BFsize span);
 	void _copy_from_ghost(BFoffset buf_offset, BFsize span);
 	bool _advance_reserve_head(unique_lock_type& lock, BFsize size, bool nonblocking);
-	inline void _add_guarantee(BFoffset offset) {
-		auto iter = _guarantees.find(offset);
-		if( iter == _guarantees.end() ) {
-			_guarantees.insert(std::make_pair(offset, 1));
+	void _pull_tail(BFoffset reserve_head);
+	inline BFsequence_sptr& _sequence_at_index(BFsize i) {
+		return _sequences[(_sequence_first + i) & (_sequences.size() - 1)];
+	}
+	inline BFsequence_sptr& _front_sequence() { return _sequence_at_index(0); }
+	inline BFsequence_sptr& _back_sequence()  { return _sequence_at_index(_nsequence-1); }
+	BFsequence_sptr _new_sequence(const char* name,
+	                              BFoffset    time_tag,
+	                              BFsize      header_size,
+	                              const void* header,
+	                              BFsize      nringlet,
+	                              BFoffset    begin);
+	void _push_sequence(BFsequence_sptr sequence);
+	void _pop_sequence();
+	BFsequence_sptr _find_sequence_by_name(const char* name);
+	BFsequence_sptr _find_sequence_by_time_tag(BFoffset time_tag);
+	void _expire_sequences();
+	void _update_earliest_sequence_end();
+	bool _reserve_span_nolock(BFsize size, BFoffset* begin, void** data);
+	bool _commit_span_nolock(BFoffset begin, BFsize reserve_size, BFsize commit_size);
+	bool _acquire_span_nolock(BFrsequence rsequence,
+	                          BFoffset    offset,
+	                          BFsize*     size,
+	                          BFoffset*   begin,
+	                          void**      data,
+	                          bool        batched=false);
+	bool _acquire_span_locked(unique_lock_type& lock,
+	                          BFrsequence rsequence,
+	                          BFoffset    offset,
+	                          BFsize*     size,
+	                          BFoffset*   begin,
+	                          void**      data,
+	                          bool        batched=false);
+	static inline void _cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+	template<typename Predicate>
+	inline void _wait(condition_type& condition, atomic_size& nwaiting,
+	                  WaitStats& stats, unique_lock_type& lock,
+	                  Predicate pred) {
+		if( pred() ) {
+			return;
 		}
-		else {
-			++iter->second;
+		++nwaiting;
+		clock_type::time_point t0 = clock_type::now();
+		if( stats.ncurrent++ == 0 ) {
+			stats.current_begin = t0;
 		}
-	}
-	inline void _remove_guarantee(BFoffset offset) {
-		auto iter = _guarantees.find(offset);
-		if( iter == _guarantees.end() ) {
-			throw BFexception(BF_STATUS_INTERNAL_ERROR);
+		bool satisfied = false;
+		clock_type::time_point t1 = t0;
+		if( _wait_policy != BF_RING_WAIT_BLOCK ) {
+			// Note: The lock is dropped between checks so that the thread
+			//         we are waiting on can make progress, and is only
+			//         retaken once the condition has been notified (or
+			//         after a while, as notifications from other processes
+			//         are not seen).
+			BFsize nspin = 0;
+			while( true ) {
+				bool spinning = (nspin < _wait_spin_count ||
+				                 _wait_policy == BF_RING_WAIT_SPIN);
+				if( !spinning &&
+				    _wait_policy == BF_RING_WAIT_SPIN_THEN_BLOCK ) {
+					break;
+				}
+				uint64_t nnotify = condition.nnotify();
+				lock.unlock();
+				for( int j=0; j<WAIT_SPIN_RECHECK; ++j ) {
+					if( condition.nnotify() != nnotify ) {
+						break;
+					}
+					if( !spinning ) {
+						std::this_thread::yield();
+						continue;
+					}
+					_cpu_relax();
+					if( ++nspin == _wait_spin_count &&
+					    _wait_policy != BF_RING_WAIT_SPIN ) {
+						break;
+					}
+				}
+				lock.lock();
+				if( pred() ) {
+					satisfied = true;
+					break;
+				}
+				this->_update_proclog_entry();
+			}
+			t1 = clock_type::now();
+			stats.spin_secs += std::chrono::duration<double>(t1 - t0).count();
 		}
-		if( !--iter->second ) {
-			_guarantees.erase(iter);
-			_write_condition.notify_all();
+		if( satisfied ) {
+			++stats.nspun;
+		} else {
+			// Note: Wakes up every PROCLOG_INTERVAL_MS so that the ProcLog
+			//         entry stays current (including this wait) while it lasts
+			while( !pred() ) {
+				condition.wait_for(lock, PROCLOG_INTERVAL_MS);
+				if( this->_update_proclog_entry() ) {
+					// Note: Writes the entry without the lock (the
+					//         predicate is re-checked before waiting again)
+					lock.unlock();
+					lock.lock();
+				}
+			}
+			t0 = clock_type::now();
+			stats.block_secs += std::chrono::duration<double>(t0 - t1).count();
+			++stats.nblocked;
+		}
+		--nwaiting;
+		if( --stats.ncurrent == 0 && _proclog_time > stats.current_begin ) {
+			// Note: The entry was written during the wait, so it must be
+			//         rewritten to show that the wait is over
+			this->_write_proclog_entry();
+		} else {
+			this->_update_proclog_entry();
+		}
+	}
+	// Note: Only for use outside of the lock
+	inline void _notify_if_waiting(condition_type& condition, atomic_size& nwaiting) {
+		if( nwaiting ) {
+			lock_guard_type lock(_mutex);
+			condition.notify_all();
 		}
 	}
-	inline BFoffset _get_earliest_guarantee() {
-		return _guarantees.begin()->first;
+	// Note: Only for use outside of the lock
+	inline void _close_nolock(atomic_size& nopen, BFsize n=1) {
+		nopen -= n;
+		if( _nrealloc_pending ) {
+			lock_guard_type lock(_mutex);
+			_realloc_condition.notify_all();
+		}
 	}
+	int  _add_guarantee(BFoffset offset);
+	BFoffset _move_guarantee(int slot, BFoffset old_offset, BFoffset new_offset,
+	                         bool locked=true);
+	void _remove_guarantee(int slot);
+	BFoffset _guarantee_offset(int slot) const;
+	bool _guarantees_allow(BFoffset reserve_head);
 	
 	bool _sequence_still_within_ring(BFsequence_sptr sequence) const;
 	BFoffset _get_start_of_sequence_within_ring(BFsequence_sptr sequence) const;
-	BFsequence_sptr _get_earliest_or_latest_sequence(unique_lock_type& lock, bool latest) const;
+	BFsequence_sptr _get_earliest_or_latest_sequence(unique_lock_type& lock, bool latest);
 	BFsequence_sptr open_earliest_or_latest_sequence(bool with_guarantee,
 	                                                 std::unique_ptr<Guarantee>& guarantee,
 	                                                 bool latest);
@@ -168,7 +440,17 @@ class BFring_impl {
 	BFring_impl(BFring_impl&& )                 = delete;
 	BFring_impl& operator=(BFring_impl&& )      = delete;
 	
+	// Snapshots the ProcLog entry for this ring (must be called with the
+	//   lock held), which is then written when the lock is next released
+	//   (see RingMutex::unlock).
 	void _write_proclog_entry();
+	void _log_proclog_entry(ProcLogEntry const& entry);
+	// Rewrites the ProcLog entry if PROCLOG_INTERVAL_MS has elapsed since
+	//   it was last written (must be called with the lock held), and
+	//   returns whether it did.
+	bool _update_proclog_entry();
+	// Called after every commit to update the occupancy statistics
+	void _note_commit(BFsize commit_size, bool locked);
 public:
 	BFring_impl(const char* name,
 	            BFspace space);
@@ -180,6 +462,17 @@ public:
 	inline BFspace space()    const { return _space; }
 	inline void set_core(int core)  { _core = core; }
 	inline int      core()    const { return _core; }
+	void set_lockfree(bool lockfree);
+	inline bool lockfree()    const { return _lockfree; }
+	void set_mirrored(bool mirrored);
+	inline bool mirrored()    const { return _mirrored; }
+	void set_wait_policy(BFringwait policy, BFsize spin_count);
+	inline BFringwait wait_policy()     const { return _wait_policy; }
+	inline BFsize     wait_spin_count() const { return _wait_spin_count; }
+	// Places the ring in shared memory under its name, either creating it
+	//   (as the owner and only writer) or attaching to an existing one.
+	void open_shared(bool create);
+	inline bool shared()      const { return _shm; }
 	inline void   lock()   { _mutex.lock(); }
 	inline void   unlock() { _mutex.unlock(); }
 	inline void*  locked_data()            const { return _buf; }
@@ -187,22 +480,30 @@ public:
 	inline BFsize locked_total_span()      const { return _span; }
 	inline BFsize locked_nringlet()        const { return _nringlet; }
 	inline BFsize locked_stride()          const { return _stride; }
-	// TODO: Add getters for debugging/monitoring queries
-	//         such as positions of tail, head etc. in buffer.
+	// Note: Occupancy and stall statistics are published to the ring's
+	//         ProcLog entry (see _write_proclog_entry).
+	inline BFoffset current_head_offset()         const { return _head; }
+	inline BFoffset current_reserve_head_offset() const { return _reserve_head; }
 	
 	void begin_writing();
 	void end_writing();
 	inline bool writing_ended() { return _writing_ended; }
 	
 	inline BFoffset current_tail_offset() const {
-		lock_guard_type lock(_mutex);
 		return _tail;
 	}
 	inline BFsize current_stride() const {
+		if( _lockfree ) {
+			// Note: Only called while a span is open, which prevents resize
+			return _stride;
+		}
 		lock_guard_type lock(_mutex);
 		return _stride;
 	}
 	inline BFsize current_nringlet() const {
+		if( _lockfree ) {
+			return _nringlet;
+		}
 		lock_guard_type lock(_mutex);
 		return _nringlet;
 	}
@@ -225,34 +526,67 @@ public:
 	void release_span(BFrsequence sequence,
 	                  BFoffset    begin,
 	                  BFsize      size);
+	// Acquires up to nspan consecutive spans of span_size bytes under a single
+	//   lock, waiting only for the first. Returns the number acquired.
+	BFsize acquire_spans(BFrsequence sequence,
+	                     BFoffset    offset,
+	                     BFsize      nspan,
+	                     BFsize      span_size,
+	                     BFsize*     sizes,
+	                     BFoffset*   begins,
+	                     void**      datas);
+	void release_spans(BFsize nspan);
+	// Writes the sequences covering [time_tag_begin,time_tag_end) to fd
+	//   (see bfRingDump).
+	void dump(BFoffset time_tag_begin, BFoffset time_tag_end, int fd);
 };
 
 // A scoped guarantee object
 class Guarantee {
 	BFring   _ring;
 	BFoffset _offset;
+	int      _slot;
+	std::atomic<BFsize> _nbyte_read; // Total distance moved (for monitoring)
 	void create(BFoffset offset)  {
 		_offset = offset;
-		_ring->_add_guarantee(_offset);
+		_slot   = _ring->_add_guarantee(_offset);
+		// Note: The ring may have placed the guarantee further forward
+		_offset = _ring->_guarantee_offset(_slot);
+	}
+	void destroy() { _ring->_remove_guarantee(_slot); }
+	void advance(BFoffset old_offset) {
+		if( BFdelta(_offset - old_offset) > 0 ) {
+			_nbyte_read.fetch_add(_offset - old_offset, std::memory_order_relaxed);
+		}
 	}
-	void destroy() { _ring->_remove_guarantee(_offset); }
 public:
 	Guarantee(Guarantee const& ) = delete;
 	Guarantee& operator=(Guarantee const& ) = delete;
 	explicit Guarantee(BFring ring)
-		: _ring(ring) {
+		: _ring(ring), _nbyte_read(0) {
 		BFring_impl::lock_guard_type lock(_ring->_mutex);
 		this->create(_ring->_tail);
+		_ring->_guarantee_objs.push_back(this);
 	}
 	~Guarantee() {
 		BFring_impl::lock_guard_type lock(_ring->_mutex);
 		this->destroy();
+		std::vector<Guarantee*>& objs = _ring->_guarantee_objs;
+		objs.erase(std::find(objs.begin(), objs.end(), this));
 	}
 	void move_nolock(BFoffset offset) {
-		this->destroy();
-		this->create(offset);
+		BFoffset old_offset = _offset;
+		_offset = _ring->_move_guarantee(_slot, _offset, offset);
+		this->advance(old_offset);
 	}
-	BFoffset offset() const { return _offset; }
+	// Note: Only valid in lock-free mode (see BFring_impl::_move_guarantee)
+	void move_lockfree(BFoffset offset) {
+		BFoffset old_offset = _offset;
+		_offset = _ring->_move_guarantee(_slot, _offset, offset, false);
+		this->advance(old_offset);
+	}
+	BFoffset offset()     const { return _offset; }
+	BFsize   nbyte_read() const { return _nbyte_read.load(std::memory_order_relaxed); }
 };
 inline std::unique_ptr<Guarantee> new_guarantee(BFring ring) {
 	// TODO: Use std::make_unique here (requires C++14)
@@ -267,11 +601,21 @@ class BFsequence_impl {
 	BFoffset          _time_tag;
 	BFsize            _nringlet;
 	BFoffset          _begin;
-	BFoffset          _end;
+	std::atomic<BFoffset> _end;
 	typedef std::vector<char> header_type;
 	header_type       _header;
 	BFsequence_sptr   _next;
 	BFsize            _readrefcount;
+	uint64_t          _name_hash;
+	bool              _time_tag_unsorted;
+	static uint64_t _hash_name(const char* name);
+	// Reinitialises a recycled sequence (reusing its storage)
+	void _assign(const char* name,
+	             BFoffset    time_tag,
+	             BFsize      header_size,
+	             const void* header,
+	             BFsize      nringlet,
+	             BFoffset    begin);
 public:
 	BFsequence_impl(BFring      ring,
 	                const char* name,
@@ -338,7 +682,21 @@ public:
 };
 
 class BFrsequence_impl : public BFsequence_wrapper {
+public:
+	// The subset of the data that spans acquired from the sequence refer to
+	//   (see bfRingSequenceSetView).
+	struct View {
+		BFsize ringlet_offset;
+		BFsize nringlet;     // 0 => all ringlets
+		BFsize frame_offset;
+		BFsize frame_width;
+		BFsize frame_stride; // 0 => whole frames
+		View() : ringlet_offset(0), nringlet(0),
+		         frame_offset(0), frame_width(0), frame_stride(0) {}
+	};
+private:
 	std::unique_ptr<Guarantee> _guarantee;
+	View                       _view;
 public:
 	// TODO: See if can make these function bodies a bit more concise
 	static BFrsequence_impl earliest_or_latest(BFring ring, bool with_guarantee, bool latest) {
@@ -368,6 +726,26 @@ public:
 	}
 	inline std::unique_ptr<Guarantee>&       guarantee()       { return _guarantee; }
 	inline std::unique_ptr<Guarantee> const& guarantee() const { return _guarantee; }
+	inline void set_view(View const& view) {
+		BF_ASSERT_EXCEPTION(view.nringlet ?
+		                    view.ringlet_offset + view.nringlet <= this->nringlet() :
+		                    view.ringlet_offset == 0,
+		                    BF_STATUS_INVALID_ARGUMENT);
+		BF_ASSERT_EXCEPTION(!view.frame_stride ||
+		                    (view.frame_width &&
+		                     view.frame_offset + view.frame_width <= view.frame_stride),
+		                    BF_STATUS_INVALID_ARGUMENT);
+		_view = view;
+	}
+	inline View const& view() const { return _view; }
+	// Converts an offset/size within the view to one within the sequence
+	inline BFoffset view_to_sequence(BFoffset n) const {
+		if( !_view.frame_stride ) {
+			return n;
+		}
+		BF_ASSERT_EXCEPTION(n % _view.frame_width == 0, BF_STATUS_INVALID_ARGUMENT);
+		return n / _view.frame_width * _view.frame_stride;
+	}
 	/*
 	  // TODO: This is needed for bfRingSequenceOpenSame, but it's not clear
 	  //         that that API is really needed. Also need to delete
@@ -401,7 +779,9 @@ public:
 	inline BFsize     size()     const { return _size; }
 	// Note: These two are only safe to read while a span is open (preventing resize)
 	inline BFsize     stride()   const { return _ring->current_stride(); }
-	inline BFsize     nringlet() const { return _ring->current_nringlet(); }
+	virtual BFsize    nringlet() const { return _ring->current_nringlet(); }
+	// Distance between frames if not contiguous (see bfRingSequenceSetView)
+	virtual BFsize    frame_stride() const { return 0; }
 	virtual void*     data()     const = 0;
 	virtual BFoffset  offset()   const = 0;
 };
@@ -431,6 +811,12 @@ class BFrspan_impl : public BFspan_impl {
 	BFrsequence     _sequence;
 	BFoffset        _begin;
 	void*           _data;
+	bool            _released;
+	// The view of the sequence at the time of acquisition
+	BFsize          _nringlet;
+	BFsize          _frame_width;
+	BFsize          _frame_stride;
+	void _apply_view(BFsize size);
 	// No copy or move
 	BFrspan_impl(BFrspan_impl const& )            = delete;
 	BFrspan_impl& operator=(BFrspan_impl const& ) = delete;
@@ -440,17 +826,44 @@ public:
 	BFrspan_impl(BFrsequence sequence,
 	             BFoffset    offset,
 	             BFsize      size);
+	// Wraps a span already acquired via BFring_impl::acquire_spans
+	BFrspan_impl(BFrsequence sequence,
+	             BFsize      requested_size,
+	             BFsize      size,
+	             BFoffset    begin,
+	             void*       data);
 	~BFrspan_impl();
+	// Marks the span as released via BFring_impl::release_spans
+	inline void set_released() { _released = true; }
+	inline bool        released() const { return _released; }
+	inline BFrsequence sequence() const { return _sequence; }
 	inline BFsize size_overwritten() const {
 		if( _sequence->guarantee() ) {
 			return 0;
 		}
 		BFoffset tail = this->ring()->current_tail_offset();
+		if( _frame_stride ) {
+			// Whole frames are overwritten as soon as any of their bytes are
+			BFsize nbyte  = std::max(BFdelta(tail - _begin), BFdelta(0));
+			BFsize nframe = (nbyte + _frame_stride - 1) / _frame_stride;
+			return std::min(nframe * _frame_width, this->size());
+		}
 		return std::max(std::min(BFdelta(tail - _begin),
 		                         BFdelta(this->size())),
 		                BFdelta(0));
 	}
 	inline virtual void*    data()     const { return _data; }
 	// Note: This is the offset relative to the beginning of the sequence
-	inline virtual BFoffset offset()   const { return _begin - _sequence->begin(); }
+	//         (or of the view, see bfRingSequenceSetView).
+	inline virtual BFoffset offset()   const {
+		BFoffset offset = _begin - _sequence->begin();
+		if( _frame_stride ) {
+			offset = offset / _frame_stride * _frame_width;
+		}
+		return offset;
+	}
+	inline virtual BFsize   nringlet() const {
+		return _nringlet ? _nringlet : BFspan_impl::nringlet();
+	}
+	inline virtual BFsize   frame_stride() const { return _frame_stride; }
 };
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ring_shm.hpp"
+#include "ring_impl.hpp"
+#include "assert.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <cstddef>      // For offsetof
+
+void* ring_map_mirrored(int fd, BFsize span, BFsize nringlet) {
+	BFsize nbyte = 2*span*nringlet;
+	// Reserve a contiguous range of addresses, then map over it
+	void* base = ::mmap(0, nbyte, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if( base == MAP_FAILED ) {
+		return nullptr;
+	}
+	for( BFsize r=0; r<nringlet*2; ++r ) {
+		void* addr = (char*)base + r*span;
+		void* ptr  = ::mmap(addr, span, PROT_READ | PROT_WRITE,
+		                    MAP_SHARED | MAP_FIXED, fd, (r/2)*span);
+		if( ptr != addr ) {
+			::munmap(base, nbyte);
+			return nullptr;
+		}
+	}
+	return base;
+}
+
+void RingMutex::_check_lock(int ret) {
+	if( ret == EOWNERDEAD ) {
+		// A process died while holding the lock; the ring state it left
+		//   behind is the best we have, so carry on with it.
+		pthread_mutex_consistent(_mutex);
+	}
+}
+void RingMutex::_on_lock(bool unlock_on_error) {
+	try {
+		_ring->_shm_on_lock();
+	} catch( ... ) {
+		if( unlock_on_error ) {
+			pthread_mutex_unlock(_mutex);
+		}
+		throw;
+	}
+}
+void RingMutex::_on_unlock() {
+	_ring->_shm_on_unlock();
+}
+void RingMutex::_unlock_and_log() {
+	_log_pending = false;
+	BFring_impl::ProcLogEntry entry(std::move(_ring->_proclog_entry));
+	pthread_mutex_unlock(_mutex);
+	_ring->_log_proclog_entry(entry);
+}
+void RingMutex::wait(pthread_cond_t* cond, int timeout_ms) {
+	if( !_shared && timeout_ms < 0 ) {
+		pthread_cond_wait(cond, _mutex);
+		return;
+	}
+	// Note: Shared waits are always timed so that waiters periodically
+	//         re-check for peers that have died without notifying (see
+	//         _guarantees_allow).
+	if( _shared && (timeout_ms < 0 || timeout_ms > 100) ) {
+		timeout_ms = 100;
+	}
+	timespec abstime;
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec  += timeout_ms / 1000;
+	abstime.tv_nsec += (long)(timeout_ms % 1000)*1000*1000;
+	if( abstime.tv_nsec >= 1000*1000*1000 ) {
+		abstime.tv_nsec -= 1000*1000*1000;
+		abstime.tv_sec  += 1;
+	}
+	if( !_shared ) {
+		pthread_cond_timedwait(cond, _mutex, &abstime);
+		return;
+	}
+	this->_on_unlock();
+	this->_check_lock(pthread_cond_timedwait(cond, _mutex, &abstime));
+	// Note: The caller's unique_lock still owns the mutex, and unlocks it if
+	//         this throws
+	this->_on_lock(false);
+}
+
+std::string BFring_impl::_shm_name(uint64_t generation, const char* kind) const {
+	std::string name = "/bifrost_ring." + _name;
+	for( size_t i=1; i<name.size(); ++i ) {
+		if( name[i] == '/' ) {
+			name[i] = '_';
+		}
+	}
+	if( kind ) {
+		name += std::string(".") + kind + "." + std::to_string(generation);
+	}
+	return name;
+}
+BFring_impl::pointer BFring_impl::_shm_map_buf(uint64_t generation,
+                                               BFsize   span,
+                                               BFsize   nringlet) {
+	std::string name = this->_shm_name(generation, "data");
+	int flags = _shm_owner ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+	int fd = ::shm_open(name.c_str(), flags, 0600);
+	if( fd == -1 ) {
+		return nullptr;
+	}
+	void* ptr = nullptr;
+	if( !_shm_owner || ::ftruncate(fd, span*nringlet) == 0 ) {
+		ptr = ring_map_mirrored(fd, span, nringlet);
+	}
+	// Note: The mappings keep the memory alive
+	::close(fd);
+	if( !ptr && _shm_owner ) {
+		::shm_unlink(name.c_str());
+	}
+	return (pointer)ptr;
+}
+RingShmSequence* BFring_impl::_shm_map_seqs(uint64_t generation,
+                                            BFsize   capacity) {
+	std::string name = this->_shm_name(generation, "seqs");
+	BFsize nbyte = capacity*sizeof(RingShmSequence);
+	int flags = _shm_owner ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+	int fd = ::shm_open(name.c_str(), flags, 0600);
+	if( fd == -1 ) {
+		return nullptr;
+	}
+	// Note: The table is sparse; only the pages of records in use (and of
+	//         their headers) are ever touched
+	void* ptr = MAP_FAILED;
+	if( !_shm_owner || ::ftruncate(fd, nbyte) == 0 ) {
+		ptr = ::mmap(0, nbyte, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if( ptr == MAP_FAILED ) {
+		if( _shm_owner ) {
+			::shm_unlink(name.c_str());
+		}
+		return nullptr;
+	}
+	return (RingShmSequence*)ptr;
+}
+void BFring_impl::_shm_unmap_seqs() {
+	if( !_shm_seqs ) {
+		return;
+	}
+	::munmap(_shm_seqs, _shm_seq_capacity*sizeof(RingShmSequence));
+	if( _shm_owner ) {
+		::shm_unlink(this->_shm_name(_shm_seq_generation, "seqs").c_str());
+	}
+	_shm_seqs = nullptr;
+}
+// Moves the sequences to a table of twice the size
+void BFring_impl::_shm_grow_seqs() {
+	BFsize           new_capacity = 2*_shm_seq_capacity;
+	RingShmSequence* new_seqs     = this->_shm_map_seqs(_shm_seq_generation + 1,
+	                                                    new_capacity);
+	BF_ASSERT_EXCEPTION(new_seqs, BF_STATUS_MEM_ALLOC_FAILED);
+	for( BFoffset serial=_shm->seq_first; serial!=_shm->seq_next; ++serial ) {
+		RingShmSequence const& src = this->_shm_seq_record(serial);
+		RingShmSequence&       dst = new_seqs[serial % new_capacity];
+		// Note: Only the used part of the header is copied, to keep the new
+		//         table sparse
+		::memcpy(&dst, &src, offsetof(RingShmSequence, header));
+		::memcpy(dst.header, src.header, src.header_size);
+	}
+	this->_shm_unmap_seqs();
+	_shm_seqs           = new_seqs;
+	_shm_seq_capacity   = new_capacity;
+	_shm_seq_generation = _shm_seq_generation + 1;
+	_shm->seq_capacity   = _shm_seq_capacity;
+	_shm->seq_generation = _shm_seq_generation;
+}
+void BFring_impl::open_shared(bool create) {
+	BF_ASSERT_EXCEPTION(BF_RING_MIRROR_SUPPORTED, BF_STATUS_UNSUPPORTED);
+	BF_ASSERT_EXCEPTION(_space == BF_SPACE_SYSTEM, BF_STATUS_UNSUPPORTED_SPACE);
+	BF_ASSERT_EXCEPTION(!_buf && !_shm,            BF_STATUS_INVALID_STATE);
+	std::string name = this->_shm_name();
+	int fd;
+	if( create ) {
+		fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if( fd == -1 && errno == EEXIST ) {
+			// Clean up after a previous owner that has since died
+			int old_fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+			pid_t old_pid = 0;
+			if( old_fd != -1 ) {
+				void* old = ::mmap(0, sizeof(RingShmHeader), PROT_READ,
+				                   MAP_SHARED, old_fd, 0);
+				if( old != MAP_FAILED ) {
+					old_pid = ((RingShmHeader*)old)->owner_pid;
+					::munmap(old, sizeof(RingShmHeader));
+				}
+				::close(old_fd);
+			}
+			BF_ASSERT_EXCEPTION(old_pid && ::kill(old_pid, 0) == -1 &&
+			                    errno == ESRCH,
+			                    BF_STATUS_INVALID_ARGUMENT);
+			::shm_unlink(name.c_str());
+			fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		}
+		BF_ASSERT_EXCEPTION(fd != -1, BF_STATUS_MEM_ALLOC_FAILED);
+		if( ::ftruncate(fd, sizeof(RingShmHeader)) != 0 ) {
+			::close(fd);
+			::shm_unlink(name.c_str());
+			throw BFexception(BF_STATUS_MEM_ALLOC_FAILED);
+		}
+	} else {
+		fd = ::shm_open(name.c_str(), O_RDWR, 0);
+		BF_ASSERT_EXCEPTION(fd != -1, BF_STATUS_INVALID_ARGUMENT);
+	}
+	void* ptr = ::mmap(0, sizeof(RingShmHeader), PROT_READ | PROT_WRITE,
+	                   MAP_SHARED, fd, 0);
+	::close(fd);
+	if( ptr == MAP_FAILED && create ) {
+		::shm_unlink(name.c_str());
+	}
+	BF_ASSERT_EXCEPTION(ptr != MAP_FAILED, BF_STATUS_MEM_ALLOC_FAILED);
+	RingShmHeader* shm = (RingShmHeader*)ptr;
+	if( create ) {
+		// Note: The new memory is already zeroed
+		pthread_mutexattr_t mutex_attr;
+		pthread_mutexattr_init(&mutex_attr);
+		pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+		pthread_mutex_init(&shm->mutex, &mutex_attr);
+		pthread_mutexattr_destroy(&mutex_attr);
+		pthread_condattr_t cond_attr;
+		pthread_condattr_init(&cond_attr);
+		pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+		pthread_cond_init(&shm->read_condition,        &cond_attr);
+		pthread_cond_init(&shm->write_condition,       &cond_attr);
+		pthread_cond_init(&shm->write_close_condition, &cond_attr);
+		pthread_cond_init(&shm->realloc_condition,     &cond_attr);
+		pthread_cond_init(&shm->sequence_condition,    &cond_attr);
+		pthread_condattr_destroy(&cond_attr);
+		shm->owner_pid = ::getpid();
+		shm->space     = _space;
+		shm->magic     = RingShmHeader::MAGIC;
+	} else if( shm->magic != RingShmHeader::MAGIC ) {
+		::munmap(shm, sizeof(RingShmHeader));
+		throw BFexception(BF_STATUS_INVALID_ARGUMENT);
+	}
+	_shm       = shm;
+	_shm_owner = create;
+	_mirrored  = true;
+	if( create ) {
+		_shm_seqs = this->_shm_map_seqs(1, BF_RING_SHM_INIT_SEQUENCES);
+		if( !_shm_seqs ) {
+			::munmap(shm, sizeof(RingShmHeader));
+			::shm_unlink(name.c_str());
+			_shm = nullptr;
+			throw BFexception(BF_STATUS_MEM_ALLOC_FAILED);
+		}
+		_shm_seq_capacity   = BF_RING_SHM_INIT_SEQUENCES;
+		_shm_seq_generation = 1;
+		shm->seq_capacity   = _shm_seq_capacity;
+		shm->seq_generation = _shm_seq_generation;
+	}
+	_guarantee_slot_mask = &shm->guarantee_slot_mask;
+	_guarantee_slots     =  shm->guarantee_slots;
+	_guarantee_min       = &shm->guarantee_min;
+	_read_condition.share(       &shm->read_condition);
+	_write_condition.share(      &shm->write_condition);
+	_write_close_condition.share(&shm->write_close_condition);
+	_realloc_condition.share(    &shm->realloc_condition);
+	_sequence_condition.share(   &shm->sequence_condition);
+	_mutex.share(&shm->mutex);
+	if( !create ) {
+		// Pull in the current state of the ring
+		lock_guard_type lock(_mutex);
+		this->_shm_add_reader();
+	}
+	
+	// Update the ProcLog entry for this ring
+	lock_guard_type lock(_mutex);
+	_write_proclog_entry();
+}
+// Claims a slot in which to count this process's open spans
+// Note: Must be called with the lock held
+void BFring_impl::_shm_add_reader() {
+	for( int slot=0; slot<BF_RING_SHM_MAX_READERS; ++slot ) {
+		RingShmReader& reader = _shm->readers[slot];
+		pid_t pid = reader.pid;
+		if( pid && !(::kill(pid, 0) == -1 && errno == ESRCH) ) {
+			continue;
+		}
+		reader.nread_open = 0;
+		reader.pid        = ::getpid();
+		_shm_reader = slot;
+		return;
+	}
+	throw BFexception(BF_STATUS_INSUFFICIENT_STORAGE);
+}
+void BFring_impl::_shm_close() {
+	if( _shm_reader != -1 ) {
+		RingShmReader& reader = _shm->readers[_shm_reader];
+		reader.nread_open = 0;
+		reader.pid        = 0;
+		_shm_reader = -1;
+	}
+	this->_shm_unmap_seqs();
+	::munmap(_shm, sizeof(RingShmHeader));
+	if( _shm_owner ) {
+		::shm_unlink(this->_shm_name().c_str());
+	}
+	_shm = nullptr;
+}
+void BFring_impl::_shm_on_lock() {
+	if( _shm_owner ) {
+		// Note: Everything that the other processes change lives directly
+		//         in the shared memory.
+		return;
+	}
+	if( _shm->buf_generation != _shm_generation ) {
+		// The owner has reallocated the buffer
+		if( _buf ) {
+			this->_free_buf();
+			_buf = nullptr;
+		}
+		_shm_generation = _shm->buf_generation;
+		if( _shm_generation ) {
+			_buf = this->_shm_map_buf(_shm_generation,
+			                          _shm->span, _shm->nringlet);
+			BF_ASSERT_EXCEPTION(_buf, BF_STATUS_MEM_ALLOC_FAILED);
+		}
+	}
+	if( _shm->seq_generation != _shm_seq_generation ) {
+		// The owner has grown the table of sequences
+		this->_shm_unmap_seqs();
+		_shm_seqs = this->_shm_map_seqs(_shm->seq_generation,
+		                                _shm->seq_capacity);
+		BF_ASSERT_EXCEPTION(_shm_seqs, BF_STATUS_MEM_ALLOC_FAILED);
+		_shm_seq_capacity   = _shm->seq_capacity;
+		_shm_seq_generation = _shm->seq_generation;
+	}
+	_ghost_span    = _shm->ghost_span;
+	_span          = _shm->span;
+	_stride        = _shm->stride;
+	_nringlet      = _shm->nringlet;
+	_offset0       = _shm->offset0;
+	_tail          = _shm->tail;
+	_head          = _shm->head;
+	_reserve_head  = _shm->reserve_head;
+	_eod           = _shm->eod;
+	_writing_begun = _shm->writing_begun;
+	_writing_ended = _shm->writing_ended;
+	this->_shm_pull_sequences();
+}
+void BFring_impl::_shm_on_unlock() {
+	if( !_shm_owner ) {
+		return;
+	}
+	_shm->ghost_span     = _ghost_span;
+	_shm->span           = _span;
+	_shm->stride         = _stride;
+	_shm->nringlet       = _nringlet;
+	_shm->offset0        = _offset0;
+	_shm->tail           = _tail;
+	_shm->head           = _head;
+	_shm->reserve_head   = _reserve_head;
+	_shm->eod            = _eod;
+	_shm->writing_begun  = _writing_begun;
+	_shm->writing_ended  = _writing_ended;
+	_shm->buf_generation = _shm_generation;
+}
+void BFring_impl::_shm_publish_sequence(BFsequence_sptr sequence) {
+	BF_ASSERT_EXCEPTION(::strlen(sequence->name()) < BF_RING_SHM_MAX_NAME,
+	                    BF_STATUS_INVALID_ARGUMENT);
+	BF_ASSERT_EXCEPTION(sequence->header_size() <= BF_RING_SHM_MAX_HEADER,
+	                    BF_STATUS_INVALID_ARGUMENT);
+	if( _shm->seq_next - _shm->seq_first == _shm_seq_capacity ) {
+		this->_shm_grow_seqs();
+	}
+	RingShmSequence& record = this->_shm_seq_record(_shm->seq_next);
+	record.serial      = _shm->seq_next;
+	record.time_tag    = sequence->time_tag();
+	record.begin       = sequence->begin();
+	record.end         = sequence->end();
+	record.nringlet    = sequence->nringlet();
+	record.header_size = sequence->header_size();
+	// Note: The name's length was checked above
+	::memcpy(record.name, sequence->name(), ::strlen(sequence->name()) + 1);
+	if( sequence->header_size() ) {
+		::memcpy(record.header, sequence->header(), sequence->header_size());
+	}
+	++_shm->seq_next;
+}
+void BFring_impl::_shm_finish_sequence(BFsequence_sptr sequence) {
+	// Note: Only the latest sequence can be open
+	BFoffset serial = _shm->seq_next - 1;
+	this->_shm_seq_record(serial).end = sequence->end();
+}
+void BFring_impl::_shm_pull_sequences() {
+	// Drop sequences that the owner has expired
+	while( _shm_seq_first < _shm->seq_first && _nsequence ) {
+		this->_pop_sequence();
+		++_shm_seq_first;
+	}
+	if( !_nsequence ) {
+		_shm_seq_first = _shm_seq_next = std::max(_shm_seq_next, _shm->seq_first);
+	}
+	// Pick up the end of the latest sequence
+	if( _nsequence && !_back_sequence()->is_finished() ) {
+		BFoffset serial = _shm_seq_next - 1;
+		_back_sequence()->_end = this->_shm_seq_record(serial).end;
+	}
+	// Add any new sequences
+	while( _shm_seq_next < _shm->seq_next ) {
+		RingShmSequence const& record = this->_shm_seq_record(_shm_seq_next);
+		BFsequence_sptr sequence = this->_new_sequence(record.name,
+		                                               record.time_tag,
+		                                               record.header_size,
+		                                               record.header,
+		                                               record.nringlet,
+		                                               record.begin);
+		sequence->_end = record.end;
+		this->_push_sequence(sequence);
+		++_shm_seq_next;
+	}
+	this->_update_earliest_sequence_end();
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+  Support for rings that live in POSIX shared memory
+
+  The process that creates a shared ring (the owner) does all of the writing
+    and publishes its state (head, tail, geometry and sequences) to a control
+    block in /dev/shm. Other processes attach to the ring by name, and see
+    the same data buffer (mapped twice in a row, see BFring_impl::set_mirrored)
+    with zero copies. Guarantees and open reads from every process are kept
+    in the control block so that the owner never overwrites data that a
+    reader in another process is still using.
+*/
+
+#pragma once
+
+#include <bifrost/ring.h>
+
+#include <pthread.h>
+#include <cerrno>
+#include <sys/types.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__linux__) && defined(__NR_memfd_create)
+#define BF_RING_MIRROR_SUPPORTED 1
+#else
+#define BF_RING_MIRROR_SUPPORTED 0
+#endif
+
+class BFring_impl;
+
+enum {
+	BF_RING_SHM_MAX_GUARANTEES = 64,
+	BF_RING_SHM_MAX_READERS    = 64, // Processes attached at once
+	BF_RING_SHM_INIT_SEQUENCES = 64, // Note: The table grows as needed
+	BF_RING_SHM_MAX_NAME       = 256,
+	BF_RING_SHM_MAX_HEADER     = 65536
+};
+
+struct RingShmSequence {
+	BFoffset serial;
+	BFoffset time_tag;
+	BFoffset begin;
+	BFoffset end;
+	BFsize   nringlet;
+	BFsize   header_size;
+	char     name[BF_RING_SHM_MAX_NAME];
+	char     header[BF_RING_SHM_MAX_HEADER];
+};
+
+// A process attached to a shared ring
+// Note: A slot is freed when its process detaches, or is reclaimed once the
+//         process is found to have died (see BFring_impl::_nread_open_total).
+struct RingShmReader {
+	std::atomic<pid_t>  pid; // 0 if the slot is free
+	std::atomic<BFsize> nread_open;
+};
+
+// Note: This lives in shared memory, so must only contain process-shared
+//         primitives, plain data and (address-free) lock-free atomics.
+struct RingShmHeader {
+	enum { MAGIC = 0x42465253484d5231ull /* "BFRSHMR1" */ };
+	uint64_t        magic;
+	pid_t           owner_pid;
+	BFspace         space;
+	pthread_mutex_t mutex;
+	pthread_cond_t  read_condition;
+	pthread_cond_t  write_condition;
+	pthread_cond_t  write_close_condition;
+	pthread_cond_t  realloc_condition;
+	pthread_cond_t  sequence_condition;
+	// Published by the owner whenever it releases the lock
+	BFoffset tail;
+	BFoffset head;
+	BFoffset reserve_head;
+	BFoffset offset0;
+	BFoffset eod;
+	BFsize   ghost_span;
+	BFsize   span;
+	BFsize   stride;
+	BFsize   nringlet;
+	uint64_t buf_generation;
+	int      writing_begun;
+	int      writing_ended;
+	// Updated by all processes
+	RingShmReader         readers[BF_RING_SHM_MAX_READERS];
+	std::atomic<uint64_t> guarantee_slot_mask;
+	std::atomic<BFoffset> guarantee_slots[BF_RING_SHM_MAX_GUARANTEES];
+	std::atomic<BFoffset> guarantee_min;
+	pid_t                 guarantee_pids[BF_RING_SHM_MAX_GUARANTEES];
+	// Sequences [seq_first,seq_next) live in the table of seq_capacity
+	//   records at serial % seq_capacity, which is a separate segment that
+	//   the owner replaces (with a new generation) whenever it fills up
+	BFoffset        seq_first;
+	BFoffset        seq_next;
+	BFsize          seq_capacity;
+	uint64_t        seq_generation;
+};
+
+// Maps span*nringlet bytes of fd twice per ringlet (i.e., each ringlet is
+//   immediately followed by a second view of itself). Returns nullptr on
+//   failure.
+void* ring_map_mirrored(int fd, BFsize span, BFsize nringlet);
+
+// A pthread mutex that can optionally be placed in shared memory, in which
+//   case the owning ring is told about every lock/unlock so that it can
+//   synchronise its state with the shared control block.
+class RingMutex {
+	pthread_mutex_t  _local;
+	pthread_mutex_t* _mutex;
+	BFring_impl*     _ring;
+	bool             _shared;
+	// Note: If unlock_on_error, the mutex is released again if syncing
+	//         with the shared state fails (i.e., when called from lock or
+	//         try_lock, whose callers do not yet own the lock).
+	void _on_lock(bool unlock_on_error);
+	void _on_unlock();
+	void _check_lock(int ret);
+	// Set (under the lock) when the ring's ProcLog entry has been
+	//   snapshotted and is to be written once the lock is released.
+	bool             _log_pending;
+	void _unlock_and_log();
+	RingMutex(RingMutex const& )            = delete;
+	RingMutex& operator=(RingMutex const& ) = delete;
+public:
+	explicit RingMutex(BFring_impl* ring)
+		: _mutex(&_local), _ring(ring), _shared(false), _log_pending(false) {
+		pthread_mutex_init(&_local, 0);
+	}
+	~RingMutex() { pthread_mutex_destroy(&_local); }
+	void share(pthread_mutex_t* mutex) {
+		_mutex  = mutex;
+		_shared = true;
+	}
+	inline void lock() {
+		int ret = pthread_mutex_lock(_mutex);
+		if( _shared ) {
+			this->_check_lock(ret);
+			this->_on_lock(true);
+		}
+	}
+	inline bool try_lock() {
+		int ret = pthread_mutex_trylock(_mutex);
+		if( ret == EBUSY ) {
+			return false;
+		}
+		if( _shared ) {
+			this->_check_lock(ret);
+			this->_on_lock(true);
+		}
+		return true;
+	}
+	inline void unlock() {
+		if( _shared ) {
+			this->_on_unlock();
+		}
+		if( _log_pending ) {
+			this->_unlock_and_log();
+			return;
+		}
+		pthread_mutex_unlock(_mutex);
+	}
+	// Defers the writing of the ring's ProcLog entry until the next unlock
+	//   (see BFring_impl::_write_proclog_entry)
+	inline void log_on_unlock() { _log_pending = true; }
+	// Waits on cond, releasing the mutex while asleep
+	// Note: If timeout_ms >= 0, returns after at most that long even if
+	//         cond was not notified
+	void wait(pthread_cond_t* cond, int timeout_ms=-1);
+};
+
+// A pthread condition variable for use with RingMutex
+class RingCondition {
+	pthread_cond_t  _local;
+	pthread_cond_t* _cond;
+	// Note: This lets spinning waiters detect (local) notifications without
+	//         taking the mutex.
+	std::atomic<uint64_t> _nnotify;
+	RingCondition(RingCondition const& )            = delete;
+	RingCondition& operator=(RingCondition const& ) = delete;
+public:
+	RingCondition() : _cond(&_local), _nnotify(0) { pthread_cond_init(&_local, 0); }
+	~RingCondition() { pthread_cond_destroy(&_local); }
+	void share(pthread_cond_t* cond) { _cond = cond; }
+	template<typename Predicate>
+	inline void wait(std::unique_lock<RingMutex>& lock, Predicate pred) {
+		while( !pred() ) {
+			lock.mutex()->wait(_cond);
+		}
+	}
+	// Waits once, for a notification or at most timeout_ms
+	inline void wait_for(std::unique_lock<RingMutex>& lock, int timeout_ms) {
+		lock.mutex()->wait(_cond, timeout_ms);
+	}
+	inline void notify_all() { ++_nnotify; pthread_cond_broadcast(_cond); }
+	inline void notify_one() { ++_nnotify; pthread_cond_signal(_cond); }
+	inline uint64_t nnotify() const { return _nnotify.load(std::memory_order_relaxed); }
+};
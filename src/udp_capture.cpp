@@ -35,24 +35,40 @@ using bifrost::ring::RingWriter;
 using bifrost::ring::WriteSpan;
 using bifrost::ring::WriteSequence;
 #include "proclog.hpp"
+#include "packet_scatter.hpp"
 
 #include <arpa/inet.h>  // For ntohs
 #include <sys/socket.h> // For recvfrom
+#include <sys/mman.h>   // For mmap, shm_open
+#include <sys/stat.h>   // For fstat
+#include <fcntl.h>      // For O_* constants
+#include <dirent.h>     // For opendir
+#include <signal.h>     // For kill
+#include <poll.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/if_packet.h> // For TPACKET_V3
 
-#include <queue>
+#include <deque>
+#include <vector>
 #include <memory>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <cstdlib>      // For posix_memalign
 #include <cstring>      // For memcpy, memset
 #include <cstdint>
+#include <cmath>        // For ldexp
 
 #include <sys/types.h>
 #include <unistd.h>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <chrono>
 
-//#include <immintrin.h> // SSE
-
 // TODO: The VMA API is returning unaligned buffers, which prevents use of SSE
 #ifndef BF_VMA_ENABLED
 #define BF_VMA_ENABLED 0
@@ -78,11 +94,54 @@ template<typename T>
 inline T atomic_fetch_and_add(T* dst, T val) {
 	return __sync_fetch_and_add(dst, val); // GCC builtin
 }
+template<typename T>
+inline T atomic_fetch_and_or(T* dst, T val) {
+	return __sync_fetch_and_or(dst, val); // GCC builtin
+}
+template<typename T>
+inline void atomic_min(T* dst, T val) {
+	T cur = *dst;
+	while( val < cur ) {
+		T prev = __sync_val_compare_and_swap(dst, cur, val); // GCC builtin
+		if( prev == cur ) {
+			break;
+		}
+		cur = prev;
+	}
+}
+template<typename T>
+inline void atomic_max(T* dst, T val) {
+	T cur = *dst;
+	while( val > cur ) {
+		T prev = __sync_val_compare_and_swap(dst, cur, val); // GCC builtin
+		if( prev == cur ) {
+			break;
+		}
+		cur = prev;
+	}
+}
+
+// Returns the current (wall clock) time in ns since the Unix epoch, as
+//   used for packet arrival times
+inline uint64_t time_now_ns() {
+	timespec ts;
+	::clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
 
 // Wrap-safe comparisons
 inline bool greater_equal(uint64_t a, uint64_t b) { return int64_t(a-b) >= 0; }
 inline bool less_than(    uint64_t a, uint64_t b) { return int64_t(a-b) <  0; }
 
+inline uint64_t round_up(uint64_t val, uint64_t mult) {
+	return (val == 0 ?
+	        0 :
+	        ((val-1)/mult+1)*mult);
+}
+inline uint64_t round_nearest(uint64_t val, uint64_t mult) {
+	return (2*val/mult+1)/2*mult;
+}
+
 #if BF_VMA_ENABLED
 #include <mellanox/vma_extra.h>
 class VMAReceiver {
@@ -238,32 +297,745 @@ public:
 	}
 };
 
+struct RecvStats {
+	size_t ncall;   // No. recv syscalls (or polls)
+	size_t nempty;  // No. of them that found no packets
+	size_t npacket; // No. packets received by them
+	double time;    // Total time spent in them (secs, includes waiting)
+};
+
+// Returns the socket's SO_RCVTIMEO in ms, or -1 if there is none
+inline int get_recv_timeout_ms(int fd) {
+	timeval   timeout;
+	socklen_t timeout_size = sizeof(timeout);
+	if( ::getsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+	                 &timeout, &timeout_size) == 0 &&
+	    (timeout.tv_sec || timeout.tv_usec) ) {
+		return std::max(timeout.tv_sec*1000 + timeout.tv_usec/1000, (long)1);
+	}
+	return -1;
+}
+
+// Paces a busy-polling receiver while its polls come up empty: it spins for
+//   a no. polls, and then sleeps for exponentially longer between them (up
+//   to a max), so that an idle capture need not hold on to its core.
+class PollBackoff {
+	int _npoll;
+	int _max_usec;
+	int _timeout_ms;
+	int _nempty;
+	int _sleep_usec;
+	std::chrono::steady_clock::time_point _deadline;
+public:
+	PollBackoff() : _npoll(0), _max_usec(0), _timeout_ms(-1), _nempty(0),
+	                _sleep_usec(0) {}
+	inline void configure(int npoll, int max_usec, int timeout_ms) {
+		_npoll      = npoll;
+		_max_usec   = max_usec;
+		_timeout_ms = timeout_ms;
+	}
+	// Starts waiting for packets (for up to the socket's timeout)
+	inline void begin() {
+		_nempty     = 0;
+		_sleep_usec = 0;
+		if( _timeout_ms >= 0 ) {
+			_deadline = std::chrono::steady_clock::now() +
+			            std::chrono::milliseconds(_timeout_ms);
+		}
+	}
+	// Waits before the next poll, or returns false once timed out
+	inline bool wait() {
+		if( _timeout_ms >= 0 && std::chrono::steady_clock::now() >= _deadline ) {
+			return false;
+		}
+		if( ++_nempty <= _npoll || _max_usec <= 0 ) {
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		} else {
+			_sleep_usec = std::min(std::max(2*_sleep_usec, 1), _max_usec);
+			std::this_thread::sleep_for(std::chrono::microseconds(_sleep_usec));
+		}
+		return true;
+	}
+};
+
+// Finds the UDP payload of an IPv4 packet of (captured) length len
+// Returns the size of the payload, or -1 if it is not one we want
+inline int parse_ipv4_udp(const uint8_t* net, size_t len, uint8_t** pkt_ptr) {
+	const iphdr* ip = (const iphdr*)net;
+	if( len < sizeof(iphdr) ||
+	    ip->version != 4 ||
+	    ip->protocol != IPPROTO_UDP ||
+	    (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) ) {
+		return -1;
+	}
+	size_t ip_size = ip->ihl*4;
+	if( len < ip_size + sizeof(udphdr) ) {
+		return -1;
+	}
+	const udphdr* udp = (const udphdr*)(net + ip_size);
+	size_t udp_size = ntohs(udp->len);
+	if( udp_size < sizeof(udphdr) || udp_size > len - ip_size ) {
+		return -1; // Note: Includes packets truncated by the snaplen
+	}
+	*pkt_ptr = (uint8_t*)udp + sizeof(udphdr);
+	return udp_size - sizeof(udphdr);
+}
+
+// Receives from an AF_PACKET socket via a TPACKET_V3 memory-mapped RX ring,
+//   handing out the UDP payloads of IPv4 packets directly from the ring.
+// Note: A block is only returned to the kernel once all of its packets have
+//         been handed out and the last one is done with, so there are no
+//         per-packet syscalls (only a poll when waiting for a new block).
+class PacketRingReceiver {
+	enum {
+		BLOCK_SIZE       = 1 << 22,
+		NBLOCK           = 64,
+		FRAME_SIZE       = 1 << 11,
+		BLOCK_TIMEOUT_MS = 8
+	};
+	int                   _fd;
+	uint8_t*              _map;
+	size_t                _map_size;
+	int                   _timeout_ms;
+	int                   _block;
+	bool                  _have_block;
+	uint32_t              _npkt_left;
+	const tpacket3_hdr*   _next;
+	bool                  _busy;
+	PollBackoff           _backoff;
+	inline tpacket_block_desc* block_desc(int b) {
+		return (tpacket_block_desc*)(_map + (size_t)b*BLOCK_SIZE);
+	}
+	// Returns the size of the UDP payload, or -1 if it is not one we want
+	static inline int parse(const tpacket3_hdr* hdr, uint8_t** pkt_ptr) {
+		const uint8_t* frame = (const uint8_t*)hdr;
+		const sockaddr_ll* sll =
+			(const sockaddr_ll*)(frame + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+		if( sll->sll_pkttype == PACKET_OUTGOING ) {
+			return -1; // Note: Seen e.g., on loopback
+		}
+		return parse_ipv4_udp(frame + hdr->tp_net,
+		                      hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac),
+		                      pkt_ptr);
+	}
+public:
+	PacketRingReceiver(int fd)
+		: _fd(fd), _map(0), _map_size((size_t)BLOCK_SIZE*NBLOCK),
+		  _timeout_ms(-1), _block(0), _have_block(false), _npkt_left(0),
+		  _next(0), _busy(false) {
+		int version = TPACKET_V3;
+		if( ::setsockopt(_fd, SOL_PACKET, PACKET_VERSION,
+		                 &version, sizeof(version)) != 0 ) {
+			throw std::runtime_error("Failed to set TPACKET_V3");
+		}
+		tpacket_req3 req;
+		::memset(&req, 0, sizeof(req));
+		req.tp_block_size       = BLOCK_SIZE;
+		req.tp_block_nr         = NBLOCK;
+		req.tp_frame_size       = FRAME_SIZE;
+		req.tp_frame_nr         = (BLOCK_SIZE / FRAME_SIZE) * NBLOCK;
+		req.tp_retire_blk_tov   = BLOCK_TIMEOUT_MS;
+		if( ::setsockopt(_fd, SOL_PACKET, PACKET_RX_RING,
+		                 &req, sizeof(req)) != 0 ) {
+			throw std::runtime_error("Failed to create packet RX ring");
+		}
+		void* map = ::mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		                   _fd, 0);
+		if( map == MAP_FAILED ) {
+			throw std::runtime_error("Failed to map packet RX ring");
+		}
+		_map = (uint8_t*)map;
+		// Note: SO_RCVTIMEO does not apply to the ring, so we honour it here
+		_timeout_ms = get_recv_timeout_ms(_fd);
+	}
+	~PacketRingReceiver() {
+		::munmap(_map, _map_size);
+	}
+	// Note: When busy, the block status is polled directly (no syscalls)
+	inline void set_poll(const BFudpcapture_poll* config) {
+		_busy = config->busy;
+		_backoff.configure(config->backoff_npoll, config->backoff_max_usec,
+		                   _timeout_ms);
+	}
+	// Note: The returned packet remains valid until the next call
+	// Note: arrival_ns is set to the kernel's receive timestamp
+	inline int recv_packet(uint8_t** pkt_ptr, uint64_t* arrival_ns,
+	                       RecvStats* stats) {
+		while( true ) {
+			tpacket_block_desc* desc = this->block_desc(_block);
+			if( !_have_block && _busy ) {
+				std::chrono::high_resolution_clock::time_point t0, t1;
+				t0 = std::chrono::high_resolution_clock::now();
+				_backoff.begin();
+				bool timed_out = false;
+				++stats->ncall;
+				while( !(__atomic_load_n(&desc->hdr.bh1.block_status,
+				                         __ATOMIC_ACQUIRE) & TP_STATUS_USER) ) {
+					++stats->nempty;
+					if( !_backoff.wait() ) {
+						timed_out = true;
+						break;
+					}
+					++stats->ncall;
+				}
+				t1 = std::chrono::high_resolution_clock::now();
+				stats->time += std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count();
+				if( timed_out ) {
+					errno = EAGAIN;
+					return -1;
+				}
+			}
+			if( !_have_block ) {
+				while( !(__atomic_load_n(&desc->hdr.bh1.block_status,
+				                         __ATOMIC_ACQUIRE) & TP_STATUS_USER) ) {
+					pollfd pfd;
+					pfd.fd      = _fd;
+					pfd.events  = POLLIN | POLLERR;
+					pfd.revents = 0;
+					std::chrono::high_resolution_clock::time_point t0, t1;
+					t0 = std::chrono::high_resolution_clock::now();
+					int ret = ::poll(&pfd, 1, _timeout_ms);
+					t1 = std::chrono::high_resolution_clock::now();
+					stats->time += std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count();
+					++stats->ncall;
+					if( ret == 0 ) {
+						++stats->nempty;
+						errno = EAGAIN;
+						return -1;
+					} else if( ret < 0 ) {
+						return -1;
+					}
+				}
+				_have_block = true;
+				_npkt_left  = desc->hdr.bh1.num_pkts;
+				_next       = (const tpacket3_hdr*)((uint8_t*)desc +
+				                                    desc->hdr.bh1.offset_to_first_pkt);
+			}
+			if( _npkt_left == 0 ) {
+				// Return this block to the kernel and move on to the next
+				__atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+				                 __ATOMIC_RELEASE);
+				_have_block = false;
+				_block = (_block + 1) % NBLOCK;
+				continue;
+			}
+			const tpacket3_hdr* hdr = _next;
+			_next = (const tpacket3_hdr*)((uint8_t*)hdr + hdr->tp_next_offset);
+			--_npkt_left;
+			int pkt_size = parse(hdr, pkt_ptr);
+			if( pkt_size >= 0 ) {
+				*arrival_ns = hdr->tp_sec*1000000000ull + hdr->tp_nsec;
+				++stats->npacket;
+				return pkt_size;
+			}
+		}
+	}
+};
+
+// Replays packets from a capture file in place of a socket: a pcap or pcapng
+//   file (with Ethernet, Linux cooked or raw IPv4 link types), or a dump of
+//   UDP payloads (see BF_UDP_CAPTURE_DUMP_MAGIC). The file is memory-mapped,
+//   and packets are handed out directly from it, either as fast as possible
+//   or paced to their original timing, with optional (seeded, and hence
+//   reproducible) injection of drops and reordering.
+// Note: The end of the file appears as a timeout.
+class FileReplayReceiver {
+	enum {
+		LINKTYPE_ETHERNET  = 1,
+		LINKTYPE_RAW       = 101,
+		LINKTYPE_LINUX_SLL = 113,
+		LINKTYPE_IPV4      = 228,
+		LINKTYPE_DUMP      = -1  // Note: Not a pcap link type
+	};
+	enum {
+		PCAP_MAGIC_US     = 0xa1b2c3d4,
+		PCAP_MAGIC_NS     = 0xa1b23c4d,
+		PCAPNG_SHB        = 0x0a0d0d0a,
+		PCAPNG_IDB        = 1,
+		PCAPNG_SPB        = 3,
+		PCAPNG_EPB        = 6,
+		PCAPNG_BOM        = 0x1a2b3c4d,
+		PCAPNG_IF_TSRESOL = 9
+	};
+	enum Format { FORMAT_PCAP, FORMAT_PCAPNG, FORMAT_DUMP };
+	struct Interface {
+		int      linktype;
+		uint64_t tsresol; // Note: As in if_tsresol (1 << 7 is base 2)
+	};
+	struct Packet {
+		const uint8_t* ptr;
+		int            size;
+		uint64_t       time_ns;
+		uint64_t       release; // Index of the packet to release it after
+	};
+	const uint8_t*         _map;
+	size_t                 _map_size;
+	size_t                 _offset;
+	Format                 _format;
+	bool                   _swap;
+	uint64_t               _time_ns;
+	std::vector<Interface> _interfaces;
+	BFudpcapture_replay    _config;
+	uint64_t               _rng;
+	uint64_t               _npkt;
+	std::deque<Packet>     _held;
+	bool                   _started;
+	uint64_t               _file_t0;
+	std::chrono::steady_clock::time_point _wall_t0;
+	template<typename T>
+	inline T load(size_t offset) const {
+		T val;
+		::memcpy(&val, _map + offset, sizeof(T));
+		if( _swap ) {
+			switch( sizeof(T) ) {
+			case 2: val = __builtin_bswap16(val); break;
+			case 4: val = __builtin_bswap32(val); break;
+			case 8: val = __builtin_bswap64(val); break;
+			}
+		}
+		return val;
+	}
+	static inline uint64_t to_ns(uint64_t ticks, uint64_t tsresol) {
+		uint64_t exponent = tsresol & 0x7F;
+		if( tsresol & 0x80 ) {
+			exponent = std::min(exponent, (uint64_t)63);
+			uint64_t secs = ticks >> exponent;
+			uint64_t frac = ticks - (secs << exponent);
+			return secs*1000000000 + (uint64_t)(frac*1e9 / std::ldexp(1.0, exponent));
+		}
+		for( ; exponent < 9; ++exponent ) {
+			ticks *= 10;
+		}
+		for( ; exponent > 9; --exponent ) {
+			ticks /= 10;
+		}
+		return ticks;
+	}
+	// Returns a uniform random no. in [0,1) (xorshift64*)
+	inline double random() {
+		_rng ^= _rng >> 12;
+		_rng ^= _rng << 25;
+		_rng ^= _rng >> 27;
+		return (_rng * 0x2545F4914F6CDD1Dull >> 11) * (1.0 / (1ull << 53));
+	}
+	// Finds the next packet record in the file, or returns false at the end
+	bool next_record(const uint8_t** data, size_t* size, int* linktype) {
+		while( true ) {
+			size_t left = _map_size - _offset;
+			if( _format == FORMAT_DUMP ) {
+				// Note: Records are a 16-byte header (u64 time_ns, u32 size,
+				//         u32 reserved) followed by the payload
+				if( left < 16 || left - 16 < load<uint32_t>(_offset + 8) ) {
+					return false;
+				}
+				_time_ns  = load<uint64_t>(_offset);
+				*size     = load<uint32_t>(_offset + 8);
+				*data     = _map + _offset + 16;
+				*linktype = LINKTYPE_DUMP;
+				_offset  += 16 + *size;
+				return true;
+			} else if( _format == FORMAT_PCAP ) {
+				if( left < 16 || left - 16 < load<uint32_t>(_offset + 8) ) {
+					return false;
+				}
+				uint64_t subsec = load<uint32_t>(_offset + 4);
+				_time_ns  = load<uint32_t>(_offset)*1000000000ull +
+				            to_ns(subsec, _interfaces[0].tsresol);
+				*size     = load<uint32_t>(_offset + 8);
+				*data     = _map + _offset + 16;
+				*linktype = _interfaces[0].linktype;
+				_offset  += 16 + *size;
+				return true;
+			}
+			// pcapng
+			if( left < 12 ) {
+				return false;
+			}
+			uint32_t type = load<uint32_t>(_offset);
+			if( type == PCAPNG_SHB ) {
+				// Note: Each section may have a different byte order, given
+				//         by how its byte-order magic reads unswapped
+				_swap = false;
+				_swap = (load<uint32_t>(_offset + 8) != PCAPNG_BOM);
+				_interfaces.clear();
+			}
+			uint32_t block_size = load<uint32_t>(_offset + 4);
+			if( block_size < 12 || block_size > left ) {
+				return false;
+			}
+			size_t body      = _offset + 8;
+			size_t body_size = block_size - 12;
+			_offset += block_size;
+			if( type == PCAPNG_IDB && body_size >= 8 ) {
+				Interface iface = {load<uint16_t>(body), 6};
+				for( size_t opt=body+8; opt+4<=body+body_size; ) {
+					uint16_t code = load<uint16_t>(opt);
+					uint16_t len  = load<uint16_t>(opt + 2);
+					if( code == 0 ) {
+						break;
+					} else if( code == PCAPNG_IF_TSRESOL && len >= 1 ) {
+						iface.tsresol = _map[opt + 4];
+					}
+					opt += 4 + round_up(len, 4);
+				}
+				_interfaces.push_back(iface);
+			} else if( type == PCAPNG_EPB && body_size >= 20 ) {
+				uint32_t iface = load<uint32_t>(body);
+				size_t   len   = load<uint32_t>(body + 12);
+				if( iface >= _interfaces.size() || len > body_size - 20 ) {
+					continue;
+				}
+				uint64_t ticks = ((uint64_t)load<uint32_t>(body + 4) << 32 |
+				                  load<uint32_t>(body + 8));
+				_time_ns  = to_ns(ticks, _interfaces[iface].tsresol);
+				*size     = len;
+				*data     = _map + body + 20;
+				*linktype = _interfaces[iface].linktype;
+				return true;
+			} else if( type == PCAPNG_SPB && body_size >= 4 &&
+			           !_interfaces.empty() ) {
+				// Note: These have no timestamp, so keep the previous one
+				*size     = std::min(body_size - 4,
+				                     (size_t)load<uint32_t>(body));
+				*data     = _map + body + 4;
+				*linktype = _interfaces[0].linktype;
+				return true;
+			}
+		}
+	}
+	// Returns the size of the UDP payload, or -1 if it is not one we want
+	static inline int parse(const uint8_t* data, size_t size, int linktype,
+	                        uint8_t** pkt_ptr) {
+		size_t   hdr_size;
+		uint16_t ethertype;
+		switch( linktype ) {
+		case LINKTYPE_DUMP: {
+			*pkt_ptr = (uint8_t*)data;
+			return size;
+		}
+		case LINKTYPE_RAW:
+		case LINKTYPE_IPV4: {
+			return parse_ipv4_udp(data, size, pkt_ptr);
+		}
+		case LINKTYPE_ETHERNET: {
+			hdr_size = 14;
+			if( size < hdr_size ) {
+				return -1;
+			}
+			ethertype = ntohs(*(const uint16_t*)(data + 12));
+			if( ethertype == 0x8100 && size >= hdr_size + 4 ) { // 802.1Q
+				ethertype = ntohs(*(const uint16_t*)(data + 16));
+				hdr_size += 4;
+			}
+			break;
+		}
+		case LINKTYPE_LINUX_SLL: {
+			hdr_size = 16;
+			if( size < hdr_size ) {
+				return -1;
+			}
+			ethertype = ntohs(*(const uint16_t*)(data + 14));
+			break;
+		}
+		default: return -1;
+		}
+		if( ethertype != 0x0800 ) { // IPv4
+			return -1;
+		}
+		return parse_ipv4_udp(data + hdr_size, size - hdr_size, pkt_ptr);
+	}
+	// Waits until the packet's original time relative to the first packet
+	inline void pace(uint64_t time_ns) {
+		if( !_started ) {
+			_started = true;
+			_file_t0 = time_ns;
+			_wall_t0 = std::chrono::steady_clock::now();
+		}
+		if( _config.speed > 0 ) {
+			double offset = (int64_t)(time_ns - _file_t0) * 1e-9 / _config.speed;
+			std::this_thread::sleep_until(_wall_t0 +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(offset)));
+		}
+	}
+public:
+	FileReplayReceiver(int fd)
+		: _map(0), _map_size(0), _offset(0), _format(FORMAT_PCAP),
+		  _swap(false), _time_ns(0), _rng(1), _npkt(0), _started(false),
+		  _file_t0(0) {
+		::memset(&_config, 0, sizeof(_config));
+		struct stat st;
+		if( ::fstat(fd, &st) != 0 ) {
+			throw std::runtime_error("Failed to stat replay file");
+		}
+		_map_size = st.st_size;
+		if( _map_size < 24 ) {
+			throw std::runtime_error("Replay file is too small");
+		}
+		void* map = ::mmap(0, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if( map == MAP_FAILED ) {
+			throw std::runtime_error("Failed to map replay file");
+		}
+		_map = (const uint8_t*)map;
+		::madvise(map, _map_size, MADV_SEQUENTIAL);
+		uint32_t magic = this->load<uint32_t>(0);
+		if( ::memcmp(_map, BF_UDP_CAPTURE_DUMP_MAGIC, 8) == 0 ) {
+			_format = FORMAT_DUMP;
+			_offset = 8;
+		} else if( magic == PCAPNG_SHB ) {
+			_format = FORMAT_PCAPNG;
+		} else if( magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+		           __builtin_bswap32(magic) == PCAP_MAGIC_US ||
+		           __builtin_bswap32(magic) == PCAP_MAGIC_NS ) {
+			_format = FORMAT_PCAP;
+			_swap   = (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS);
+			magic   = this->load<uint32_t>(0);
+			Interface iface = {(int)(this->load<uint32_t>(20) & 0xFFFF),
+			                   magic == PCAP_MAGIC_NS ? 9u : 6u};
+			_interfaces.push_back(iface);
+			_offset = 24;
+		} else {
+			::munmap((void*)_map, _map_size);
+			throw std::runtime_error("Unknown replay file format");
+		}
+	}
+	~FileReplayReceiver() {
+		::munmap((void*)_map, _map_size);
+	}
+	inline void set_config(const BFudpcapture_replay* config) {
+		_config = *config;
+		_rng    = config->seed*0x9E3779B97F4A7C15ull + 1; // Note: Never 0
+	}
+	// Note: The returned packet remains valid until the receiver is destroyed
+	// Note: arrival_ns is set to the packet's timestamp in the file
+	inline int recv_packet(uint8_t** pkt_ptr, uint64_t* arrival_ns,
+	                       RecvStats* stats) {
+		while( true ) {
+			// Release held-back packets once enough others have gone by
+			if( !_held.empty() && _held.front().release <= _npkt ) {
+				Packet pkt = _held.front();
+				_held.pop_front();
+				*pkt_ptr    = (uint8_t*)pkt.ptr;
+				*arrival_ns = pkt.time_ns;
+				++stats->npacket;
+				return pkt.size;
+			}
+			const uint8_t* data;
+			size_t         size;
+			int            linktype;
+			if( !this->next_record(&data, &size, &linktype) ) {
+				if( !_held.empty() ) {
+					_npkt = _held.front().release;
+					continue;
+				}
+				errno = EAGAIN;
+				return -1;
+			}
+			int pkt_size = parse(data, size, linktype, pkt_ptr);
+			if( pkt_size < 0 ) {
+				continue;
+			}
+			++_npkt;
+			std::chrono::steady_clock::time_point t0, t1;
+			t0 = std::chrono::steady_clock::now();
+			this->pace(_time_ns);
+			t1 = std::chrono::steady_clock::now();
+			stats->time += std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count();
+			if( _config.drop_prob > 0 && this->random() < _config.drop_prob ) {
+				continue;
+			}
+			if( _config.reorder_prob > 0 && _config.reorder_depth > 0 &&
+			    this->random() < _config.reorder_prob ) {
+				Packet pkt = {*pkt_ptr, pkt_size, _time_ns,
+				              _npkt + _config.reorder_depth};
+				_held.push_back(pkt);
+				continue;
+			}
+			*arrival_ns = _time_ns;
+			++stats->npacket;
+			return pkt_size;
+		}
+	}
+};
+
+// Receives packets in batches of up to nslot with a single recvmmsg call,
+//   and then hands them out one at a time from their (aligned) slots.
+// Note: Packets are timestamped by the kernel on arrival (SO_TIMESTAMPNS).
+// Note: If fd is an AF_PACKET socket, the packets are instead read directly
+//         from a memory-mapped RX ring (see PacketRingReceiver), and if it
+//         is a regular file they are replayed from it (see
+//         FileReplayReceiver).
 class UDPPacketReceiver {
 	int                    _fd;
+	size_t                 _slot_size;
 	AlignedBuffer<uint8_t> _buf;
+	std::vector<mmsghdr>   _msgs;
+	std::vector<iovec>     _iovecs;
+	std::vector<uint8_t>   _cmsgs;
+	size_t                 _cmsg_size;
+	int                    _npkt;
+	int                    _ipkt;
+	uint64_t               _batch_ns;
+	uint64_t               _arrival_ns;
+	RecvStats              _stats;
+	bool                   _busy;
+	PollBackoff            _backoff;
+	std::unique_ptr<PacketRingReceiver> _ring;
+	std::unique_ptr<FileReplayReceiver> _replay;
 #if BF_VMA_ENABLED
 	VMAReceiver            _vma;
 #endif
+	inline int recv_batch(int flags) {
+		for( size_t m=0; m<_msgs.size(); ++m ) {
+			_msgs[m].msg_hdr.msg_controllen = _cmsg_size; // Note: Set by recvmmsg
+		}
+		std::chrono::high_resolution_clock::time_point t0, t1;
+		t0 = std::chrono::high_resolution_clock::now();
+		int nmsg;
+		if( _busy ) {
+			_backoff.begin();
+			while( true ) {
+				nmsg = ::recvmmsg(_fd, &_msgs[0], _msgs.size(),
+				                  flags | MSG_DONTWAIT, 0);
+				++_stats.ncall;
+				if( nmsg > 0 || (errno != EAGAIN && errno != EWOULDBLOCK) ) {
+					break;
+				}
+				++_stats.nempty;
+				if( !_backoff.wait() ) {
+					errno = EAGAIN;
+					break;
+				}
+			}
+		} else {
+			nmsg = ::recvmmsg(_fd, &_msgs[0], _msgs.size(),
+			                  flags | MSG_WAITFORONE, 0);
+			++_stats.ncall;
+			_stats.nempty += (nmsg <= 0);
+		}
+		t1 = std::chrono::high_resolution_clock::now();
+		_batch_ns = time_now_ns();
+		_stats.time += std::chrono::duration_cast<std::chrono::duration<double>>(t1-t0).count();
+		if( nmsg > 0 ) {
+			_stats.npacket += nmsg;
+		}
+		return nmsg;
+	}
+	// Returns the kernel's receive timestamp for a packet, falling back to
+	//   the time its batch was received if there is none
+	inline uint64_t arrival_time(msghdr* hdr) const {
+		for( cmsghdr* cmsg=CMSG_FIRSTHDR(hdr); cmsg; cmsg=CMSG_NXTHDR(hdr, cmsg) ) {
+			if( cmsg->cmsg_level == SOL_SOCKET &&
+			    cmsg->cmsg_type  == SCM_TIMESTAMPNS ) {
+				timespec ts;
+				::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				return ts.tv_sec*1000000000ull + ts.tv_nsec;
+			}
+		}
+		return _batch_ns;
+	}
 public:
-	UDPPacketReceiver(int fd, size_t pkt_size_max=JUMBO_FRAME_SIZE)
-		: _fd(fd), _buf(pkt_size_max)
+	enum { DEFAULT_NSLOT = 32 };
+	UDPPacketReceiver(int fd, size_t pkt_size_max=JUMBO_FRAME_SIZE,
+	                  int nslot=DEFAULT_NSLOT)
+		: _fd(fd), _slot_size(round_up(pkt_size_max, 64)),
+		  _buf(_slot_size*std::max(nslot, 1)),
+		  _msgs(std::max(nslot, 1)), _iovecs(std::max(nslot, 1)),
+		  _cmsg_size(CMSG_SPACE(sizeof(timespec))),
+		  _npkt(0), _ipkt(0), _batch_ns(0), _arrival_ns(0), _busy(false)
 #if BF_VMA_ENABLED
 		, _vma(fd)
 #endif
-	{}
+	{
+		::memset(&_msgs[0], 0, _msgs.size()*sizeof(mmsghdr));
+		_cmsgs.resize(_msgs.size()*_cmsg_size);
+		for( size_t m=0; m<_msgs.size(); ++m ) {
+			_iovecs[m].iov_base = &_buf[m*_slot_size];
+			_iovecs[m].iov_len  = pkt_size_max;
+			_msgs[m].msg_hdr.msg_iov     = &_iovecs[m];
+			_msgs[m].msg_hdr.msg_iovlen  = 1;
+			_msgs[m].msg_hdr.msg_control = &_cmsgs[m*_cmsg_size];
+		}
+		::memset(&_stats, 0, sizeof(_stats));
+		struct stat st;
+		int       domain;
+		socklen_t domain_size = sizeof(domain);
+		if( ::fstat(_fd, &st) == 0 && S_ISREG(st.st_mode) ) {
+			_replay.reset(new FileReplayReceiver(_fd));
+		} else if( ::getsockopt(_fd, SOL_SOCKET, SO_DOMAIN,
+		                        &domain, &domain_size) == 0 &&
+		           domain == AF_PACKET ) {
+			_ring.reset(new PacketRingReceiver(_fd));
+		} else {
+			// Note: Failure is not fatal; arrival times then come from
+			//         the batch receive times instead
+			int enable = 1;
+			::setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPNS,
+			             &enable, sizeof(enable));
+		}
+	}
+	// Note: The returned packet remains valid until the next call
 	inline int recv_packet(uint8_t** pkt_ptr, int flags=0) {
+		if( _ring ) {
+			return _ring->recv_packet(pkt_ptr, &_arrival_ns, &_stats);
+		} else if( _replay ) {
+			return _replay->recv_packet(pkt_ptr, &_arrival_ns, &_stats);
+		}
 #if BF_VMA_ENABLED
 		if( _vma ) {
 			*pkt_ptr = 0;
-			return _vma.recv_packet(&_buf[0], _buf.size(), pkt_ptr, flags);
+			++_stats.ncall;
+			int ret = _vma.recv_packet(&_buf[0], _slot_size, pkt_ptr, flags);
+			_stats.npacket += (ret > 0);
+			_arrival_ns = time_now_ns();
+			return ret;
 		} else {
 #endif
-			*pkt_ptr = &_buf[0];
-			return ::recvfrom(_fd, &_buf[0], _buf.size(), flags, 0, 0);
+			if( _ipkt == _npkt ) {
+				_ipkt = 0;
+				_npkt = this->recv_batch(flags);
+				if( _npkt <= 0 ) {
+					_npkt = 0;
+					return -1;
+				}
+			}
+			int m = _ipkt++;
+			*pkt_ptr = (uint8_t*)_iovecs[m].iov_base;
+			_arrival_ns = this->arrival_time(&_msgs[m].msg_hdr);
+			return _msgs[m].msg_len;
 #if BF_VMA_ENABLED
 		}
 #endif
 	}
+	inline const RecvStats* get_stats() const { return &_stats; }
+	inline void set_replay(const BFudpcapture_replay* config) {
+		BF_ASSERT_EXCEPTION(_replay, BF_STATUS_INVALID_STATE);
+		_replay->set_config(config);
+	}
+	// Note: Has no effect on replays (or VMA)
+	inline void set_poll(const BFudpcapture_poll* config) {
+		if( _replay ) {
+			return;
+		}
+		if( config->busy_poll_usec > 0 ) {
+			int usec = config->busy_poll_usec;
+			if( ::setsockopt(_fd, SOL_SOCKET, SO_BUSY_POLL,
+			                 &usec, sizeof(usec)) != 0 ) {
+				throw std::runtime_error("Failed to set SO_BUSY_POLL");
+			}
+		}
+		if( _ring ) {
+			_ring->set_poll(config);
+			return;
+		}
+		_busy = config->busy;
+		_backoff.configure(config->backoff_npoll, config->backoff_max_usec,
+		                   get_recv_timeout_ms(_fd));
+	}
+	// Returns the arrival time of the last packet (ns since the Unix epoch)
+	inline uint64_t get_last_arrival() const { return _arrival_ns; }
 };
 
 struct PacketDesc {
@@ -282,14 +1054,51 @@ struct PacketStats {
 	size_t nlate_bytes;
 	size_t nvalid;
 	size_t nvalid_bytes;
+	// Note: Padded to a cache line so that capture threads' counters do not
+	//         share one
+	char   padding[64 - 6*sizeof(size_t)];
+};
+
+// The earliest and latest packet arrival times in a buffer (ns since the
+//   Unix epoch)
+struct BufArrival {
+	uint64_t first;
+	uint64_t last;
+	BufArrival() : first(UINT64_MAX), last(0) {}
 };
 
+// Late packets are binned by how many seqs late they are on a log2 scale:
+//   bin i counts lateness in [2^i, 2^(i+1)), and the last bin is open-ended.
+enum { LATE_HIST_NBIN = 16 };
+inline int late_hist_bin(uint64_t nseq_late) {
+	return std::min(63 - __builtin_clzll(nseq_late), (int)LATE_HIST_NBIN-1);
+}
+// Returns which of the open output buffers (starting at seq0) seq falls in
+inline int obuf_index(uint64_t seq, uint64_t seq0, uint64_t nseq_per_obuf) {
+	return (seq - seq0) / nseq_per_obuf;
+}
+
 class UDPCaptureThread : public BoundThread {
 	UDPPacketReceiver _udp;
 	PacketStats       _stats;
 	std::vector<PacketStats> _src_stats;
+	size_t            _late_hist[LATE_HIST_NBIN];
+	std::vector<size_t>  _local_ngood_bytes;     // [nbuf]
+	std::vector<size_t>  _local_src_ngood_bytes; // [nbuf][nsrc]
+	std::vector<size_t*> _local_src_ngood_ptrs;
+	std::vector<BufArrival> _local_arrivals;     // [nbuf]
 	bool              _have_pkt;
 	PacketDesc        _pkt;
+	void resize_local(int nbuf) {
+		size_t nsrc = _src_stats.size();
+		_local_ngood_bytes.resize(nbuf, 0);
+		_local_src_ngood_bytes.resize(nbuf*nsrc, 0);
+		_local_src_ngood_ptrs.resize(nbuf);
+		_local_arrivals.resize(nbuf);
+		for( int b=0; b<nbuf; ++b ) {
+			_local_src_ngood_ptrs[b] = &_local_src_ngood_bytes[b*nsrc];
+		}
+	}
 public:
 	enum {
 		CAPTURE_SUCCESS     = 1 << 0,
@@ -297,9 +1106,11 @@ public:
 		CAPTURE_INTERRUPTED = 1 << 2,
 		CAPTURE_ERROR       = 1 << 3
 	};
-	UDPCaptureThread(int fd, int nsrc, int core=0, size_t pkt_size_max=9000)
-		: BoundThread(core), _udp(fd, pkt_size_max), _src_stats(nsrc),
+	UDPCaptureThread(int fd, int nsrc, int core=0, size_t pkt_size_max=9000,
+	                 int nslot=UDPPacketReceiver::DEFAULT_NSLOT)
+		: BoundThread(core), _udp(fd, pkt_size_max, nslot), _src_stats(nsrc),
 		  _have_pkt(false) {
+		this->resize_local(2);
 		this->reset_stats();
 	}
 	// Captures, decodes and unpacks packets into the provided buffers
@@ -307,6 +1118,12 @@ public:
 	//         beyond the end of the provided buffers. This packet is
 	//         saved, accessible via get_last_packet(), and will be
 	//         processed on the next call to run() if possible.
+	// Note: Packets larger than max_payload_size are invalid, as are those
+	//         within the buffers whose size differs from their source's
+	//         entry in src_payload_sizes (if given)
+	// Note: If enter is given, it is called before the first write into the
+	//         buffers, and if it returns false the packet is saved for the
+	//         next call instead (see UDPCaptureGroup::run).
 	template<class PacketDecoder, class PacketProcessor>
 	int run(uint64_t         seq_beg,
 	        uint64_t         nseq_per_obuf,
@@ -314,10 +1131,23 @@ public:
 	        uint8_t*         obufs[],
 	        size_t*          ngood_bytes[],
 	        size_t*          src_ngood_bytes[],
+	        uint64_t*        masks[],
+	        BufArrival*      arrivals[],
+	        const int*       src_payload_sizes,
+	        int              max_payload_size,
 	        PacketDecoder*   decode,
-	        PacketProcessor* process) {
+	        PacketProcessor* process,
+	        const std::function<bool()>* enter=NULL) {
 		uint64_t seq_end = seq_beg + nbuf*nseq_per_obuf;
-		size_t local_ngood_bytes[2] = {0, 0};
+		bool     entered = !enter;
+		// Note: Counts are accumulated locally and only added to the
+		//         (possibly shared) totals at the end.
+		if( (int)_local_src_ngood_ptrs.size() < nbuf ) {
+			this->resize_local(nbuf);
+		}
+		size_t*     local_ngood_bytes     = &_local_ngood_bytes[0];
+		size_t**    local_src_ngood_bytes = &_local_src_ngood_ptrs[0];
+		BufArrival* local_arrivals        = &_local_arrivals[0];
 		int ret;
 		while( true ) {
 			if( !_have_pkt ) {
@@ -333,7 +1163,8 @@ public:
 					}
 					break;
 				}
-				if( !(*decode)(pkt_ptr, pkt_size, &_pkt) ) {
+				if( !(*decode)(pkt_ptr, pkt_size, &_pkt) ||
+				    _pkt.payload_size > max_payload_size ) {
 					++_stats.ninvalid;
 					_stats.ninvalid_bytes += pkt_size;
 					continue;
@@ -347,25 +1178,68 @@ public:
 				break;
 			}
 			_have_pkt = false;
+			if( src_payload_sizes &&
+			    _pkt.payload_size != src_payload_sizes[_pkt.src] ) {
+				// Note: The buffers are laid out for the sources' payload
+				//         sizes, so this packet cannot be scattered into them
+				++_stats.ninvalid;
+				_stats.ninvalid_bytes += _pkt.payload_size;
+				continue;
+			}
 			if( less_than(_pkt.seq, seq_beg) ) {
+				++_late_hist[late_hist_bin(seq_beg - _pkt.seq)];
 				++_stats.nlate;
 				_stats.nlate_bytes += _pkt.payload_size;
 				++_src_stats[_pkt.src].nlate;
 				_src_stats[_pkt.src].nlate_bytes += _pkt.payload_size;
 				continue;
 			}
+			if( !entered ) {
+				if( !(*enter)() ) {
+					_have_pkt = true;
+					ret = CAPTURE_TIMEOUT;
+					break;
+				}
+				entered = true;
+			}
 			++_stats.nvalid;
 			_stats.nvalid_bytes += _pkt.payload_size;
 			++_src_stats[_pkt.src].nvalid;
 			_src_stats[_pkt.src].nvalid_bytes += _pkt.payload_size;
-			// HACK TODO: src_ngood_bytes should be accumulated locally and
-			//              then atomically updated, like ngood_bytes. The
-			//              current way is not thread-safe.
 			(*process)(&_pkt, seq_beg, nseq_per_obuf, nbuf, obufs,
-			           local_ngood_bytes, /*local_*/src_ngood_bytes);
+			           local_ngood_bytes, local_src_ngood_bytes);
+			int      b       = obuf_index(_pkt.seq, seq_beg, nseq_per_obuf);
+			uint64_t arrival = _udp.get_last_arrival();
+			local_arrivals[b].first = std::min(local_arrivals[b].first, arrival);
+			local_arrivals[b].last  = std::max(local_arrivals[b].last,  arrival);
+			if( masks ) {
+				// Mark this packet's (seq, src) slot as received
+				uint64_t offset = _pkt.seq - seq_beg - b*nseq_per_obuf;
+				uint64_t slot   = offset*_pkt.nsrc + _pkt.src;
+				atomic_fetch_and_or(&masks[b][slot / 64],
+				                    (uint64_t)1 << (slot % 64));
+			}
+		}
+		// Note: Orders any streaming stores before the buffers are committed
+		scatter_fence();
+		for( int b=0; b<nbuf; ++b ) {
+			if( local_ngood_bytes[b] ) {
+				atomic_add_and_fetch(ngood_bytes[b], local_ngood_bytes[b]);
+				local_ngood_bytes[b] = 0;
+			}
+			if( local_arrivals[b].last ) {
+				atomic_min(&arrivals[b]->first, local_arrivals[b].first);
+				atomic_max(&arrivals[b]->last,  local_arrivals[b].last);
+				local_arrivals[b] = BufArrival();
+			}
+			for( size_t src=0; src<_src_stats.size(); ++src ) {
+				if( local_src_ngood_bytes[b][src] ) {
+					atomic_add_and_fetch(&src_ngood_bytes[b][src],
+					                     local_src_ngood_bytes[b][src]);
+					local_src_ngood_bytes[b][src] = 0;
+				}
+			}
 		}
-		if( nbuf > 0 ) { atomic_add_and_fetch(ngood_bytes[0], local_ngood_bytes[0]); }
-		if( nbuf > 1 ) { atomic_add_and_fetch(ngood_bytes[1], local_ngood_bytes[1]); }
 		return ret;
 	}
 	inline const PacketDesc* get_last_packet() const {
@@ -373,9 +1247,365 @@ public:
 	}
 	inline const PacketStats* get_stats() const { return &_stats; }
 	inline const PacketStats* get_stats(int src) const { return &_src_stats[src]; }
+	inline const size_t*      get_late_hist() const { return _late_hist; }
+	inline const RecvStats* get_recv_stats() const { return _udp.get_stats(); }
+	inline void set_replay(const BFudpcapture_replay* config) {
+		_udp.set_replay(config);
+	}
+	inline void set_poll(const BFudpcapture_poll* config) {
+		_udp.set_poll(config);
+	}
 	inline void reset_stats() {
 		::memset(&_stats, 0, sizeof(_stats));
 		::memset(&_src_stats[0], 0, _src_stats.size()*sizeof(PacketStats));
+		::memset(_late_hist, 0, sizeof(_late_hist));
+	}
+};
+
+// Captures from several sockets at once (e.g., sharing a port via
+//   SO_REUSEPORT), with one UDPCaptureThread per socket. The first runs in
+//   the calling thread and the rest in worker threads, and all of them
+//   decode and scatter packets into the same output buffers.
+// Note: A worker must enter a gulp before writing into its buffers, so that
+//         the gulp can be closed without waiting for workers that have no
+//         data for it (e.g., shards whose sources are idle) to time out.
+class UDPCaptureGroup {
+	typedef std::unique_lock<std::mutex> lock_type;
+	typedef std::function<int(UDPCaptureThread*,
+	                          const std::function<bool()>*)> work_type;
+	// How long to wait for workers that have not entered a gulp once it is
+	//   otherwise complete, in case they were just slow to start
+	enum { IDLE_GRACE_USEC = 1000 };
+	int                               _nsrc;
+	std::unique_ptr<UDPCaptureThread> _main;
+	std::vector<UDPCaptureThread*>    _captures;
+	std::vector<std::thread>          _workers;
+	std::vector<int>                  _states;
+	// The last gulp (generation) each worker entered and finished, and
+	//   whether it is currently running one
+	std::vector<uint64_t>             _entered;
+	std::vector<uint64_t>             _finished;
+	std::vector<char>                 _running;
+	mutable std::mutex                _mutex;
+	std::condition_variable           _start_cv;
+	std::condition_variable           _done_cv;
+	uint64_t                          _generation;
+	bool                              _gate_open;
+	int                               _nready;
+	bool                              _failed;
+	bool                              _shutdown;
+	work_type                         _work;
+	bool enter(int i, uint64_t generation) {
+		lock_type lock(_mutex);
+		if( generation != _generation || !_gate_open ) {
+			return false;
+		}
+		_entered[i] = generation;
+		return true;
+	}
+	// Returns whether all workers that entered the current gulp have
+	//   finished it (and, if all_workers, that all of the others have too)
+	bool workers_finished(bool all_workers) const {
+		for( size_t i=1; i<_captures.size(); ++i ) {
+			if( _finished[i] != _generation &&
+			    (all_workers || _entered[i] == _generation) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+	// Returns whether the gulp is only waiting on workers that are running
+	//   but have not entered it, after some thread has already moved past
+	//   the end of the window
+	bool only_idle_left() const {
+		bool moved_past = _states[0] & UDPCaptureThread::CAPTURE_SUCCESS;
+		for( size_t i=1; i<_captures.size(); ++i ) {
+			if( _finished[i] == _generation ) {
+				moved_past |= _states[i] & UDPCaptureThread::CAPTURE_SUCCESS;
+			} else if( _entered[i] == _generation || !_running[i] ) {
+				return false;
+			}
+		}
+		return moved_past;
+	}
+	// Copies of a worker's stats taken as it starts a gulp, which are read
+	//   in place of its live counters while it is running
+	struct StatsSnapshot {
+		PacketStats              stats;
+		std::vector<PacketStats> src_stats;
+		size_t                   late_hist[LATE_HIST_NBIN];
+		RecvStats                recv_stats;
+	};
+	std::vector<StatsSnapshot>        _snapshots;
+	PacketStats                       _stats;
+	RecvStats                         _recv_stats;
+	void snapshot_stats(int i) {
+		const UDPCaptureThread* capture  = _captures[i];
+		StatsSnapshot&          snapshot = _snapshots[i];
+		snapshot.stats = *capture->get_stats();
+		snapshot.src_stats.resize(_nsrc);
+		for( int src=0; src<_nsrc; ++src ) {
+			snapshot.src_stats[src] = *capture->get_stats(src);
+		}
+		::memcpy(snapshot.late_hist, capture->get_late_hist(),
+		         sizeof(snapshot.late_hist));
+		snapshot.recv_stats = *capture->get_recv_stats();
+	}
+	// Note: These must be called with _mutex held
+	inline const PacketStats* stats_of(size_t i) const {
+		return _running[i] ? &_snapshots[i].stats : _captures[i]->get_stats();
+	}
+	inline const PacketStats* stats_of(size_t i, int src) const {
+		return (_running[i] ?
+		        &_snapshots[i].src_stats[src] : _captures[i]->get_stats(src));
+	}
+	inline const size_t* late_hist_of(size_t i) const {
+		return (_running[i] ?
+		        _snapshots[i].late_hist : _captures[i]->get_late_hist());
+	}
+	inline const RecvStats* recv_stats_of(size_t i) const {
+		return (_running[i] ?
+		        &_snapshots[i].recv_stats : _captures[i]->get_recv_stats());
+	}
+	void worker(int i, int fd, int core, size_t pkt_size_max, int nslot) {
+		std::unique_ptr<UDPCaptureThread> capture;
+		try {
+			capture.reset(new UDPCaptureThread(fd, _nsrc, core, pkt_size_max,
+			                                   nslot));
+		} catch( ... ) {
+			lock_type lock(_mutex);
+			_failed = true;
+			_done_cv.notify_all();
+			return;
+		}
+		lock_type lock(_mutex);
+		_captures[i] = capture.get();
+		++_nready;
+		_done_cv.notify_all();
+		uint64_t generation = _generation;
+		while( true ) {
+			_start_cv.wait(lock, [&]() {
+					return _shutdown || _generation != generation;
+				});
+			if( _shutdown ) {
+				break;
+			}
+			generation = _generation;
+			// Note: The gulp may be closed (and the next one started) while
+			//         this worker is still waiting for data, so it keeps its
+			//         own copy of the work
+			work_type work = _work;
+			std::function<bool()> enter = [this, i, generation]() {
+				return this->enter(i, generation);
+			};
+			// Note: The counters only change while running, so this is
+			//         consistent until _running[i] is cleared again
+			this->snapshot_stats(i);
+			_running[i] = true;
+			_done_cv.notify_all();
+			lock.unlock();
+			int state;
+			try {
+				state = work(capture.get(), &enter);
+			} catch( ... ) {
+				state = UDPCaptureThread::CAPTURE_ERROR;
+			}
+			lock.lock();
+			_running[i] = false;
+			if( generation == _generation ) {
+				_states[i]   = state;
+				_finished[i] = generation;
+			}
+			_done_cv.notify_all();
+		}
+		_captures[i] = nullptr;
+	}
+	void stop_workers() {
+		{
+			lock_type lock(_mutex);
+			_shutdown = true;
+			_start_cv.notify_all();
+		}
+		for( size_t i=0; i<_workers.size(); ++i ) {
+			_workers[i].join();
+		}
+		_workers.clear();
+	}
+	UDPCaptureGroup(UDPCaptureGroup const& )            = delete;
+	UDPCaptureGroup& operator=(UDPCaptureGroup const& ) = delete;
+public:
+	UDPCaptureGroup(int nfd, const int* fds, const int* cores, int nsrc,
+	                size_t pkt_size_max=JUMBO_FRAME_SIZE,
+	                int    nslot=UDPPacketReceiver::DEFAULT_NSLOT)
+		: _nsrc(nsrc),
+		  _main(new UDPCaptureThread(fds[0], nsrc, cores[0], pkt_size_max,
+		                             nslot)),
+		  _captures(nfd, nullptr), _states(nfd, 0),
+		  _entered(nfd, 0), _finished(nfd, 0), _running(nfd, false),
+		  _generation(0), _gate_open(false), _nready(1), _failed(false),
+		  _shutdown(false), _snapshots(nfd) {
+		_captures[0] = _main.get();
+		for( int i=1; i<nfd; ++i ) {
+			_workers.push_back(std::thread(&UDPCaptureGroup::worker, this,
+			                               i, fds[i], cores[i], pkt_size_max,
+			                               nslot));
+		}
+		lock_type lock(_mutex);
+		_done_cv.wait(lock, [&]() { return _failed || _nready == nfd; });
+		if( _failed ) {
+			lock.unlock();
+			this->stop_workers();
+			throw std::runtime_error("Failed to start capture threads");
+		}
+	}
+	~UDPCaptureGroup() {
+		this->stop_workers();
+	}
+	inline int size() const { return (int)_captures.size(); }
+	// See UDPCaptureThread::run; the result is that of the whole group
+	template<class PacketDecoder, class PacketProcessor>
+	int run(uint64_t         seq_beg,
+	        uint64_t         nseq_per_obuf,
+	        int              nbuf,
+	        uint8_t*         obufs[],
+	        size_t*          ngood_bytes[],
+	        size_t*          src_ngood_bytes[],
+	        uint64_t*        masks[],
+	        BufArrival*      arrivals[],
+	        const int*       src_payload_sizes,
+	        int              max_payload_size,
+	        PacketDecoder*   decode,
+	        PacketProcessor* process) {
+		if( _workers.empty() ) {
+			return _main->run(seq_beg, nseq_per_obuf, nbuf, obufs,
+			                  ngood_bytes, src_ngood_bytes, masks, arrivals,
+			                  src_payload_sizes, max_payload_size, decode, process);
+		}
+		{
+			lock_type lock(_mutex);
+			_work = [=](UDPCaptureThread* capture,
+			            const std::function<bool()>* enter) {
+				return capture->run(seq_beg, nseq_per_obuf, nbuf, obufs,
+				                    ngood_bytes, src_ngood_bytes, masks, arrivals,
+				                    src_payload_sizes, max_payload_size,
+				                    decode, process, enter);
+			};
+			++_generation;
+			_gate_open = true;
+			_start_cv.notify_all();
+		}
+		int main_state = _main->run(seq_beg, nseq_per_obuf, nbuf, obufs,
+		                            ngood_bytes, src_ngood_bytes, masks, arrivals,
+		                            src_payload_sizes, max_payload_size,
+		                            decode, process);
+		lock_type lock(_mutex);
+		_states[0] = main_state;
+		_done_cv.wait(lock, [&]() {
+				return this->workers_finished(true) || this->only_idle_left();
+			});
+		if( !this->workers_finished(true) ) {
+			_done_cv.wait_for(lock, std::chrono::microseconds(IDLE_GRACE_USEC),
+			                  [&]() { return this->workers_finished(true); });
+			// Close the gulp to the workers that are still waiting for data,
+			//   and wait only for those that entered it
+			_gate_open = false;
+			_done_cv.wait(lock, [&]() { return this->workers_finished(false); });
+		}
+		// Note: A socket that timed out (or whose worker was left waiting)
+		//         simply had no data for this gulp
+		int state = _states[0];
+		for( size_t i=1; i<_states.size(); ++i ) {
+			state |= (_finished[i] == _generation ?
+			          _states[i] : (int)UDPCaptureThread::CAPTURE_TIMEOUT);
+		}
+		if( state & UDPCaptureThread::CAPTURE_ERROR ) {
+			return UDPCaptureThread::CAPTURE_ERROR;
+		} else if( state & UDPCaptureThread::CAPTURE_INTERRUPTED ) {
+			return UDPCaptureThread::CAPTURE_INTERRUPTED;
+		} else if( state & UDPCaptureThread::CAPTURE_SUCCESS ) {
+			return UDPCaptureThread::CAPTURE_SUCCESS;
+		}
+		return UDPCaptureThread::CAPTURE_TIMEOUT;
+	}
+	// Returns the earliest of the packets left over by the last run
+	// Note: Workers still waiting for data are skipped
+	inline const PacketDesc* get_last_packet() const {
+		lock_type lock(_mutex);
+		const PacketDesc* pkt = NULL;
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			if( _running[i] ) {
+				continue;
+			}
+			const PacketDesc* cur = _captures[i]->get_last_packet();
+			if( cur && (!pkt || less_than(cur->seq, pkt->seq)) ) {
+				pkt = cur;
+			}
+		}
+		return pkt;
+	}
+	// Adds up the stats for source src across all threads
+	// Note: Workers still waiting for data contribute their stats as of the
+	//         start of their current run
+	inline void get_stats(int src, PacketStats* stats) const {
+		lock_type lock(_mutex);
+		::memset(stats, 0, sizeof(*stats));
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			const PacketStats* cur = this->stats_of(i, src);
+			stats->nlate        += cur->nlate;
+			stats->nlate_bytes  += cur->nlate_bytes;
+			stats->nvalid       += cur->nvalid;
+			stats->nvalid_bytes += cur->nvalid_bytes;
+		}
+	}
+	// Note: Each thread's injector is seeded differently (but reproducibly)
+	inline void set_replay(const BFudpcapture_replay* config) {
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			BFudpcapture_replay thread_config = *config;
+			thread_config.seed += i;
+			_captures[i]->set_replay(&thread_config);
+		}
+	}
+	inline void set_poll(const BFudpcapture_poll* config) {
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			_captures[i]->set_poll(config);
+		}
+	}
+	// Adds up the late-packet histograms across all threads
+	inline void get_late_hist(size_t hist[LATE_HIST_NBIN]) const {
+		lock_type lock(_mutex);
+		::memset(hist, 0, LATE_HIST_NBIN*sizeof(size_t));
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			const size_t* cur = this->late_hist_of(i);
+			for( int bin=0; bin<LATE_HIST_NBIN; ++bin ) {
+				hist[bin] += cur[bin];
+			}
+		}
+	}
+	inline const PacketStats* get_stats() {
+		lock_type lock(_mutex);
+		::memset(&_stats, 0, sizeof(_stats));
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			const PacketStats* stats = this->stats_of(i);
+			_stats.ninvalid       += stats->ninvalid;
+			_stats.ninvalid_bytes += stats->ninvalid_bytes;
+			_stats.nlate          += stats->nlate;
+			_stats.nlate_bytes    += stats->nlate_bytes;
+			_stats.nvalid         += stats->nvalid;
+			_stats.nvalid_bytes   += stats->nvalid_bytes;
+		}
+		return &_stats;
+	}
+	inline const RecvStats* get_recv_stats() {
+		lock_type lock(_mutex);
+		::memset(&_recv_stats, 0, sizeof(_recv_stats));
+		for( size_t i=0; i<_captures.size(); ++i ) {
+			const RecvStats* stats = this->recv_stats_of(i);
+			_recv_stats.ncall   += stats->ncall;
+			_recv_stats.nempty  += stats->nempty;
+			_recv_stats.npacket += stats->npacket;
+			_recv_stats.time    += stats->time;
+		}
+		return &_recv_stats;
 	}
 };
 
@@ -432,7 +1662,15 @@ struct __attribute__((aligned(64))) aligned512_type {
 };
 
 class CHIPSProcessor8bit {
+	scatter_func _scatter;
 public:
+	CHIPSProcessor8bit() : _scatter(scatter_select(scatter_isa_detect())) {}
+	// Note: The output is channel-major, so all sources must be the same size
+	inline bool set_source_layout(const size_t* src_offsets,
+	                              const int*    src_sizes,
+	                              size_t        row_size) {
+		return false;
+	}
 	inline void operator()(const PacketDesc* pkt,
 	                       uint64_t          seq0,
 	                       uint64_t          nseq_per_obuf,
@@ -444,8 +1682,7 @@ public:
 			PKT_NINPUT = 32,
 			PKT_NBIT   = 4
 		};
-		int    obuf_idx = ((pkt->seq - seq0 >= 1*nseq_per_obuf) +
-		                   (pkt->seq - seq0 >= 2*nseq_per_obuf));
+		int    obuf_idx = obuf_index(pkt->seq, seq0, nseq_per_obuf);
 		size_t obuf_seq0 = seq0 + obuf_idx*nseq_per_obuf;
 		size_t nbyte = pkt->payload_size * BF_UNPACK_FACTOR;
 		ngood_bytes[obuf_idx]               += nbyte;
@@ -454,62 +1691,24 @@ public:
 		int payload_size = pkt->payload_size;//pkt->nchan*(PKT_NINPUT*2*PKT_NBIT/8);
 		
 		size_t obuf_offset = (pkt->seq-obuf_seq0)*pkt->nsrc*payload_size;
-		typedef aligned256_type itype;
 		typedef aligned256_type otype;
 		
 		obuf_offset *= BF_UNPACK_FACTOR;
 		
-		// Note: Using these SSE types allows the compiler to use SSE instructions
-		//         However, they require aligned memory (otherwise segfault)
-		itype const* __restrict__ in  = (itype const*)pkt->payload_ptr;
-		otype*       __restrict__ out = (otype*      )&obufs[obuf_idx][obuf_offset];
-		
-		int chan = 0;
-		//cout << pkt->src << ", " << pkt->nsrc << endl;
-		//cout << pkt->nchan << endl;
-		/*
-		  // HACK TESTING disabled
-		for( ; chan<pkt->nchan/4*4; chan+=4 ) {
-			__m128i tmp0 = ((__m128i*)&in[chan])[0];
-			__m128i tmp1 = ((__m128i*)&in[chan])[1];
-			__m128i tmp2 = ((__m128i*)&in[chan+1])[0];
-			__m128i tmp3 = ((__m128i*)&in[chan+1])[1];
-			__m128i tmp4 = ((__m128i*)&in[chan+2])[0];
-			__m128i tmp5 = ((__m128i*)&in[chan+2])[1];
-			__m128i tmp6 = ((__m128i*)&in[chan+3])[0];
-			__m128i tmp7 = ((__m128i*)&in[chan+3])[1];
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*chan])[0], tmp0);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*chan])[1], tmp1);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+1)])[0], tmp2);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+1)])[1], tmp3);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+2)])[0], tmp4);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+2)])[1], tmp5);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+3)])[0], tmp6);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*(chan+3)])[1], tmp7);
-		}
-		*/
-		//for( ; chan<pkt->nchan; ++chan ) {
-		/*
-		for( ; chan<10; ++chan ) { // HACK TESTING
-			__m128i tmp0 = ((__m128i*)&in[chan])[0];
-			__m128i tmp1 = ((__m128i*)&in[chan])[1];
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*chan])[0], tmp0);
-			_mm_store_si128(&((__m128i*)&out[pkt->src + pkt->nsrc*chan])[1], tmp1);
-		}
-		*/
-		//if( pkt->src < 8 ) { // HACK TESTING
-		//for( ; chan<32; ++chan ) { // HACK TESTING
-		for( ; chan<pkt->nchan; ++chan ) { // HACK TESTING
-			out[pkt->src + pkt->nsrc*chan] = in[chan];
-			//::memset(
-		}
-		//}
+		uint8_t* out = &obufs[obuf_idx][obuf_offset + pkt->src*sizeof(otype)];
+		size_t   stride = pkt->nsrc*sizeof(otype);
+		if( ((uintptr_t)out | stride) & (sizeof(otype)-1) ) {
+			scatter_scalar(out, pkt->payload_ptr, pkt->nchan, stride);
+		} else {
+			_scatter(out, pkt->payload_ptr, pkt->nchan, stride);
+		}
 	}
 	inline void blank_out_source(uint8_t* data,
 	                             int      src,
 	                             int      nsrc,
 	                             int      nchan,
-	                             int      nseq) {
+	                             int      nseq,
+	                             int      payload_size) {
 		typedef aligned256_type otype;
 		otype* __restrict__ aligned_data = (otype*)data;
 		for( int t=0; t<nseq; ++t ) {
@@ -519,27 +1718,357 @@ public:
 			}
 		}
 	}
+	inline void blank_out_packet(uint8_t* data,
+	                             int      seq,
+	                             int      src,
+	                             int      nsrc,
+	                             int      nchan,
+	                             int      payload_size) {
+		typedef aligned256_type otype;
+		otype* __restrict__ aligned_data = (otype*)data;
+		for( int c=0; c<nchan; ++c ) {
+			::memset(&aligned_data[src + nsrc*(c + nchan*seq)],
+			         0, sizeof(otype));
+		}
+	}
 };
 
-inline uint64_t round_up(uint64_t val, uint64_t mult) {
-	return (val == 0 ?
-	        0 :
-	        ((val-1)/mult+1)*mult);
-}
-inline uint64_t round_nearest(uint64_t val, uint64_t mult) {
-	return (2*val/mult+1)/2*mult;
-}
+// A minimal generic format: a 16-byte header followed by the payload
+struct simple_hdr_type {
+	// Note: Big endian
+	uint64_t seq;      // Note: 0-based
+	uint16_t src;      // Note: 0-based
+	uint16_t nchan;
+	uint16_t chan0;
+	uint16_t reserved;
+};
+
+class SimpleDecoder {
+	int _nsrc;
+	int _src0;
+	inline bool valid_packet(const PacketDesc* pkt) const {
+		return (pkt->src >= 0 && pkt->src < _nsrc);
+	}
+public:
+	SimpleDecoder(int nsrc, int src0) : _nsrc(nsrc), _src0(src0) {}
+	inline bool operator()(const uint8_t* pkt_ptr,
+	                       int            pkt_size,
+	                       PacketDesc*    pkt) const {
+		if( pkt_size < (int)sizeof(simple_hdr_type) ) {
+			return false;
+		}
+		simple_hdr_type pkt_hdr;
+		::memcpy(&pkt_hdr, pkt_ptr, sizeof(pkt_hdr)); // Note: May be unaligned
+		pkt->seq   = be64toh(pkt_hdr.seq);
+		pkt->nsrc  =         _nsrc;
+		pkt->src   =   ntohs(pkt_hdr.src) - _src0;
+		pkt->nchan =   ntohs(pkt_hdr.nchan);
+		pkt->chan0 =   ntohs(pkt_hdr.chan0);
+		pkt->payload_size = pkt_size - sizeof(simple_hdr_type);
+		pkt->payload_ptr  = pkt_ptr  + sizeof(simple_hdr_type);
+		return this->valid_packet(pkt);
+	}
+};
+
+// SPEAD-style packets, in the common SPEAD-64-48 flavour: an 8-byte header
+//   followed by nitem 8-byte item pointers and then the payload, all big
+//   endian. Each item pointer holds an immediate flag (1 bit), an id (15
+//   bits) and a value (48 bits).
+// Note: Each packet must carry a whole heap, and the following immediate
+//         items are used: the heap counter (-> seq), the source id (-> src)
+//         and the first channel (-> chan0). nchan is not carried, so is 0.
+class SPEADDecoder {
+	enum {
+		SPEAD_MAGIC         = 0x53,
+		SPEAD_VERSION       = 4,
+		SPEAD_ITEM_PTR_SIZE = 2,
+		SPEAD_HEAP_ADDR_SIZE = 6,
+		ITEM_HEAP_COUNTER   = 0x0001,
+		ITEM_HEAP_SIZE      = 0x0002,
+		ITEM_HEAP_OFFSET    = 0x0003,
+		ITEM_PAYLOAD_LENGTH = 0x0004,
+		ITEM_SOURCE_ID      = 0x4101,
+		ITEM_CHAN0          = 0x4103
+	};
+	int _nsrc;
+	int _src0;
+public:
+	SPEADDecoder(int nsrc, int src0) : _nsrc(nsrc), _src0(src0) {}
+	inline bool operator()(const uint8_t* pkt_ptr,
+	                       int            pkt_size,
+	                       PacketDesc*    pkt) const {
+		if( pkt_size < 8 ||
+		    pkt_ptr[0] != SPEAD_MAGIC ||
+		    pkt_ptr[1] != SPEAD_VERSION ||
+		    pkt_ptr[2] != SPEAD_ITEM_PTR_SIZE ||
+		    pkt_ptr[3] != SPEAD_HEAP_ADDR_SIZE ) {
+			return false;
+		}
+		int nitem = (pkt_ptr[6] << 8) | pkt_ptr[7];
+		int hdr_size = 8 + nitem*8;
+		if( pkt_size < hdr_size ) {
+			return false;
+		}
+		int payload_size = pkt_size - hdr_size;
+		bool have_seq = false, have_src = false;
+		uint64_t heap_size = payload_size, heap_offset = 0;
+		uint64_t payload_length = payload_size;
+		pkt->chan0 = 0;
+		for( int i=0; i<nitem; ++i ) {
+			uint64_t item;
+			::memcpy(&item, pkt_ptr + 8 + i*8, sizeof(item));
+			item = be64toh(item);
+			if( !(item >> 63) ) {
+				continue; // Not immediate
+			}
+			int      id    = (item >> 48) & 0x7FFF;
+			uint64_t value = item & 0xFFFFFFFFFFFFull;
+			switch( id ) {
+			case ITEM_HEAP_COUNTER:   pkt->seq = value; have_seq = true; break;
+			case ITEM_HEAP_SIZE:      heap_size      = value; break;
+			case ITEM_HEAP_OFFSET:    heap_offset    = value; break;
+			case ITEM_PAYLOAD_LENGTH: payload_length = value; break;
+			case ITEM_SOURCE_ID:      pkt->src = (int)value - _src0; have_src = true; break;
+			case ITEM_CHAN0:          pkt->chan0 = (int)value; break;
+			default: break;
+			}
+		}
+		pkt->nsrc  = _nsrc;
+		pkt->nchan = 0;
+		pkt->payload_size = payload_size;
+		pkt->payload_ptr  = pkt_ptr + hdr_size;
+		return (have_seq && have_src &&
+		        pkt->src >= 0 && pkt->src < _nsrc &&
+		        heap_offset == 0 &&
+		        heap_size == (uint64_t)payload_size &&
+		        payload_length == (uint64_t)payload_size);
+	}
+};
+
+// Copies each payload into its (seq, src) slot, so that the output buffers
+//   are ordered [time][src][payload]
+// Note: If the sources have different payload sizes (see set_source_layout),
+//         each time holds their payloads back to back instead
+class SimpleProcessor {
+	const size_t* _src_offsets;
+	const int*    _src_sizes;
+	size_t        _row_size;
+	inline size_t offset(uint64_t seq, int src, int nsrc,
+	                     int payload_size) const {
+		if( _src_offsets ) {
+			return seq*_row_size + _src_offsets[src];
+		}
+		return (seq*nsrc + src)*payload_size;
+	}
+public:
+	SimpleProcessor() : _src_offsets(NULL), _src_sizes(NULL), _row_size(0) {}
+	inline bool set_source_layout(const size_t* src_offsets,
+	                              const int*    src_sizes,
+	                              size_t        row_size) {
+		_src_offsets = src_offsets;
+		_src_sizes   = src_sizes;
+		_row_size    = row_size;
+		return true;
+	}
+	inline void operator()(const PacketDesc* pkt,
+	                       uint64_t          seq0,
+	                       uint64_t          nseq_per_obuf,
+	                       int               nbuf,
+	                       uint8_t*          obufs[],
+	                       size_t            ngood_bytes[],
+	                       size_t*           src_ngood_bytes[]) {
+		int    obuf_idx = obuf_index(pkt->seq, seq0, nseq_per_obuf);
+		size_t obuf_seq0 = seq0 + obuf_idx*nseq_per_obuf;
+		size_t nbyte = pkt->payload_size;
+		ngood_bytes[obuf_idx]               += nbyte;
+		src_ngood_bytes[obuf_idx][pkt->src] += nbyte;
+		size_t obuf_offset = this->offset(pkt->seq-obuf_seq0, pkt->src,
+		                                  pkt->nsrc, pkt->payload_size);
+		::memcpy(&obufs[obuf_idx][obuf_offset],
+		         pkt->payload_ptr, pkt->payload_size);
+	}
+	inline void blank_out_source(uint8_t* data,
+	                             int      src,
+	                             int      nsrc,
+	                             int      nchan,
+	                             int      nseq,
+	                             int      payload_size) {
+		if( _src_sizes ) {
+			payload_size = _src_sizes[src];
+		}
+		for( int t=0; t<nseq; ++t ) {
+			::memset(&data[this->offset(t, src, nsrc, payload_size)],
+			         0, payload_size);
+		}
+	}
+	inline void blank_out_packet(uint8_t* data,
+	                             int      seq,
+	                             int      src,
+	                             int      nsrc,
+	                             int      nchan,
+	                             int      payload_size) {
+		if( _src_sizes ) {
+			payload_size = _src_sizes[src];
+		}
+		::memset(&data[this->offset(seq, src, nsrc, payload_size)],
+		         0, payload_size);
+	}
+};
 
+// A table of per-source stats in POSIX shared memory (see
+//   BFudpcapture_stats_header), which other processes can snapshot at any
+//   time without the capture having to write out a file.
+// Note: Updates are protected by a seqlock: the counter is odd while an
+//         update is in progress, and readers retry if it changed under them.
+// Note: Tables are named /bifrost_udp_capture.<pid>.<n>, and are unlinked
+//         when their capture is destroyed. Those left behind by processes
+//         that died without doing so are removed by the next capture to be
+//         created on the host.
+class SourceStatsShm {
+	std::string                _name;
+	size_t                     _size;
+	BFudpcapture_stats_header* _hdr;
+	BFudpcapture_src_stats*    _src;
+	SourceStatsShm(SourceStatsShm const& )            = delete;
+	SourceStatsShm& operator=(SourceStatsShm const& ) = delete;
+	// Removes the tables of processes that no longer exist
+	static void cleanup_stale() {
+		static const std::string prefix = "bifrost_udp_capture.";
+		DIR* dp = ::opendir("/dev/shm");
+		if( !dp ) {
+			return;
+		}
+		while( struct dirent* ep = ::readdir(dp) ) {
+			std::string name = ep->d_name;
+			if( name.compare(0, prefix.size(), prefix) != 0 ) {
+				continue;
+			}
+			pid_t pid = atoi(name.c_str() + prefix.size());
+			if( pid && ::kill(pid, 0) == -1 && errno == ESRCH ) {
+				::shm_unlink(("/" + name).c_str());
+			}
+		}
+		::closedir(dp);
+	}
+public:
+	SourceStatsShm(int nsrc, int src0)
+		: _size(sizeof(BFudpcapture_stats_header) +
+		        nsrc*sizeof(BFudpcapture_src_stats)),
+		  _hdr(0), _src(0) {
+		static int  ninstance = 0;
+		static bool cleaned   = (SourceStatsShm::cleanup_stale(), true);
+		(void)cleaned;
+		// Note: A table of the same name may still exist (e.g., from an
+		//         earlier process with this pid), in which case the next
+		//         name is tried rather than taking over the old table
+		int fd = -1;
+		do {
+			_name = ("/bifrost_udp_capture." + std::to_string(getpid()) +
+			         "." + std::to_string(atomic_fetch_and_add(&ninstance, 1)));
+			fd = ::shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		} while( fd == -1 && errno == EEXIST );
+		if( fd == -1 ) {
+			throw std::runtime_error("Failed to create stats shm");
+		}
+		void* ptr = MAP_FAILED;
+		if( ::ftruncate(fd, _size) == 0 ) {
+			ptr = ::mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		::close(fd);
+		if( ptr == MAP_FAILED ) {
+			::shm_unlink(_name.c_str());
+			throw std::runtime_error("Failed to map stats shm");
+		}
+		_hdr = (BFudpcapture_stats_header*)ptr;
+		_src = (BFudpcapture_src_stats*)(_hdr + 1);
+		// Note: The new memory is already zeroed
+		_hdr->nsrc = nsrc;
+		_hdr->src0 = src0;
+		::memcpy(_hdr->magic, BF_UDP_CAPTURE_STATS_MAGIC, sizeof(_hdr->magic));
+	}
+	~SourceStatsShm() {
+		::munmap(_hdr, _size);
+		::shm_unlink(_name.c_str());
+	}
+	inline const std::string& name() const { return _name; }
+	inline BFudpcapture_src_stats* begin_update() {
+		__atomic_store_n(&_hdr->seqlock, _hdr->seqlock + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		return _src;
+	}
+	inline void end_update(size_t ninvalid, size_t ninvalid_bytes) {
+		_hdr->ninvalid       = ninvalid;
+		_hdr->ninvalid_bytes = ninvalid_bytes;
+		_hdr->update_time    = std::chrono::duration<double>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		__atomic_store_n(&_hdr->seqlock, _hdr->seqlock + 1, __ATOMIC_RELEASE);
+	}
+	// Copies a consistent snapshot of the table (as another process would)
+	inline void snapshot(BFudpcapture_stats_header* hdr,
+	                     BFudpcapture_src_stats*    src) const {
+		while( true ) {
+			BFoffset seq = __atomic_load_n(&_hdr->seqlock, __ATOMIC_ACQUIRE);
+			if( seq & 1 ) {
+				continue;
+			}
+			::memcpy(hdr, _hdr, sizeof(*hdr));
+			::memcpy(src, _src, _hdr->nsrc*sizeof(*src));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if( __atomic_load_n(&_hdr->seqlock, __ATOMIC_RELAXED) == seq ) {
+				break;
+			}
+		}
+	}
+};
+
+// A lock-free single-producer/single-consumer queue of the events reported by
+//   a capture's internal thread. When full, new events are dropped (and
+//   counted in the nlost of the next event that is queued).
+class CaptureEventQueue {
+	enum { CAPACITY = 256 };
+	BFudpcapture_event _events[CAPACITY];
+	uint64_t           _head;  // Next event to pop (written by the consumer)
+	uint64_t           _tail;  // Next event to push (written by the producer)
+	uint64_t           _nlost; // Note: Only accessed by the producer
+public:
+	CaptureEventQueue() : _head(0), _tail(0), _nlost(0) {}
+	inline bool push(BFudpcapture_event event) {
+		uint64_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+		if( _tail - head == CAPACITY ) {
+			++_nlost;
+			return false;
+		}
+		event.nlost = _nlost;
+		_nlost = 0;
+		_events[_tail % CAPACITY] = event;
+		__atomic_store_n(&_tail, _tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	inline bool pop(BFudpcapture_event* event) {
+		uint64_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+		if( _head == tail ) {
+			return false;
+		}
+		*event = _events[_head % CAPACITY];
+		__atomic_store_n(&_head, _head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+// The parts of a capture that do not depend on the packet format; see
+//   UDPCaptureFormat for the rest.
 class BFudpcapture_impl {
-	UDPCaptureThread   _capture;
-	CHIPSDecoder       _decoder;
-	CHIPSProcessor8bit _processor;
+protected:
+	UDPCaptureGroup    _capture;
 	ProcLog            _type_log;
 	ProcLog            _bind_log;
 	ProcLog            _out_log;
 	ProcLog            _size_log;
 	ProcLog            _chan_log;
 	ProcLog            _stat_log;
+	ProcLog            _late_log;
+	ProcLog            _poll_log;
+	ProcLog            _src_size_log;
 	ProcLog            _perf_log;
 	pid_t              _pid;
 	
@@ -548,71 +2077,232 @@ class BFudpcapture_impl {
 	std::chrono::high_resolution_clock::time_point _t2;
 	std::chrono::duration<double> _process_time;
 	std::chrono::duration<double> _reserve_time;
+	RecvStats                     _recv_stats;
+	std::chrono::steady_clock::time_point _stat_log_time;
+	ProcLog                       _src_stats_log;
+	SourceStatsShm                _src_stats;
+	std::vector<size_t>           _src_ngood_bytes;
+	std::vector<size_t>           _src_nmissing_bytes;
 	
 	int      _nsrc;
 	int      _nseq_per_buf;
 	int      _slot_ntime;
+	int      _max_payload_size;
+	int      _nbuf_window;
+	int      _core;
 	BFoffset _seq;
+	BFoffset _seq0;
+	BFoffset _time_tag;
 	int      _chan0;
 	int      _nchan;
 	int      _payload_size;
 	bool     _active;
+	// The payload size of each source, and where it goes in each seq of the
+	//   buffers (uniform unless fixed by set_source_sizes)
+	std::vector<int>    _src_payload_sizes;
+	std::vector<size_t> _src_offsets;
+	size_t              _row_size;
+	bool                _fixed_layout;
 	BFudpcapture_sequence_callback _sequence_callback;
 	
 	RingWrapper _ring;
 	RingWriter  _oring;
-	std::queue<std::shared_ptr<WriteSpan> > _bufs;
-	std::queue<size_t>                      _buf_ngood_bytes;
-	std::queue<std::vector<size_t> >        _buf_src_ngood_bytes;
+	// Note: The open bufs form a reorder window, oldest first
+	std::deque<std::shared_ptr<WriteSpan> > _bufs;
+	std::deque<size_t>                      _buf_ngood_bytes;
+	std::deque<std::vector<size_t> >        _buf_src_ngood_bytes;
+	std::deque<BufArrival>                  _buf_arrivals;
 	std::shared_ptr<WriteSequence>          _sequence;
+	// Optional sidecar ring of received-packet masks
+	std::unique_ptr<RingWrapper>            _mask_ring;
+	std::unique_ptr<RingWriter>             _mask_oring;
+	std::deque<std::shared_ptr<WriteSpan> > _mask_bufs;
+	std::shared_ptr<WriteSequence>          _mask_sequence;
+	// Optional sidecar ring of per-buffer arrival times
+	std::unique_ptr<RingWrapper>            _time_ring;
+	std::unique_ptr<RingWriter>             _time_oring;
+	std::shared_ptr<WriteSequence>          _time_sequence;
+	BFudpcapture_buf_times                  _buf_times;
+	// Note: Odd while _buf_times is being updated, so that it can be read
+	//         while the internal thread is running (see get_buf_times)
+	BFoffset                                _buf_times_seqlock;
+	// Pointers into the open bufs, as passed to run_capture
+	std::vector<uint8_t*>  _buf_ptrs;
+	std::vector<size_t*>   _ngood_bytes_ptrs;
+	std::vector<size_t*>   _src_ngood_bytes_ptrs;
+	std::vector<uint64_t*> _mask_ptrs;
+	std::vector<BufArrival*> _arrival_ptrs;
 	size_t _ngood_bytes;
 	size_t _nmissing_bytes;
+	// The internal capture thread (see start)
+	std::thread       _thread;
+	bool              _stop_requested;
+	bool              _thread_done;
+	CaptureEventQueue _events;
 	
 	inline size_t bufsize(int payload_size=-1) {
 		if( payload_size == -1 ) {
+			if( _fixed_layout ) {
+				return _nseq_per_buf * _row_size;
+			}
 			payload_size = _payload_size;
 		}
 		return _nseq_per_buf * _nsrc * payload_size * BF_UNPACK_FACTOR;
 	}
+	// One bit per (seq, src) slot, padded to a whole no. 64-bit words
+	inline size_t masksize() const {
+		return round_up((uint64_t)_nseq_per_buf * _nsrc, 64) / 8;
+	}
+	// Note: Up to _nbuf_window bufs may be open for writing at one time, so
+	//         the rings are made twice that size to leave room for readers
+	inline void resize_ring() {
+		size_t contig_span  = this->bufsize(_max_payload_size);
+		size_t total_span   = contig_span * 2*_nbuf_window;
+		size_t nringlet_max = 1;
+		_ring.resize(contig_span, total_span, nringlet_max);
+	}
+	inline void resize_mask_ring() {
+		size_t contig_span = this->masksize();
+		_mask_ring->resize(contig_span, contig_span * 2*_nbuf_window, 1);
+	}
+	inline void resize_time_ring() {
+		size_t contig_span = sizeof(BFudpcapture_buf_times);
+		_time_ring->resize(contig_span, contig_span * 2*_nbuf_window, 1);
+	}
+	inline void update_out_log() {
+		std::vector<const char*> names(1, _ring.name());
+		if( _mask_ring ) {
+			names.push_back(_mask_ring->name());
+		}
+		if( _time_ring ) {
+			names.push_back(_time_ring->name());
+		}
+		std::stringstream out_info;
+		out_info << "nring : " << names.size() << "\n";
+		for( size_t i=0; i<names.size(); ++i ) {
+			out_info << "ring" << i << " : " << names[i] << "\n";
+		}
+		_out_log.update() << out_info.str();
+	}
+	inline void update_size_log() {
+		_size_log.update("nsrc         : %i\n"
+		                 "nseq_per_buf : %i\n"
+		                 "slot_ntime   : %i\n"
+		                 "nbuf_window  : %i\n",
+		                 _nsrc, _nseq_per_buf, _slot_ntime, _nbuf_window);
+	}
 	inline void reserve_buf() {
-		_buf_ngood_bytes.push(0);
-		_buf_src_ngood_bytes.push(std::vector<size_t>(_nsrc, 0));
+		_buf_ngood_bytes.push_back(0);
+		_buf_src_ngood_bytes.push_back(std::vector<size_t>(_nsrc, 0));
+		_buf_arrivals.push_back(BufArrival());
 		size_t size = this->bufsize();
 		// TODO: Can make this simpler?
-		_bufs.push(std::shared_ptr<WriteSpan>(new bifrost::ring::WriteSpan(_oring, size)));
+		_bufs.push_back(std::shared_ptr<WriteSpan>(new bifrost::ring::WriteSpan(_oring, size)));
+		if( _mask_oring ) {
+			size_t mask_size = this->masksize();
+			_mask_bufs.push_back(std::shared_ptr<WriteSpan>(
+				new bifrost::ring::WriteSpan(*_mask_oring, mask_size)));
+			::memset(_mask_bufs.back()->data(), 0, mask_size);
+		}
+	}
+	inline size_t src_expected_bytes(int src) const {
+		return (size_t)_nseq_per_buf * _src_payload_sizes[src] * BF_UNPACK_FACTOR;
+	}
+	// Lays out all sources with the payload size of the (new) sequence
+	inline void set_uniform_layout() {
+		if( _fixed_layout ) {
+			return;
+		}
+		for( int src=0; src<_nsrc; ++src ) {
+			_src_payload_sizes[src] = _payload_size;
+			_src_offsets[src]       = (size_t)src * _payload_size;
+		}
+		_row_size = (size_t)_nsrc * _payload_size;
+	}
+	// Zeroes exactly the slots that are not marked in the mask
+	inline void set_buf_times(BFoffset seq0, BFoffset first_arrival,
+	                          BFoffset last_arrival, BFoffset commit_time) {
+		__atomic_store_n(&_buf_times_seqlock, _buf_times_seqlock + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&_buf_times.seq0,          seq0,          __ATOMIC_RELAXED);
+		__atomic_store_n(&_buf_times.first_arrival, first_arrival, __ATOMIC_RELAXED);
+		__atomic_store_n(&_buf_times.last_arrival,  last_arrival,  __ATOMIC_RELAXED);
+		__atomic_store_n(&_buf_times.commit_time,   commit_time,   __ATOMIC_RELAXED);
+		__atomic_store_n(&_buf_times_seqlock, _buf_times_seqlock + 1, __ATOMIC_RELEASE);
+	}
+	inline void blank_out_missing(uint8_t* data, const uint64_t* mask) {
+		size_t nslot = (size_t)_nseq_per_buf * _nsrc;
+		for( size_t w=0; w<(nslot+63)/64; ++w ) {
+			uint64_t missing = ~mask[w];
+			if( (w+1)*64 > nslot ) {
+				missing &= ((uint64_t)1 << (nslot % 64)) - 1;
+			}
+			while( missing ) {
+				size_t slot = w*64 + __builtin_ctzll(missing);
+				missing &= missing - 1;
+				this->blank_out_packet(data, slot / _nsrc, slot % _nsrc);
+			}
+		}
 	}
 	inline void commit_buf() {
 		size_t expected_bytes = _bufs.front()->size();
 		
 		for( int src=0; src<_nsrc; ++src ) {
-			// TODO: This assumes all sources contribute equally; should really
-			//         allow non-uniform partitioning.
-			size_t src_expected_bytes = expected_bytes / _nsrc;
+			size_t src_expected_bytes = this->src_expected_bytes(src);
 			size_t src_ngood_bytes    = _buf_src_ngood_bytes.front()[src];
 			size_t src_nmissing_bytes = src_expected_bytes - src_ngood_bytes;
-			// Detect >50% missing data from this source
-			if( src_nmissing_bytes > src_ngood_bytes ) {
-				// Zero-out this source's contribution to the buffer
-				uint8_t* data = (uint8_t*)_bufs.front()->data();
-				_processor.blank_out_source(data, src, _nsrc,
-				                            _nchan, _nseq_per_buf);
+			_src_ngood_bytes[src]    += src_ngood_bytes;
+			_src_nmissing_bytes[src] += src_nmissing_bytes;
+		}
+		if( _mask_oring ) {
+			// Note: Downstream can flag exactly the missing packets using
+			//         the mask, so there is no need to drop whole sources.
+			this->blank_out_missing((uint8_t*)_bufs.front()->data(),
+			                        (const uint64_t*)_mask_bufs.front()->data());
+			_mask_bufs.front()->commit();
+			_mask_bufs.pop_front();
+		} else {
+			for( int src=0; src<_nsrc; ++src ) {
+				size_t src_expected_bytes = this->src_expected_bytes(src);
+				size_t src_ngood_bytes    = _buf_src_ngood_bytes.front()[src];
+				size_t src_nmissing_bytes = src_expected_bytes - src_ngood_bytes;
+				// Detect >50% missing data from this source
+				if( src_nmissing_bytes > src_ngood_bytes ) {
+					// Zero-out this source's contribution to the buffer
+					uint8_t* data = (uint8_t*)_bufs.front()->data();
+					this->blank_out_source(data, src);
+				}
 			}
 		}
-		_buf_src_ngood_bytes.pop();
+		_buf_src_ngood_bytes.pop_front();
+		
+		const BufArrival& arrival = _buf_arrivals.front();
+		bool have_arrival = arrival.last != 0;
+		this->set_buf_times(_seq,
+		                    have_arrival ? arrival.first : 0,
+		                    have_arrival ? arrival.last  : 0,
+		                    time_now_ns());
+		_buf_arrivals.pop_front();
+		if( _time_oring ) {
+			WriteSpan span(*_time_oring, sizeof(_buf_times));
+			::memcpy(span.data(), &_buf_times, sizeof(_buf_times));
+			span.commit();
+		}
 		
 		_ngood_bytes    += _buf_ngood_bytes.front();
 		//_nmissing_bytes += _bufs.front()->size() - _buf_ngood_bytes.front();
 		//// HACK TESTING 15/16 correction for missing roach11
 		//_nmissing_bytes += _bufs.front()->size()*15/16 - _buf_ngood_bytes.front();
 		_nmissing_bytes += expected_bytes - _buf_ngood_bytes.front();
-		_buf_ngood_bytes.pop();
+		_buf_ngood_bytes.pop_front();
 		
 		_bufs.front()->commit();
-		_bufs.pop();
+		_bufs.pop_front();
 		_seq += _nseq_per_buf;
 	}
 	inline void begin_sequence() {
 		BFoffset    seq0 = _seq;// + _nseq_per_buf*_bufs.size();
+		_seq0 = seq0;
 		const void* hdr;
 		size_t      hdr_size;
 		BFoffset    time_tag;
@@ -636,14 +2326,93 @@ class BFudpcapture_impl {
 		}
 		const char* name     = "";
 		int         nringlet = 1;
+		_time_tag = time_tag;
 		_sequence.reset(new WriteSequence(_oring, name, time_tag,
 		                                  hdr_size, hdr, nringlet));
+		if( _mask_oring ) {
+			_mask_sequence.reset(new WriteSequence(*_mask_oring, name, time_tag,
+			                                       0, NULL, nringlet));
+		}
+		if( _time_oring ) {
+			_time_sequence.reset(new WriteSequence(*_time_oring, name, time_tag,
+			                                       0, NULL, nringlet));
+		}
 	}
 	inline void end_sequence() {
 		_sequence.reset(); // Note: This is releasing the shared_ptr
+		_mask_sequence.reset();
+		_time_sequence.reset();
+	}
+	// Captures into the open buffers (see UDPCaptureGroup::run)
+	virtual int  run_capture(uint64_t    seq_beg,
+	                         uint64_t    nseq_per_obuf,
+	                         int         nbuf,
+	                         uint8_t*    obufs[],
+	                         size_t*     ngood_bytes[],
+	                         size_t*     src_ngood_bytes[],
+	                         uint64_t*   masks[],
+	                         BufArrival* arrivals[],
+	                         const int*  src_payload_sizes,
+	                         int         max_payload_size) = 0;
+	virtual bool set_source_layout() = 0;
+	virtual void blank_out_source(uint8_t* data, int src) = 0;
+	virtual void blank_out_packet(uint8_t* data, int seq, int src) = 0;
+	inline void flush_bufs() {
+		while( _bufs.size() ) {
+			this->commit_buf();
+		}
+		if( _sequence ) {
+			this->end_sequence();
+		}
+	}
+	inline void push_event(BFudpcapture_status status) {
+		BFudpcapture_event event;
+		::memset(&event, 0, sizeof(event));
+		event.status   = status;
+		// Note: An ENDED sequence's seq is the one after its last buffer
+		event.seq      = (status == BF_CAPTURE_ENDED) ? _seq : _seq0;
+		event.time_tag = _time_tag;
+		event.chan0    = _chan0;
+		event.nchan    = _nchan;
+		event.time     = time_now_ns();
+		_events.push(event);
+	}
+	void run_thread() {
+		bfAffinitySetCore(_core);
+		while( !__atomic_load_n(&_stop_requested, __ATOMIC_ACQUIRE) ) {
+			BFudpcapture_status status;
+			try {
+				status = this->recv_gulp();
+			} catch( std::exception const& err ) {
+				BF_REPORT_INTERNAL_ERROR(err.what());
+				status = BF_CAPTURE_ERROR;
+			}
+			if( status == BF_CAPTURE_STARTED ||
+			    status == BF_CAPTURE_CHANGED ||
+			    status == BF_CAPTURE_ENDED ) {
+				this->push_event(status);
+			} else if( status == BF_CAPTURE_INTERRUPTED ||
+			           status == BF_CAPTURE_ERROR ) {
+				// Note: The open bufs are committed (and the sequence
+				//         ended) here, as nothing else would until the
+				//         capture is used again
+				try {
+					this->flush_bufs();
+				} catch( std::exception const& err ) {
+					BF_REPORT_INTERNAL_ERROR(err.what());
+				}
+				_active = false;
+				this->push_event(status);
+				break;
+			}
+		}
+		__atomic_store_n(&_thread_done, true, __ATOMIC_RELEASE);
 	}
 public:
-	inline BFudpcapture_impl(int    fd,
+	inline BFudpcapture_impl(const char* format,
+	           int        nfd,
+	           const int* fds,
+	           const int* cores,
 	           BFring ring,
 	           int    nsrc,
 	           int    src0,
@@ -651,89 +2420,254 @@ public:
 	           int    buffer_ntime,
 	           int    slot_ntime,
 	           BFudpcapture_sequence_callback sequence_callback,
-	           int    core)
-		: _capture(fd, nsrc, core), _decoder(nsrc, src0), _processor(),
+	           int    batch_size)
+		: _capture(nfd, fds, cores, nsrc, JUMBO_FRAME_SIZE,
+		           batch_size ? batch_size : (int)UDPPacketReceiver::DEFAULT_NSLOT),
 		  _type_log("udp_capture/type"),
 		  _bind_log("udp_capture/bind"),
 		  _out_log("udp_capture/out"),
 		  _size_log("udp_capture/sizes"),
 		  _chan_log("udp_capture/chans"),
 		  _stat_log("udp_capture/stats"),
+		  _late_log("udp_capture/late"),
+		  _poll_log("udp_capture/poll"),
+		  _src_size_log("udp_capture/src_sizes"),
 		  _perf_log("udp_capture/perf"), 
+		  _src_stats_log("udp_capture/src_stats"),
+		  _src_stats(nsrc, src0),
+		  _src_ngood_bytes(nsrc, 0), _src_nmissing_bytes(nsrc, 0),
 		  _nsrc(nsrc), _nseq_per_buf(buffer_ntime), _slot_ntime(slot_ntime),
-		  _seq(), _chan0(), _nchan(), _active(false),
+		  _max_payload_size(max_payload_size), _nbuf_window(2),
+		  _core(cores[0]), _seq(), _seq0(), _time_tag(), _chan0(), _nchan(),
+		  _active(false),
+		  _src_payload_sizes(nsrc, 0), _src_offsets(nsrc, 0), _row_size(0),
+		  _fixed_layout(false),
 		  _sequence_callback(sequence_callback),
 		  _ring(ring), _oring(_ring),
 		  // TODO: Add reset method for stats
-		  _ngood_bytes(0), _nmissing_bytes(0) {
-		size_t contig_span  = this->bufsize(max_payload_size);
-		// Note: 2 write bufs may be open for writing at one time
-		size_t total_span   = contig_span * 4;
-		size_t nringlet_max = 1;
-		_ring.resize(contig_span, total_span, nringlet_max);
-		_type_log.update("type : %s", "chips");
-		_bind_log.update("ncore : %i\n"
-		                 "core0 : %i\n", 
-		                 1, core);
-		_out_log.update("nring : %i\n"
-		                "ring0 : %s\n", 
-		                1, _ring.name());
-		_size_log.update("nsrc         : %i\n"
-		                 "nseq_per_buf : %i\n"
-		                 "slot_ntime   : %i\n",
-		                 _nsrc, _nseq_per_buf, _slot_ntime);
+		  _ngood_bytes(0), _nmissing_bytes(0),
+		  _stop_requested(false), _thread_done(false) {
+		::memset(&_recv_stats, 0, sizeof(_recv_stats));
+		::memset(&_buf_times,  0, sizeof(_buf_times));
+		_buf_times_seqlock = 0;
+		this->resize_ring();
+		_type_log.update("type : %s", format);
+		std::stringstream bind_info;
+		bind_info << "ncore : " << nfd << "\n";
+		for( int i=0; i<nfd; ++i ) {
+			bind_info << "core" << i << " : " << cores[i] << "\n";
+		}
+		_bind_log.update() << bind_info.str();
+		this->update_out_log();
+		this->update_size_log();
+		_src_stats_log.update("shm  : %s\n"
+		                      "nsrc : %i\n",
+		                      _src_stats.name().c_str(), _nsrc);
 	}
-	inline void flush() {
-		while( _bufs.size() ) {
-			this->commit_buf();
+	virtual ~BFudpcapture_impl() {}
+	// Note: The thread no longer counts as running once it has exited by
+	//         itself (after an interruption or error), although it is only
+	//         joined by the next call to start or stop
+	inline bool running() const {
+		return (_thread.joinable() &&
+		        !__atomic_load_n(&_thread_done, __ATOMIC_ACQUIRE));
+	}
+	// Runs recv continuously on an internal thread (bound to the first core),
+	//   which reports the sequence events through a queue (see poll_event)
+	inline void start() {
+		BF_ASSERT_EXCEPTION(!this->running(), BF_STATUS_INVALID_STATE);
+		if( _thread.joinable() ) {
+			_thread.join();
 		}
-		if( _sequence ) {
-			this->end_sequence();
+		_stop_requested = false;
+		_thread_done    = false;
+		_thread = std::thread(&BFudpcapture_impl::run_thread, this);
+	}
+	// Note: Returns once the thread has finished its current gulp, which
+	//         can take up to the socket's timeout
+	inline void stop() {
+		if( !_thread.joinable() ) {
+			return;
 		}
+		__atomic_store_n(&_stop_requested, true, __ATOMIC_RELEASE);
+		_thread.join();
+	}
+	// Returns false if there is no event, and sets *active to whether more
+	//   events may still follow
+	inline bool poll_event(BFudpcapture_event* event, bool* active) {
+		// Note: This must be read before popping, so that the thread's final
+		//         event cannot be missed
+		*active = this->running();
+		return _events.pop(event);
+	}
+	inline BFudpcapture_status recv() {
+		BF_ASSERT_EXCEPTION(!this->running(), BF_STATUS_INVALID_STATE);
+		return this->recv_gulp();
+	}
+	inline void flush() {
+		BF_ASSERT_EXCEPTION(!this->running(), BF_STATUS_INVALID_STATE);
+		this->flush_bufs();
 	}
 	inline void end_writing() {
 		this->flush();
 		_oring.close();
+		if( _mask_oring ) {
+			_mask_oring->close();
+		}
+		if( _time_oring ) {
+			_time_oring->close();
+		}
+	}
+	inline void publish_src_stats(const PacketStats* stats) {
+		BFudpcapture_src_stats* table = _src_stats.begin_update();
+		for( int src=0; src<_nsrc; ++src ) {
+			PacketStats src_stats;
+			_capture.get_stats(src, &src_stats);
+			table[src].nvalid         = src_stats.nvalid;
+			table[src].nvalid_bytes   = src_stats.nvalid_bytes;
+			table[src].nlate          = src_stats.nlate;
+			table[src].nlate_bytes    = src_stats.nlate_bytes;
+			table[src].ngood_bytes    = _src_ngood_bytes[src];
+			table[src].nmissing_bytes = _src_nmissing_bytes[src];
+		}
+		_src_stats.end_update(stats->ninvalid, stats->ninvalid_bytes);
 	}
-	BFudpcapture_status recv() {
+	inline void get_src_stats(BFsize nsrc, BFudpcapture_src_stats* stats) {
+		BF_ASSERT_EXCEPTION(nsrc <= (BFsize)_nsrc, BF_STATUS_INVALID_ARGUMENT);
+		BFudpcapture_stats_header hdr;
+		std::vector<BFudpcapture_src_stats> table(_nsrc);
+		_src_stats.snapshot(&hdr, &table[0]);
+		::memcpy(stats, &table[0], nsrc*sizeof(*stats));
+	}
+	inline const char* src_stats_name() const {
+		return _src_stats.name().c_str();
+	}
+	inline void set_mask_ring(BFring ring) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		_mask_oring.reset();
+		_mask_ring.reset(new RingWrapper(ring));
+		this->resize_mask_ring();
+		_mask_oring.reset(new RingWriter(*_mask_ring));
+		this->update_out_log();
+	}
+	inline void set_time_ring(BFring ring) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		_time_oring.reset();
+		_time_ring.reset(new RingWrapper(ring));
+		this->resize_time_ring();
+		_time_oring.reset(new RingWriter(*_time_ring));
+		this->update_out_log();
+	}
+	// Copies a consistent snapshot of the last buffer's times, which may be
+	//   updated concurrently by the internal thread
+	inline void get_buf_times(BFudpcapture_buf_times* times) const {
+		while( true ) {
+			BFoffset seq = __atomic_load_n(&_buf_times_seqlock, __ATOMIC_ACQUIRE);
+			if( seq & 1 ) {
+				continue;
+			}
+			times->seq0          = __atomic_load_n(&_buf_times.seq0,          __ATOMIC_RELAXED);
+			times->first_arrival = __atomic_load_n(&_buf_times.first_arrival, __ATOMIC_RELAXED);
+			times->last_arrival  = __atomic_load_n(&_buf_times.last_arrival,  __ATOMIC_RELAXED);
+			times->commit_time   = __atomic_load_n(&_buf_times.commit_time,   __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if( __atomic_load_n(&_buf_times_seqlock, __ATOMIC_RELAXED) == seq ) {
+				break;
+			}
+		}
+	}
+	inline void set_replay(const BFudpcapture_replay* config) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		BF_ASSERT_EXCEPTION(config->speed >= 0, BF_STATUS_INVALID_ARGUMENT);
+		_capture.set_replay(config);
+	}
+	inline void set_poll(const BFudpcapture_poll* config) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		BF_ASSERT_EXCEPTION(config->backoff_npoll    >= 0 &&
+		                    config->backoff_max_usec >= 0,
+		                    BF_STATUS_INVALID_ARGUMENT);
+		_capture.set_poll(config);
+		_poll_log.update() << "busy             : " << config->busy             << "\n"
+		                   << "busy_poll_usec   : " << config->busy_poll_usec   << "\n"
+		                   << "backoff_npoll    : " << config->backoff_npoll    << "\n"
+		                   << "backoff_max_usec : " << config->backoff_max_usec << "\n";
+	}
+	inline void set_source_sizes(BFsize nsrc, const BFsize* payload_sizes) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		BF_ASSERT_EXCEPTION((int)nsrc == _nsrc, BF_STATUS_INVALID_ARGUMENT);
+		for( int src=0; src<_nsrc; ++src ) {
+			BF_ASSERT_EXCEPTION(payload_sizes[src] <= (BFsize)_max_payload_size,
+			                    BF_STATUS_INVALID_ARGUMENT);
+		}
+		std::stringstream layout_info;
+		size_t offset = 0;
+		for( int src=0; src<_nsrc; ++src ) {
+			_src_payload_sizes[src] = payload_sizes[src];
+			_src_offsets[src]       = offset;
+			offset += payload_sizes[src];
+			layout_info << "src" << src << " : " << payload_sizes[src] << "\n";
+		}
+		_row_size = offset;
+		// Note: Only formats that copy whole payloads support this, and the
+		//         uniform layout is restored at the next sequence otherwise
+		_fixed_layout = this->set_source_layout();
+		BF_ASSERT_EXCEPTION(_fixed_layout, BF_STATUS_UNSUPPORTED);
+		_src_size_log.update() << layout_info.str();
+	}
+	inline void set_reorder_window(int nbuf) {
+		BF_ASSERT_EXCEPTION(!this->running() && !_sequence && _bufs.empty(),
+		                    BF_STATUS_INVALID_STATE);
+		BF_ASSERT_EXCEPTION(nbuf >= 1, BF_STATUS_INVALID_ARGUMENT);
+		_nbuf_window = nbuf;
+		this->resize_ring();
+		if( _mask_ring ) {
+			this->resize_mask_ring();
+		}
+		if( _time_ring ) {
+			this->resize_time_ring();
+		}
+		this->update_size_log();
+	}
+protected:
+	// Captures the next gulp (see recv and run_thread)
+	BFudpcapture_status recv_gulp() {
 		_t0 = std::chrono::high_resolution_clock::now();
 		
-		uint8_t* buf_ptrs[2];
-		// Minor HACK to access the buffers in a 2-element queue
-		buf_ptrs[0] = _bufs.size() > 0 ? (uint8_t*)_bufs.front()->data() : NULL;
-		buf_ptrs[1] = _bufs.size() > 1 ? (uint8_t*)_bufs.back()->data()  : NULL;
-		
-		size_t* ngood_bytes_ptrs[2];
-		ngood_bytes_ptrs[0] = _buf_ngood_bytes.size() > 0 ? &_buf_ngood_bytes.front() : NULL;
-		ngood_bytes_ptrs[1] = _buf_ngood_bytes.size() > 1 ? &_buf_ngood_bytes.back()  : NULL;
-		
-		size_t* src_ngood_bytes_ptrs[2];
-		src_ngood_bytes_ptrs[0] = _buf_src_ngood_bytes.size() > 0 ? &_buf_src_ngood_bytes.front()[0] : NULL;
-		src_ngood_bytes_ptrs[1] = _buf_src_ngood_bytes.size() > 1 ? &_buf_src_ngood_bytes.back()[0]  : NULL;
+		int nbuf = _bufs.size();
+		_buf_ptrs.resize(std::max(nbuf, 1));
+		_ngood_bytes_ptrs.resize(std::max(nbuf, 1));
+		_src_ngood_bytes_ptrs.resize(std::max(nbuf, 1));
+		_mask_ptrs.resize(std::max(nbuf, 1));
+		_arrival_ptrs.resize(std::max(nbuf, 1));
+		for( int b=0; b<nbuf; ++b ) {
+			_buf_ptrs[b]             = (uint8_t*)_bufs[b]->data();
+			_ngood_bytes_ptrs[b]     = &_buf_ngood_bytes[b];
+			_src_ngood_bytes_ptrs[b] = &_buf_src_ngood_bytes[b][0];
+			_mask_ptrs[b]            = _mask_oring ? (uint64_t*)_mask_bufs[b]->data() : NULL;
+			_arrival_ptrs[b]         = &_buf_arrivals[b];
+		}
 		
-		int state = _capture.run(_seq,
-		                         _nseq_per_buf,
-		                         _bufs.size(),
-		                         buf_ptrs,
-		                         ngood_bytes_ptrs,
-		                         src_ngood_bytes_ptrs,
-		                         &_decoder,
-		                         &_processor);
+		int state = this->run_capture(_seq,
+		                              _nseq_per_buf,
+		                              nbuf,
+		                              &_buf_ptrs[0],
+		                              &_ngood_bytes_ptrs[0],
+		                              &_src_ngood_bytes_ptrs[0],
+		                              _mask_oring ? &_mask_ptrs[0] : NULL,
+		                              &_arrival_ptrs[0],
+		                              (_active || _fixed_layout) ?
+		                              &_src_payload_sizes[0] : NULL,
+		                              _max_payload_size);
 		if( state & UDPCaptureThread::CAPTURE_ERROR ) {
 			return BF_CAPTURE_ERROR;
 		} else if( state & UDPCaptureThread::CAPTURE_INTERRUPTED ) {
 			return BF_CAPTURE_INTERRUPTED;
 		}
-		const PacketStats* stats = _capture.get_stats();
-		_stat_log.update() << "ngood_bytes    : " << _ngood_bytes << "\n"
-		                   << "nmissing_bytes : " << _nmissing_bytes << "\n"
-		                   << "ninvalid       : " << stats->ninvalid << "\n"
-		                   << "ninvalid_bytes : " << stats->ninvalid_bytes << "\n"
-		                   << "nlate          : " << stats->nlate << "\n"
-		                   << "nlate_bytes    : " << stats->nlate_bytes << "\n"
-		                   << "nvalid         : " << stats->nvalid << "\n"
-		                   << "nvalid_bytes   : " << stats->nvalid_bytes << "\n";
-		
 		_t1 = std::chrono::high_resolution_clock::now();
 		
 		BFudpcapture_status ret;
@@ -757,6 +2691,7 @@ public:
 				_chan0        = pkt->chan0;
 				_nchan        = pkt->nchan;
 				_payload_size = pkt->payload_size;
+				this->set_uniform_layout();
 				_chan_log.update() << "chan0        : " << _chan0 << "\n"
 				                   << "nchan        : " << _nchan << "\n"
 				                   << "payload_size : " << _payload_size << "\n";
@@ -764,46 +2699,205 @@ public:
 				ret = BF_CAPTURE_STARTED;
 			} else {
 				//cout << "Continuing data, seq = " << seq << endl;
+				// Note: With a fixed layout, packets of the wrong size are
+				//         simply invalid (see UDPCaptureThread::run)
 				if( pkt->chan0 != _chan0 ||
-				    pkt->nchan != _nchan ) {
+				    pkt->nchan != _nchan ||
+				    (!_fixed_layout && pkt->payload_size != _payload_size) ) {
+					// Note: The open bufs are laid out for the old sequence,
+					//         so they are committed to it first
+					this->flush_bufs();
 					_chan0 = pkt->chan0;
 					_nchan = pkt->nchan;
 					_payload_size = pkt->payload_size;
+					this->set_uniform_layout();
 					_chan_log.update() << "chan0        : " << _chan0 << "\n"
 					                   << "nchan        : " << _nchan << "\n"
 					                   << "payload_size : " << _payload_size << "\n";
-					this->end_sequence();
 					this->begin_sequence();
 					ret = BF_CAPTURE_CHANGED;
 				} else {
 					ret = BF_CAPTURE_CONTINUED;
 				}
 			}
-			if( _bufs.size() == 2 ) {
+			if( (int)_bufs.size() == _nbuf_window ) {
 				this->commit_buf();
 			}
 			this->reserve_buf();
 		} else {
 			
 			if( was_active ) {
-				this->flush();
+				this->flush_bufs();
 				ret = BF_CAPTURE_ENDED;
 			} else {
 				ret = BF_CAPTURE_NO_DATA;
 			}
 		}
 		
+		// Note: Stats are published after any bufs have been committed
+		const PacketStats* stats = _capture.get_stats();
+		this->publish_src_stats(stats);
+		// Note: The (file-based) log is only rewritten once a second, or
+		//         whenever the stream goes idle so that it ends up current
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if( now - _stat_log_time >= std::chrono::seconds(1) ||
+		    !(state & UDPCaptureThread::CAPTURE_SUCCESS) ) {
+			_stat_log_time = now;
+			_stat_log.update() << "ngood_bytes    : " << _ngood_bytes << "\n"
+			                   << "nmissing_bytes : " << _nmissing_bytes << "\n"
+			                   << "ninvalid       : " << stats->ninvalid << "\n"
+			                   << "ninvalid_bytes : " << stats->ninvalid_bytes << "\n"
+			                   << "nlate          : " << stats->nlate << "\n"
+			                   << "nlate_bytes    : " << stats->nlate_bytes << "\n"
+			                   << "nvalid         : " << stats->nvalid << "\n"
+			                   << "nvalid_bytes   : " << stats->nvalid_bytes << "\n";
+			size_t late_hist[LATE_HIST_NBIN];
+			_capture.get_late_hist(late_hist);
+			std::stringstream late_info;
+			for( int bin=0; bin<LATE_HIST_NBIN; ++bin ) {
+				// Note: Each key is the min no. seqs late counted in the bin
+				late_info << "late_" << std::left << std::setw(6)
+				          << ((uint64_t)1 << bin) << " : " << late_hist[bin] << "\n";
+			}
+			_late_log.update() << late_info.str();
+		}
+		
 		_t2 = std::chrono::high_resolution_clock::now();
 		_process_time = std::chrono::duration_cast<std::chrono::duration<double>>(_t1-_t0);
 		_reserve_time = std::chrono::duration_cast<std::chrono::duration<double>>(_t2-_t1);
+		// Note: recv_time includes any time spent waiting for packets
+		const RecvStats* recv_stats = _capture.get_recv_stats();
+		size_t ncall   = recv_stats->ncall   - _recv_stats.ncall;
+		size_t nempty  = recv_stats->nempty  - _recv_stats.nempty;
+		size_t npacket = recv_stats->npacket - _recv_stats.npacket;
+		double recv_time = recv_stats->time  - _recv_stats.time;
+		_recv_stats = *recv_stats;
+		double buf_arrival_span   = -1.0;
+		double buf_commit_latency = -1.0;
+		if( _buf_times.last_arrival ) {
+			buf_arrival_span   = 1e-9*(_buf_times.last_arrival - _buf_times.first_arrival);
+			buf_commit_latency = 1e-9*((int64_t)_buf_times.commit_time - (int64_t)_buf_times.last_arrival);
+		}
 		_perf_log.update() << "acquire_time : " << -1.0 << "\n"
 		                   << "process_time : " << _process_time.count() << "\n"
-		                   << "reserve_time : " << _reserve_time.count() << "\n";
+		                   << "reserve_time : " << _reserve_time.count() << "\n"
+		                   << "recv_calls   : " << ncall << "\n"
+		                   << "recv_packets : " << npacket << "\n"
+		                   << "recv_time    : " << recv_time << "\n"
+		                   // Note: The fraction of recv calls/polls that found packets
+		                   << "recv_hit_ratio : "
+		                   << (ncall ? double(ncall - nempty) / ncall : -1.0) << "\n"
+		                   << "recv_time_per_packet : "
+		                   << (npacket ? recv_time / npacket : -1.0) << "\n"
+		                   // Note: These are for the last committed buf, from
+		                   //         its first/last packet arrival to its commit
+		                   << "arrival_span   : " << buf_arrival_span   << "\n"
+		                   << "commit_latency : " << buf_commit_latency << "\n";
 		
 		return ret;
 	}
 };
 
+// Binds a capture to a packet format, so that the capture loop is compiled
+//   separately for each format's decoder and processor.
+template<class PacketDecoder, class PacketProcessor>
+class UDPCaptureFormat : public BFudpcapture_impl {
+	PacketDecoder   _decoder;
+	PacketProcessor _processor;
+	virtual int  run_capture(uint64_t    seq_beg,
+	                         uint64_t    nseq_per_obuf,
+	                         int         nbuf,
+	                         uint8_t*    obufs[],
+	                         size_t*     ngood_bytes[],
+	                         size_t*     src_ngood_bytes[],
+	                         uint64_t*   masks[],
+	                         BufArrival* arrivals[],
+	                         const int*  src_payload_sizes,
+	                         int         max_payload_size) {
+		return _capture.run(seq_beg, nseq_per_obuf, nbuf, obufs,
+		                    ngood_bytes, src_ngood_bytes, masks, arrivals,
+		                    src_payload_sizes, max_payload_size,
+		                    &_decoder, &_processor);
+	}
+	virtual bool set_source_layout() {
+		return _processor.set_source_layout(&_src_offsets[0],
+		                                    &_src_payload_sizes[0],
+		                                    _row_size);
+	}
+	virtual void blank_out_source(uint8_t* data, int src) {
+		_processor.blank_out_source(data, src, _nsrc, _nchan, _nseq_per_buf,
+		                            _payload_size);
+	}
+	virtual void blank_out_packet(uint8_t* data, int seq, int src) {
+		_processor.blank_out_packet(data, seq, src, _nsrc, _nchan,
+		                            _payload_size);
+	}
+public:
+	UDPCaptureFormat(const char* format,
+	                 int        nfd,
+	                 const int* fds,
+	                 const int* cores,
+	                 BFring ring,
+	                 int    nsrc,
+	                 int    src0,
+	                 int    max_payload_size,
+	                 int    buffer_ntime,
+	                 int    slot_ntime,
+	                 BFudpcapture_sequence_callback sequence_callback,
+	                 int    batch_size)
+		: BFudpcapture_impl(format, nfd, fds, cores, ring, nsrc, src0,
+		                    max_payload_size, buffer_ntime, slot_ntime,
+		                    sequence_callback, batch_size),
+		  _decoder(nsrc, src0), _processor() {}
+	// Note: The thread must be stopped while run_capture is still callable
+	virtual ~UDPCaptureFormat() {
+		this->stop();
+	}
+};
+
+typedef BFudpcapture_impl* (*UDPCaptureFactory)(const char* format,
+                                                int        nfd,
+                                                const int* fds,
+                                                const int* cores,
+                                                BFring ring,
+                                                int    nsrc,
+                                                int    src0,
+                                                int    max_payload_size,
+                                                int    buffer_ntime,
+                                                int    slot_ntime,
+                                                BFudpcapture_sequence_callback sequence_callback,
+                                                int    batch_size);
+template<class PacketDecoder, class PacketProcessor>
+BFudpcapture_impl* create_udp_capture(const char* format,
+                                      int        nfd,
+                                      const int* fds,
+                                      const int* cores,
+                                      BFring ring,
+                                      int    nsrc,
+                                      int    src0,
+                                      int    max_payload_size,
+                                      int    buffer_ntime,
+                                      int    slot_ntime,
+                                      BFudpcapture_sequence_callback sequence_callback,
+                                      int    batch_size) {
+	return new UDPCaptureFormat<PacketDecoder, PacketProcessor>(
+		format, nfd, fds, cores, ring, nsrc, src0, max_payload_size,
+		buffer_ntime, slot_ntime, sequence_callback, batch_size);
+}
+
+// The supported packet formats
+// Note: To add a format, write a decoder (which fills in a PacketDesc from a
+//         raw packet) and a processor (which scatters the packet into the
+//         output buffers and can blank out a source), and add them here.
+static const struct {
+	const char*       name;
+	UDPCaptureFactory create;
+} udp_capture_formats[] = {
+	{"chips",  &create_udp_capture<CHIPSDecoder,  CHIPSProcessor8bit>},
+	{"simple", &create_udp_capture<SimpleDecoder, SimpleProcessor>},
+	{"spead",  &create_udp_capture<SPEADDecoder,  SimpleProcessor>}
+};
+
 BFstatus bfUdpCaptureCreate(BFudpcapture* obj,
                             const char*   format,
                             int           fd,
@@ -815,15 +2909,94 @@ BFstatus bfUdpCaptureCreate(BFudpcapture* obj,
                             BFsize        slot_ntime,
                             BFudpcapture_sequence_callback sequence_callback,
                             int           core) {
-	BF_ASSERT(obj, BF_STATUS_INVALID_POINTER);
-	if( format == std::string("chips") ) {
-		BF_TRY_RETURN_ELSE(*obj = new BFudpcapture_impl(fd, ring, nsrc, src0, max_payload_size,
-		                                                buffer_ntime, slot_ntime,
-		                                                sequence_callback, core),
-		                   *obj = 0);
-	} else {
-		return BF_STATUS_UNSUPPORTED;
+	return bfUdpCaptureCreateMulti(obj, format, 1, &fd, &core, ring, nsrc, src0,
+	                               max_payload_size, buffer_ntime, slot_ntime,
+	                               sequence_callback, 0);
+}
+BFstatus bfUdpCaptureCreateMulti(BFudpcapture* obj,
+                                 const char*   format,
+                                 BFsize        nfd,
+                                 const int*    fds,
+                                 const int*    cores,
+                                 BFring        ring,
+                                 BFsize        nsrc,
+                                 BFsize        src0,
+                                 BFsize        max_payload_size,
+                                 BFsize        buffer_ntime,
+                                 BFsize        slot_ntime,
+                                 BFudpcapture_sequence_callback sequence_callback,
+                                 BFsize        batch_size) {
+	BF_ASSERT(obj,   BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(nfd,   BF_STATUS_INVALID_ARGUMENT);
+	BF_ASSERT(fds,   BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(cores, BF_STATUS_INVALID_POINTER);
+	BF_ASSERT(format, BF_STATUS_INVALID_POINTER);
+	int nformat = sizeof(udp_capture_formats) / sizeof(udp_capture_formats[0]);
+	for( int i=0; i<nformat; ++i ) {
+		if( format == std::string(udp_capture_formats[i].name) ) {
+			BF_TRY_RETURN_ELSE(*obj = udp_capture_formats[i].create(
+			                              udp_capture_formats[i].name,
+			                              nfd, fds, cores,
+			                              ring, nsrc, src0, max_payload_size,
+			                              buffer_ntime, slot_ntime,
+			                              sequence_callback, batch_size),
+			                   *obj = 0);
+		}
 	}
+	return BF_STATUS_UNSUPPORTED;
+}
+BFstatus bfUdpCaptureSetMaskRing(BFudpcapture obj, BFring mask_ring) {
+	BF_ASSERT(obj,       BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(mask_ring, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(obj->set_mask_ring(mask_ring));
+}
+BFstatus bfUdpCaptureSetTimeRing(BFudpcapture obj, BFring time_ring) {
+	BF_ASSERT(obj,       BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(time_ring, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(obj->set_time_ring(time_ring));
+}
+BFstatus bfUdpCaptureGetBufferTimes(BFudpcapture            obj,
+                                    BFudpcapture_buf_times* times) {
+	BF_ASSERT(obj,   BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(times, BF_STATUS_INVALID_POINTER);
+	obj->get_buf_times(times);
+	return BF_STATUS_SUCCESS;
+}
+BFstatus bfUdpCaptureSetReplay(BFudpcapture               obj,
+                               const BFudpcapture_replay* config) {
+	BF_ASSERT(obj,    BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(config, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(obj->set_replay(config));
+}
+BFstatus bfUdpCaptureSetPoll(BFudpcapture             obj,
+                             const BFudpcapture_poll* config) {
+	BF_ASSERT(obj,    BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(config, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(obj->set_poll(config));
+}
+BFstatus bfUdpCaptureSetSourceSizes(BFudpcapture  obj,
+                                    BFsize        nsrc,
+                                    const BFsize* payload_sizes) {
+	BF_ASSERT(obj,           BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(payload_sizes, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(obj->set_source_sizes(nsrc, payload_sizes));
+}
+BFstatus bfUdpCaptureSetReorderWindow(BFudpcapture obj, BFsize nbuf) {
+	BF_ASSERT(obj, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(obj->set_reorder_window(nbuf));
+}
+BFstatus bfUdpCaptureGetSourceStatsName(BFudpcapture obj, const char** name) {
+	BF_ASSERT(obj,  BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(name, BF_STATUS_INVALID_POINTER);
+	*name = obj->src_stats_name();
+	return BF_STATUS_SUCCESS;
+}
+BFstatus bfUdpCaptureGetSourceStats(BFudpcapture            obj,
+                                    BFsize                  nsrc,
+                                    BFudpcapture_src_stats* stats) {
+	BF_ASSERT(obj,   BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(stats, BF_STATUS_INVALID_POINTER);
+	BF_TRY_RETURN(obj->get_src_stats(nsrc, stats));
 }
 BFstatus bfUdpCaptureDestroy(BFudpcapture obj) {
 	BF_ASSERT(obj, BF_STATUS_INVALID_HANDLE);
@@ -835,6 +3008,23 @@ BFstatus bfUdpCaptureRecv(BFudpcapture obj, BFudpcapture_status* result) {
 	BF_TRY_RETURN_ELSE(*result = obj->recv(),
 	                   *result = BF_CAPTURE_ERROR);
 }
+BFstatus bfUdpCaptureStart(BFudpcapture obj) {
+	BF_ASSERT(obj, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(obj->start());
+}
+BFstatus bfUdpCaptureStop(BFudpcapture obj) {
+	BF_ASSERT(obj, BF_STATUS_INVALID_HANDLE);
+	BF_TRY_RETURN(obj->stop());
+}
+BFstatus bfUdpCapturePollEvent(BFudpcapture obj, BFudpcapture_event* event) {
+	BF_ASSERT(obj,   BF_STATUS_INVALID_HANDLE);
+	BF_ASSERT(event, BF_STATUS_INVALID_POINTER);
+	bool active;
+	if( obj->poll_event(event, &active) ) {
+		return BF_STATUS_SUCCESS;
+	}
+	return active ? BF_STATUS_WOULD_BLOCK : BF_STATUS_END_OF_DATA;
+}
 BFstatus bfUdpCaptureFlush(BFudpcapture obj) {
 	BF_ASSERT(obj, BF_STATUS_INVALID_HANDLE);
 	BF_TRY_RETURN(obj->flush());
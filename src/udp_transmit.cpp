@@ -36,6 +36,7 @@
 #include <sys/socket.h> // For recvfrom
 
 #include <queue>
+#include <vector>
 #include <memory>
 #include <stdexcept>
 #include <cstdlib>      // For posix_memalign
@@ -45,6 +46,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fstream>
+#include <chrono>
+#include <cerrno>
 
 #if BF_HWLOC_ENABLED
 #include <hwloc.h>
@@ -114,23 +117,40 @@ public:
 		ssize_t nsent = sendmsg(_fd, packet, 0);
 		if( nsent == -1 ) {
 			++_stats.ninvalid;
-			_stats.ninvalid_bytes += packet->msg_iovlen;
+			for( size_t i=0; i<packet->msg_iovlen; ++i ) {
+				_stats.ninvalid_bytes += packet->msg_iov[i].iov_len;
+			}
 		} else {
 			++_stats.nvalid;
 			_stats.nvalid_bytes += nsent;
 		}
 		return nsent;
 	}
+	// Returns the no. packets sent, or -1 if none were
+	// Note: sendmmsg may send only some of the packets (e.g., if it is
+	//         interrupted, or hits an error part-way through), in which case
+	//         the rest are retried until they are sent or an error occurs
 	inline ssize_t sendmany(mmsghdr *packets, unsigned int npackets) {
-		ssize_t nsent = sendmmsg(_fd, packets, npackets, 0);
-		if( nsent == -1 ) {
-			_stats.ninvalid += npackets;
-			_stats.ninvalid_bytes += npackets * packets->msg_len;
-		} else {
-			_stats.nvalid += npackets;
-			_stats.nvalid_bytes += npackets * packets->msg_len;
+		unsigned int nsent = 0;
+		while( nsent < npackets ) {
+			int n = sendmmsg(_fd, packets + nsent, npackets - nsent, 0);
+			if( n == -1 && errno == EINTR ) {
+				continue;
+			}
+			if( n <= 0 ) {
+				break;
+			}
+			for( int i=0; i<n; ++i ) {
+				_stats.nvalid_bytes += packets[nsent + i].msg_len;
+			}
+			_stats.nvalid += n;
+			nsent         += n;
 		}
-		return nsent;
+		for( unsigned int i=nsent; i<npackets; ++i ) {
+			_stats.ninvalid_bytes += packets[i].msg_hdr.msg_iov[0].iov_len;
+		}
+		_stats.ninvalid += npackets - nsent;
+		return nsent ? (ssize_t)nsent : -1;
 	}
 	inline const PacketStats* get_stats() const { return &_stats; }
 	inline void reset_stats() {
@@ -144,8 +164,19 @@ class BFudptransmit_impl {
 	ProcLog            _bind_log;
 	ProcLog            _stat_log;
 	pid_t              _pid;
+	std::chrono::steady_clock::time_point _stat_log_time;
+	// Note: These are reused between calls to sendmany (and only grow)
+	std::vector<mmsghdr> _mmsgs;
+	std::vector<iovec>   _iovs;
 	
-	void update_stats_log() {
+	// Note: The (file-based) log is only rewritten once a second, or
+	//         whenever a send fails
+	void update_stats_log(bool force=false) {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if( !force && now - _stat_log_time < std::chrono::seconds(1) ) {
+			return;
+		}
+		_stat_log_time = now;
 		const PacketStats* stats = _transmit.get_stats();
 		_stat_log.update() << "ngood_bytes    : " << stats->nvalid_bytes << "\n"
 		                   << "nmissing_bytes : " << stats->ninvalid_bytes << "\n"
@@ -167,6 +198,9 @@ public:
 		_bind_log.update() << "ncore : " << 1 << "\n"
 		                   << "core0 : " << core << "\n";
 	}
+	~BFudptransmit_impl() {
+		this->update_stats_log(true);
+	}
 	BFudptransmit_status send(char *packet, unsigned int len) {
 		ssize_t state;
 		struct msghdr msg;
@@ -179,35 +213,39 @@ public:
 		iov[0].iov_len = len;
 		
 		state = _transmit.send( &msg );
+		this->update_stats_log(state == -1);
 		if( state == -1 ) {
 			return BF_TRANSMIT_ERROR;
 		}
-		this->update_stats_log();
 		return BF_TRANSMIT_CONTINUED;
 	}
 	BFudptransmit_status sendmany(char *packets, unsigned int len, unsigned int npackets) {
 		ssize_t state;
 		unsigned int i;
-		struct mmsghdr *mmsg = NULL;
-		struct iovec *iovs = NULL;
 		
-		mmsg = (struct mmsghdr *) malloc(sizeof(struct mmsghdr)*npackets);
-		iovs = (struct iovec *) malloc(sizeof(struct iovec)*npackets);
-		memset(mmsg, 0, sizeof(struct mmsghdr)*npackets);
+		if( npackets == 0 ) {
+			return BF_TRANSMIT_CONTINUED;
+		}
+		if( npackets > _mmsgs.size() ) {
+			_mmsgs.resize(npackets);
+			_iovs.resize(npackets);
+			::memset(&_mmsgs[0], 0, sizeof(mmsghdr)*npackets);
+			for(i=0; i<npackets; i++) {
+				_mmsgs[i].msg_hdr.msg_iov = &_iovs[i];
+				_mmsgs[i].msg_hdr.msg_iovlen = 1;
+			}
+		}
 		for(i=0; i<npackets; i++) {
-			mmsg[i].msg_hdr.msg_iov = &iovs[i];
-			mmsg[i].msg_hdr.msg_iovlen = 1;
-			iovs[i].iov_base = (packets + i*len);
-			iovs[i].iov_len = len;
+			_iovs[i].iov_base = (packets + i*len);
+			_iovs[i].iov_len = len;
 		}
 		
-		state = _transmit.sendmany(mmsg, npackets);
-		free(mmsg);
-		free(iovs);
-		if( state == -1 ) {
+		state = _transmit.sendmany(&_mmsgs[0], npackets);
+		bool failed = (state == -1 || state < (ssize_t)npackets);
+		this->update_stats_log(failed);
+		if( failed ) {
 			return BF_TRANSMIT_ERROR;
 		}
-		this->update_stats_log();
 		return BF_TRANSMIT_CONTINUED;
 	}
 };
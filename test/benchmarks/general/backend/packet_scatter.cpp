@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the bandwidth of the CHIPS packet scatter for each ISA supported
+//   by this CPU, scattering nsrc sources' packets into ring-sized buffers.
+// Build: g++ -O3 -std=c++11 -I../../../../src packet_scatter.cpp -o packet_scatter
+// Usage: ./packet_scatter [nsrc=16] [nchan=109] [buffer_mbyte=256]
+
+#include "packet_scatter.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+	int    nsrc     = argc > 1 ? atoi(argv[1]) : 16;
+	int    nchan    = argc > 2 ? atoi(argv[2]) : 109;
+	size_t buf_size = (argc > 3 ? atoi(argv[3]) : 256) * (size_t)(1<<20);
+	size_t pkt_size = nchan*SCATTER_CHUNK_SIZE;
+	size_t nseq     = buf_size / (nsrc*pkt_size);
+	buf_size = nseq*nsrc*pkt_size;
+	uint8_t* out;
+	if( ::posix_memalign((void**)&out, 4096, buf_size) ) {
+		fprintf(stderr, "Allocation failed\n");
+		return 1;
+	}
+	// Note: Offset the payload as it would be behind a 16-byte header
+	std::vector<uint8_t> pkt(pkt_size + 16 + SCATTER_CHUNK_SIZE);
+	for( size_t i=0; i<pkt.size(); ++i ) {
+		pkt[i] = i;
+	}
+	const uint8_t* in = &pkt[16];
+	size_t stride = nsrc*SCATTER_CHUNK_SIZE;
+	ScatterISA best = scatter_isa_detect();
+	printf("nsrc = %i, nchan = %i, buffer = %.1f MB\n",
+	       nsrc, nchan, buf_size/1e6);
+	for( int isa=SCATTER_SCALAR; isa<=best; ++isa ) {
+		scatter_func scatter = scatter_select((ScatterISA)isa);
+		double best_secs = 1e99;
+		for( int rep=0; rep<5; ++rep ) {
+			auto t0 = std::chrono::high_resolution_clock::now();
+			for( size_t seq=0; seq<nseq; ++seq ) {
+				for( int src=0; src<nsrc; ++src ) {
+					scatter(out + (seq*nsrc*nchan + src)*SCATTER_CHUNK_SIZE,
+					        in, nchan, stride);
+				}
+			}
+			scatter_fence();
+			auto t1 = std::chrono::high_resolution_clock::now();
+			best_secs = std::min(best_secs,
+			                     std::chrono::duration<double>(t1-t0).count());
+		}
+		// Check the result
+		for( int chan=0; chan<nchan; ++chan ) {
+			if( out[chan*stride + 5] != in[chan*SCATTER_CHUNK_SIZE + 5] ) {
+				fprintf(stderr, "%s: wrong output\n",
+				        scatter_isa_name((ScatterISA)isa));
+				return 1;
+			}
+		}
+		printf("%-7s %8.2f GB/s %8.2f Mpkt/s\n",
+		       scatter_isa_name((ScatterISA)isa),
+		       buf_size / best_secs / 1e9,
+		       nseq*nsrc / best_secs / 1e6);
+	}
+	::free(out);
+	return 0;
+}
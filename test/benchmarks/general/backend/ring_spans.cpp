@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// Pushes spans through a ring with and without lock-free mode (see
+//   bfRingSetLockFree), with nreader guaranteed readers on their own threads,
+//   to measure the span rate of the reserve/commit/acquire/release path.
+//   This is the C++ counterpart of ring_spans.py, without its Python
+//   overheads.
+// Build: g++ -O3 -std=c++11 -I../../../../src ring_spans.cpp -o ring_spans -L../../../../lib -lbifrost -lpthread
+// Usage: ./ring_spans [nspan=1000000] [nreader=1 ...]
+
+#include <bifrost/common.h>
+#include <bifrost/ring.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static double run_ring(bool lockfree, BFsize span_size, BFsize buf_nspan,
+                       long nspan, int nreader) {
+	BFring ring;
+	bfRingCreate(&ring, lockfree ? "bench_lockfree" : "bench_locked",
+	             BF_SPACE_SYSTEM);
+	bfRingSetLockFree(ring, lockfree);
+	bfRingResize(ring, span_size, buf_nspan*span_size, 1);
+	bfRingBeginWriting(ring);
+	BFwsequence wseq;
+	bfRingSequenceBegin(&wseq, ring, "bench", 0, 0, 0, 1, 0);
+	std::vector<BFrsequence> rseqs(nreader);
+	for( int r=0; r<nreader; ++r ) {
+		bfRingSequenceOpenEarliest(&rseqs[r], ring, true);
+	}
+	std::vector<std::thread> readers;
+	for( int r=0; r<nreader; ++r ) {
+		BFrsequence rseq = rseqs[r];
+		readers.push_back(std::thread([=]() {
+			for( long i=0; i<nspan; ++i ) {
+				BFrspan rspan;
+				if( bfRingSpanAcquire(&rspan, rseq, i*span_size, span_size) ) {
+					break;
+				}
+				bfRingSpanRelease(rspan);
+			}
+		}));
+	}
+	std::chrono::high_resolution_clock::time_point t0, t1;
+	t0 = std::chrono::high_resolution_clock::now();
+	for( long i=0; i<nspan; ++i ) {
+		BFwspan wspan;
+		bfRingSpanReserve(&wspan, ring, span_size, false);
+		bfRingSpanCommit(wspan, span_size);
+	}
+	for( int r=0; r<nreader; ++r ) {
+		readers[r].join();
+	}
+	t1 = std::chrono::high_resolution_clock::now();
+	bfRingSequenceEnd(wseq, 0);
+	for( int r=0; r<nreader; ++r ) {
+		bfRingSequenceClose(rseqs[r]);
+	}
+	bfRingEndWriting(ring);
+	bfRingDestroy(ring);
+	return nspan / std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+	long nspan = argc > 1 ? atol(argv[1]) : 1000000;
+	std::vector<int> nreaders;
+	for( int i=2; i<argc; ++i ) {
+		nreaders.push_back(atoi(argv[i]));
+	}
+	if( nreaders.empty() ) {
+		nreaders.push_back(1);
+		nreaders.push_back(4);
+	}
+	BFsize span_sizes[] = {64, 4096, 1<<20};
+	printf("%9s %7s %14s %14s %7s\n",
+	       "span", "nreader", "locked/s", "lock-free/s", "speedup");
+	for( int s=0; s<3; ++s ) {
+		for( size_t r=0; r<nreaders.size(); ++r ) {
+			double locked   = run_ring(false, span_sizes[s], 8, nspan, nreaders[r]);
+			double lockfree = run_ring(true,  span_sizes[s], 8, nspan, nreaders[r]);
+			printf("%9lu %7i %14.0f %14.0f %7.2f\n",
+			       (unsigned long)span_sizes[s], nreaders[r],
+			       locked, lockfree, lockfree / locked);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+""" Measure the span throughput of a ring with and without lock-free mode """
+from __future__ import print_function
+import sys
+import threading
+from timeit import default_timer as timer
+import bifrost as bf
+from bifrost.ring2 import Ring
+
+def run_ring(lockfree, gulp_nbyte, buf_ngulp, ngulp, nreader):
+    """ Push ngulp spans of gulp_nbyte through a ring with nreader guaranteed
+    readers and return the span rate """
+    ring = Ring(space='system')
+    ring.lockfree = lockfree
+    header = {'name': 'bench',
+              'time_tag': 0,
+              '_tensor': {'dtype': 'u8',
+                          'shape': [-1, gulp_nbyte],
+                          'labels': ['time', 'byte'],
+                          'units': [None, None],
+                          'scales': [[0, 1], None]}}
+    ready = [threading.Event() for _ in range(nreader)]
+    def reader(opened):
+        iseq = ring.open_earliest_sequence(guarantee=True)
+        opened.set()
+        offset = 0
+        while True:
+            try:
+                with iseq.acquire(offset, 1) as ispan:
+                    if ispan.nframe == 0:
+                        break
+            except StopIteration:
+                break
+            offset += 1
+        iseq.close()
+    with ring.begin_writing() as oring:
+        with oring.begin_sequence(header, 1, buf_ngulp) as oseq:
+            threads = [threading.Thread(target=reader, args=(opened,))
+                       for opened in ready]
+            for thread in threads:
+                thread.start()
+            for opened in ready:
+                opened.wait()
+            start = timer()
+            for _ in range(ngulp):
+                with oseq.reserve(1) as ospan:
+                    ospan.commit(1)
+    for thread in threads:
+        thread.join()
+    end = timer()
+    return ngulp / (end - start)
+
+if __name__ == "__main__":
+    ngulp = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    for gulp_nbyte in (64, 4096, 1 << 20):
+        for nreader in (1, 4):
+            rates = [run_ring(lockfree, gulp_nbyte, 8, ngulp, nreader)
+                     for lockfree in (False, True)]
+            print("gulp=%-8i nreader=%i  locked: %10.0f spans/s  lock-free: %10.0f spans/s (x%.2f)" % \
+                  (gulp_nbyte, nreader, rates[0], rates[1], rates[1] / rates[0]))
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Replays a synthetic CHIPS capture file through the UDP capture, to measure
+//   the throughput of the capture loop without a NIC. The stats printed at
+//   the end are deterministic for a given set of arguments, and so can also
+//   be used to check how the capture handles the injected drops/reordering.
+// Build: g++ -O3 -std=c++11 -I../../../../src udp_capture_replay.cpp -o udp_capture_replay -L../../../../lib -lbifrost
+// Usage: ./udp_capture_replay [format=pcap|pcapng|dump] [nsrc=16] [nchan=109]
+//          [nseq=2000] [drop_prob=0] [reorder_prob=0] [reorder_depth=64]
+//          [nbuf_window=2] [speed=0]
+
+#include <cstddef>
+#include <bifrost/udp_capture.h>
+#include <bifrost/ring.h>
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum { BUFFER_NTIME = 250 };
+
+// Writes a capture file of nseq x nsrc CHIPS packets, 1 us apart
+class CaptureFileWriter {
+	FILE*       _file;
+	std::string _format;
+	void write(const void* data, size_t size) {
+		if( fwrite(data, 1, size, _file) != size ) {
+			perror("fwrite");
+			exit(1);
+		}
+	}
+	template<typename T>
+	void write_val(T val) { this->write(&val, sizeof(val)); }
+	void write_pcapng_block(uint32_t type, const std::vector<uint8_t>& body) {
+		size_t padded_size = (body.size() + 3) / 4 * 4;
+		uint32_t size = 12 + padded_size;
+		this->write_val<uint32_t>(type);
+		this->write_val<uint32_t>(size);
+		this->write(&body[0], body.size());
+		this->write("\0\0\0", padded_size - body.size());
+		this->write_val<uint32_t>(size);
+	}
+public:
+	CaptureFileWriter(FILE* file, std::string format)
+		: _file(file), _format(format) {
+		if( _format == "dump" ) {
+			this->write(BF_UDP_CAPTURE_DUMP_MAGIC, 8);
+		} else if( _format == "pcap" ) {
+			uint32_t hdr[6] = {0xa1b23c4d, 2 | (4 << 16), 0, 0, 65535, 1};
+			this->write(hdr, sizeof(hdr));
+		} else {
+			std::vector<uint8_t> shb(16, 0);
+			uint32_t shb_hdr[2] = {0x1a2b3c4d, 1};
+			::memcpy(&shb[0], shb_hdr, sizeof(shb_hdr));
+			::memset(&shb[8], 0xFF, 8); // Unknown section length
+			this->write_pcapng_block(0x0a0d0d0a, shb);
+			// Ethernet, with ns timestamps (if_tsresol = 9)
+			uint8_t idb[] = {1, 0, 0, 0, 0xFF, 0xFF, 0, 0,
+			                 9, 0, 1, 0, 9, 0, 0, 0, 0, 0, 0, 0};
+			this->write_pcapng_block(1, std::vector<uint8_t>(idb, idb + sizeof(idb)));
+		}
+	}
+	void write_packet(uint64_t time_ns, const std::vector<uint8_t>& payload) {
+		if( _format == "dump" ) {
+			this->write_val<uint64_t>(time_ns);
+			this->write_val<uint32_t>(payload.size());
+			this->write_val<uint32_t>(0);
+			this->write(&payload[0], payload.size());
+			return;
+		}
+		// Ethernet + IPv4 + UDP headers
+		std::vector<uint8_t> frame(14 + 20 + 8, 0);
+		frame[12] = 0x08;
+		frame[14] = 0x45;
+		uint16_t ip_len  = htons(20 + 8 + payload.size());
+		uint16_t udp_len = htons(8 + payload.size());
+		::memcpy(&frame[16], &ip_len, 2);
+		frame[22] = 64;
+		frame[23] = 17; // UDP
+		::memcpy(&frame[38], &udp_len, 2);
+		frame.insert(frame.end(), payload.begin(), payload.end());
+		if( _format == "pcap" ) {
+			this->write_val<uint32_t>(time_ns / 1000000000);
+			this->write_val<uint32_t>(time_ns % 1000000000);
+			this->write_val<uint32_t>(frame.size());
+			this->write_val<uint32_t>(frame.size());
+			this->write(&frame[0], frame.size());
+		} else {
+			std::vector<uint8_t> epb(20, 0);
+			uint32_t epb_hdr[5] = {0, (uint32_t)(time_ns >> 32), (uint32_t)time_ns,
+			                       (uint32_t)frame.size(), (uint32_t)frame.size()};
+			::memcpy(&epb[0], epb_hdr, sizeof(epb_hdr));
+			epb.insert(epb.end(), frame.begin(), frame.end());
+			this->write_pcapng_block(6, epb);
+		}
+	}
+};
+
+int main(int argc, char* argv[]) {
+	std::string format = argc > 1 ? argv[1] : "pcap";
+	int    nsrc          = argc > 2 ? atoi(argv[2]) : 16;
+	int    nchan         = argc > 3 ? atoi(argv[3]) : 109;
+	int    nseq          = argc > 4 ? atoi(argv[4]) : 2000;
+	BFudpcapture_replay replay;
+	::memset(&replay, 0, sizeof(replay));
+	replay.drop_prob     = argc > 5 ? atof(argv[5]) : 0;
+	replay.reorder_prob  = argc > 6 ? atof(argv[6]) : 0;
+	replay.reorder_depth = argc > 7 ? atoi(argv[7]) : 64;
+	int    nbuf_window   = argc > 8 ? atoi(argv[8]) : 2;
+	replay.speed         = argc > 9 ? atof(argv[9]) : 0;
+	
+	FILE* file = tmpfile();
+	if( !file ) {
+		perror("tmpfile");
+		return 1;
+	}
+	CaptureFileWriter writer(file, format);
+	std::vector<uint8_t> pkt(16 + nchan*32);
+	for( size_t i=16; i<pkt.size(); ++i ) {
+		pkt[i] = i;
+	}
+	uint64_t t0 = 1500000000ull*1000000000ull;
+	for( int t=0; t<nseq; ++t ) {
+		for( int src=0; src<nsrc; ++src ) {
+			pkt[0] = src + 1;
+			pkt[2] = nchan;
+			uint64_t seq = htobe64(t + 1);
+			::memcpy(&pkt[8], &seq, 8);
+			writer.write_packet(t0 + (uint64_t)(t*nsrc + src)*1000, pkt);
+		}
+	}
+	fflush(file);
+	
+	BFring ring;
+	BFudpcapture capture;
+	if( bfRingCreate(&ring, "udp_capture_replay", BF_SPACE_SYSTEM) ||
+	    bfUdpCaptureCreate(&capture, "chips", fileno(file), ring, nsrc, 0,
+	                       pkt.size() - 16, BUFFER_NTIME, BUFFER_NTIME,
+	                       0, -1) ||
+	    bfUdpCaptureSetReplay(capture, &replay) ||
+	    bfUdpCaptureSetReorderWindow(capture, nbuf_window) ) {
+		fprintf(stderr, "Failed to create capture\n");
+		return 1;
+	}
+	std::chrono::high_resolution_clock::time_point t_start, t_stop;
+	t_start = std::chrono::high_resolution_clock::now();
+	BFudpcapture_status status;
+	do {
+		if( bfUdpCaptureRecv(capture, &status) ) {
+			fprintf(stderr, "Capture failed\n");
+			return 1;
+		}
+	} while( status != BF_CAPTURE_ENDED && status != BF_CAPTURE_NO_DATA );
+	t_stop = std::chrono::high_resolution_clock::now();
+	double elapsed = std::chrono::duration<double>(t_stop - t_start).count();
+	
+	std::vector<BFudpcapture_src_stats> stats(nsrc);
+	bfUdpCaptureGetSourceStats(capture, nsrc, &stats[0]);
+	BFudpcapture_src_stats total;
+	::memset(&total, 0, sizeof(total));
+	for( int src=0; src<nsrc; ++src ) {
+		total.nvalid         += stats[src].nvalid;
+		total.nlate          += stats[src].nlate;
+		total.ngood_bytes    += stats[src].ngood_bytes;
+		total.nmissing_bytes += stats[src].nmissing_bytes;
+	}
+	size_t npacket = total.nvalid + total.nlate;
+	printf("%-7s %9s %9s %9s %9s\n", "format", "npacket", "time", "Mpkt/s", "Gbit/s");
+	printf("%-7s %9lu %9.4f %9.3f %9.3f\n", format.c_str(),
+	       (unsigned long)npacket, elapsed, npacket / elapsed / 1e6,
+	       npacket * pkt.size() * 8 / elapsed / 1e9);
+	printf("nvalid %llu nlate %llu ngood_bytes %llu nmissing_bytes %llu\n",
+	       total.nvalid, total.nlate, total.ngood_bytes, total.nmissing_bytes);
+	
+	bfUdpCaptureDestroy(capture);
+	bfRingDestroy(ring);
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of The Bifrost Authors nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Sends packets over loopback with bfUdpTransmitSendMany, to measure the
+//   packet rate of the transmit path. A receiver thread drains the socket
+//   with recvmmsg so that the kernel's receive buffer does not limit it.
+// Build: g++ -O3 -std=c++11 -I../../../../src udp_transmit_loopback.cpp -o udp_transmit_loopback -L../../../../lib -lbifrost -lpthread
+// Usage: ./udp_transmit_loopback [npacket=1000000] [packet_size=1024]
+//          [batch=32 ...]
+
+#include <cstddef>
+#include <bifrost/common.h>
+#include <bifrost/udp_transmit.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+	int npacket     = argc > 1 ? atoi(argv[1]) : 1000000;
+	int packet_size = argc > 2 ? atoi(argv[2]) : 1024;
+	std::vector<int> batches;
+	for( int i=3; i<argc; ++i ) {
+		batches.push_back(atoi(argv[i]));
+	}
+	if( batches.empty() ) {
+		int default_batches[] = {1, 8, 32, 128};
+		batches.assign(default_batches, default_batches + 4);
+	}
+	
+	printf("%6s %9s %9s %9s %9s %9s\n",
+	       "batch", "nsent", "nrecv", "time", "Mpkt/s", "Gbit/s");
+	for( size_t b=0; b<batches.size(); ++b ) {
+		int batch = batches[b];
+		int rx = socket(AF_INET, SOCK_DGRAM, 0);
+		int tx = socket(AF_INET, SOCK_DGRAM, 0);
+		int rcvbuf = 64*1024*1024;
+		setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		timeval timeout = {0, 100000};
+		setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		sockaddr_in addr;
+		::memset(&addr, 0, sizeof(addr));
+		addr.sin_family      = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t addr_size = sizeof(addr);
+		if( bind(rx, (sockaddr*)&addr, sizeof(addr)) ||
+		    getsockname(rx, (sockaddr*)&addr, &addr_size) ||
+		    connect(tx, (sockaddr*)&addr, sizeof(addr)) ) {
+			perror("socket");
+			return 1;
+		}
+		
+		std::atomic<bool> done(false);
+		size_t nrecv = 0;
+		std::thread receiver([&]() {
+			enum { NMSG = 256 };
+			std::vector<char>    buf(NMSG*packet_size);
+			std::vector<mmsghdr> msgs(NMSG);
+			std::vector<iovec>   iovs(NMSG);
+			::memset(&msgs[0], 0, NMSG*sizeof(mmsghdr));
+			for( int i=0; i<NMSG; ++i ) {
+				iovs[i].iov_base = &buf[i*packet_size];
+				iovs[i].iov_len  = packet_size;
+				msgs[i].msg_hdr.msg_iov    = &iovs[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			while( true ) {
+				int n = recvmmsg(rx, &msgs[0], NMSG, MSG_WAITFORONE, 0);
+				if( n > 0 ) {
+					nrecv += n;
+				} else if( done ) {
+					break;
+				}
+			}
+		});
+		
+		BFudptransmit transmit;
+		if( bfUdpTransmitCreate(&transmit, tx, -1) ) {
+			fprintf(stderr, "Failed to create transmit\n");
+			return 1;
+		}
+		std::vector<char> packets(batch*packet_size);
+		for( size_t i=0; i<packets.size(); ++i ) {
+			packets[i] = i;
+		}
+		std::chrono::high_resolution_clock::time_point t0, t1;
+		t0 = std::chrono::high_resolution_clock::now();
+		int nsent = 0;
+		while( nsent < npacket ) {
+			int n = std::min(batch, npacket - nsent);
+			bfUdpTransmitSendMany(transmit, &packets[0], packet_size, n);
+			nsent += n;
+		}
+		t1 = std::chrono::high_resolution_clock::now();
+		double elapsed = std::chrono::duration<double>(t1 - t0).count();
+		done = true;
+		receiver.join();
+		printf("%6i %9i %9lu %9.4f %9.3f %9.3f\n", batch, nsent,
+		       (unsigned long)nrecv, elapsed, nsent / elapsed / 1e6,
+		       (double)nsent * packet_size * 8 / elapsed / 1e9);
+		
+		bfUdpTransmitDestroy(transmit);
+		close(tx);
+		close(rx);
+	}
+	return 0;
+}
@@ -0,0 +1,847 @@
+
+# Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# * Neither the name of The Bifrost Authors nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Tests the features of bifrost.ring2.Ring beyond plain reading and writing
+"""
+
+import unittest
+import os
+import json
+import signal
+import struct
+import tempfile
+import threading
+import time
+import numpy as np
+from bifrost.ring2 import Ring
+from bifrost.libbifrost import _bf
+from bifrost.proclog import load_by_filename
+
+def make_header(name="seq", time_tag=0, frame_nbyte=64, nringlet=None):
+    shape = [-1, frame_nbyte] if nringlet is None else [nringlet, -1, frame_nbyte]
+    return {'name':     name,
+            'time_tag': time_tag,
+            '_tensor':  {'dtype': 'u8', 'shape': shape}}
+
+def make_frames(frame_offset, nframe, frame_nbyte, seed=0):
+    """Returns the (deterministic) contents of frames [frame_offset,
+    frame_offset+nframe) of a sequence"""
+    frames = np.arange(frame_offset, frame_offset + nframe)[:, None]
+    return ((frames * 7 + np.arange(frame_nbyte) + seed) % 251).astype(np.uint8)
+
+def write_frames(oseq, frame_offset, nframe, frame_nbyte, seed=0):
+    with oseq.reserve(nframe) as ospan:
+        ospan.data[...] = make_frames(frame_offset, nframe, frame_nbyte, seed)
+        ospan.commit(nframe)
+
+def read_all(iseq, gulp_nframe, frame_nbyte, errors, seed=0):
+    """Reads the sequence to its end, checking the data and returning the
+    number of frames read"""
+    offset = 0
+    while True:
+        try:
+            with iseq.acquire(offset, gulp_nframe) as ispan:
+                nframe = ispan.nframe
+                if nframe == 0:
+                    break
+                if ispan.nframe_skipped:
+                    errors.append("Skipped %i frames at %i" %
+                                  (ispan.nframe_skipped, offset))
+                expected = make_frames(offset, nframe, frame_nbyte, seed)
+                if not np.array_equal(np.array(ispan.data), expected):
+                    errors.append("Bad data at frame %i" % offset)
+        except StopIteration:
+            break
+        offset += nframe
+    return offset
+
+def load_ring_log(ring, rewrite=True):
+    """Returns the current contents of the ring's ProcLog entry"""
+    if rewrite:
+        # Note: Setting the wait policy rewrites the entry
+        ring.set_wait_policy(*ring.wait_policy)
+    return load_by_filename(os.path.join('/dev/shm/bifrost', str(os.getpid()),
+                                         'rings', ring.name))
+
+def load_dump(filename):
+    """Returns the records of a dump (see bfRingDump) as a list of
+    (record dict, header, [data of each ringlet]) tuples"""
+    fmt = '<8s8Q256s'
+    keys = ['record_size', 'data_offset', 'time_tag', 'offset', 'size',
+            'nringlet', 'chunk_size', 'header_size']
+    with open(filename, 'rb') as fh:
+        contents = fh.read()
+    records = []
+    pos = 0
+    while pos < len(contents):
+        fields = struct.unpack_from(fmt, contents, pos)
+        assert(fields[0] == b'BFRDUMP1')
+        record = dict(zip(keys, fields[1:-1]))
+        record['name'] = fields[-1].rstrip(b'\0').decode()
+        hbeg = pos + struct.calcsize(fmt)
+        header = json.loads(contents[hbeg:hbeg + record['header_size']])
+        # The ringlets are interleaved in chunks
+        size, chunk_size = record['size'], record['chunk_size']
+        ringlets = [b''] * record['nringlet']
+        dpos = pos + record['data_offset']
+        for beg in range(0, size, chunk_size):
+            nbyte = min(chunk_size, size - beg)
+            for r in range(record['nringlet']):
+                ringlets[r] += contents[dpos:dpos + nbyte]
+                dpos += nbyte
+        records.append((record, header, ringlets))
+        pos += record['record_size']
+    return records
+
+class SteppedReader(object):
+    """Reads a sequence in gulps of nframe as the data become available"""
+    def __init__(self, iseq, nframe, frame_nbyte, errors):
+        self.iseq        = iseq
+        self.nframe      = nframe
+        self.frame_nbyte = frame_nbyte
+        self.errors      = errors
+        self.offset      = 0
+    def read(self, nframe_written):
+        while self.offset + self.nframe <= nframe_written:
+            with self.iseq.acquire(self.offset, self.nframe) as ispan:
+                expected = make_frames(self.offset, self.nframe,
+                                       self.frame_nbyte)
+                if (ispan.nframe != self.nframe or
+                    not np.array_equal(np.array(ispan.data), expected)):
+                    self.errors.append("Bad data at frame %i (gulp %i)" %
+                                       (self.offset, self.nframe))
+            self.offset += self.nframe
+
+class RingTest(unittest.TestCase):
+    def test_lockfree(self):
+        ring = Ring(name="test_ring_lockfree")
+        self.assertFalse(ring.lockfree)
+        ring.lockfree = True
+        self.assertTrue(ring.lockfree)
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(), 4, 64) as oseq:
+                for i in range(10):
+                    write_frames(oseq, i * 4, 4, 64)
+        errors = []
+        with ring.open_earliest_sequence(guarantee=True) as iseq:
+            self.assertEqual(read_all(iseq, 4, 64, errors), 40)
+        self.assertEqual(errors, [])
+    def test_lockfree_concurrent(self):
+        # One writer, several guaranteed readers (with gulps that straddle
+        #   the end of the buffer) and a thread that grows the ring, all at
+        #   once, so that the lock-free fast paths race with the locked ones
+        #   and with reallocation.
+        frame_nbyte, gulp_nframe, nspan = 96, 4, 2000
+        ring = Ring(name="test_ring_lockfree_concurrent")
+        ring.lockfree = True
+        reader_gulps = [gulp_nframe, 3, 5]
+        opened  = [threading.Event() for _ in reader_gulps]
+        nread   = [0] * len(reader_gulps)
+        errors  = []
+        def reader(i):
+            with ring.open_earliest_sequence(guarantee=True) as iseq:
+                opened[i].set()
+                nread[i] = read_all(iseq, reader_gulps[i], frame_nbyte, errors)
+        def resizer():
+            for factor in (5, 6, 8):
+                ring.resize(gulp_nframe * frame_nbyte,
+                            factor * gulp_nframe * frame_nbyte)
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      gulp_nframe, 4 * gulp_nframe) as oseq:
+                readers = [threading.Thread(target=reader, args=(i,))
+                           for i in range(len(reader_gulps))]
+                for thread in readers:
+                    thread.start()
+                for event in opened:
+                    event.wait()
+                resize_thread = threading.Thread(target=resizer)
+                for i in range(nspan):
+                    if i == nspan // 4:
+                        resize_thread.start()
+                    write_frames(oseq, i * gulp_nframe, gulp_nframe,
+                                 frame_nbyte)
+                resize_thread.join()
+        for thread in readers:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertEqual(nread, [nspan * gulp_nframe] * len(reader_gulps))
+    def test_mirrored(self):
+        ring = Ring(name="test_ring_mirrored")
+        ring.mirrored = True
+        self.assertTrue(ring.mirrored)
+        # Spans of 5000 bytes do not divide the (page-rounded) buffer, so
+        #   they regularly wrap around its end.
+        frame_nbyte, gulp_nframe = 1000, 5
+        errors = []
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      gulp_nframe, 3 * gulp_nframe) as oseq:
+                with ring.open_earliest_sequence(guarantee=True) as iseq:
+                    for i in range(20):
+                        offset = i * gulp_nframe
+                        write_frames(oseq, offset, gulp_nframe, frame_nbyte)
+                        with iseq.acquire(offset, gulp_nframe) as ispan:
+                            expected = make_frames(offset, gulp_nframe,
+                                                   frame_nbyte)
+                            if not np.array_equal(np.array(ispan.data),
+                                                  expected):
+                                errors.append(offset)
+        self.assertEqual(errors, [])
+        # The allocation mode cannot change once the buffer exists
+        with self.assertRaises(RuntimeError):
+            ring.mirrored = False
+    def test_exact_spans(self):
+        # The buffer (7 gulps of 3000 bytes) is not a power of two in size.
+        #   Many times its size is written, which also rebases the ring's
+        #   internal offset origin along the way, while readers with gulps
+        #   that do and do not divide the buffer check every byte.
+        frame_nbyte, gulp_nframe, buf_nframe = 1000, 3, 21
+        ring = Ring(name="test_ring_exact_spans")
+        errors = []
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      gulp_nframe, buf_nframe) as oseq:
+                with ring.open_earliest_sequence(guarantee=True) as iseq1, \
+                     ring.open_earliest_sequence(guarantee=True) as iseq2:
+                    readers = [SteppedReader(iseq1, gulp_nframe, frame_nbyte,
+                                             errors),
+                               SteppedReader(iseq2, 4, frame_nbyte, errors)]
+                    for i in range(300):
+                        write_frames(oseq, i * gulp_nframe, gulp_nframe,
+                                     frame_nbyte)
+                        for reader in readers:
+                            reader.read((i + 1) * gulp_nframe)
+        self.assertEqual(errors, [])
+        self.assertEqual([reader.offset for reader in readers], [900, 900])
+    def check_resize_wrapped(self, mirrored, nread, nwrite, new_buf_nframe):
+        # Fills a buffer of 7 frames so that the live data wrap around its
+        #   end (frames [nwrite-7,nwrite), of which the reader has consumed
+        #   up to nread), grows it, and then checks that all of the data
+        #   survived and that streaming continues correctly.
+        frame_nbyte, buf_nframe, nframe = 4096, 7, 60
+        ring = Ring(name="test_ring_resize_wrapped_%i" % mirrored)
+        ring.mirrored = mirrored
+        errors = []
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      1, buf_nframe) as oseq:
+                with ring.open_earliest_sequence(guarantee=True) as iseq:
+                    reader = SteppedReader(iseq, 1, frame_nbyte, errors)
+                    for i in range(buf_nframe):
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    reader.read(nread)
+                    for i in range(buf_nframe, nwrite):
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    ring.resize(frame_nbyte, new_buf_nframe * frame_nbyte)
+                    # Fill the grown buffer before reading any more, so that
+                    #   the tail moves on while older data are still unread
+                    nfill = nread - 1 + new_buf_nframe
+                    for i in range(nwrite, nframe):
+                        if i >= nfill:
+                            reader.read(i)
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    reader.read(nframe)
+        self.assertEqual(errors, [])
+        self.assertEqual(reader.offset, nframe)
+    def test_resize_wrapped(self):
+        self.check_resize_wrapped(False, 5, 10, 9)
+        self.check_resize_wrapped(False, 6, 11, 16)
+    def test_resize_wrapped_mirrored(self):
+        # Mirrored rings grow in place, moving the smaller part of the
+        #   wrapped data next to the larger part (here the front part, both
+        #   with a larger growth and with a smaller one than it, and then
+        #   the back part).
+        self.check_resize_wrapped(True, 5, 10, 16)
+        self.check_resize_wrapped(True, 5, 10, 9)
+        self.check_resize_wrapped(True, 6, 11, 9)
+    def test_proclog(self):
+        frame_nbyte, buf_nframe = 4096, 8
+        ring = Ring(name="test_ring_proclog")
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      1, buf_nframe) as oseq:
+                with ring.open_earliest_sequence(guarantee=True) as iseq:
+                    for i in range(6):
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    log = load_ring_log(ring)
+                    self.assertEqual(log['span'], buf_nframe * frame_nbyte)
+                    self.assertEqual(log['nbyte_committed'], 6 * frame_nbyte)
+                    self.assertEqual(log['fill'], 6 * frame_nbyte)
+                    self.assertEqual(log['fill_high_water'], 6 * frame_nbyte)
+                    self.assertEqual(log['nguarantee'], 1)
+                    self.assertEqual(log['guarantee0_lag'], 6 * frame_nbyte)
+                    # The reader keeps up from here on, so the fill is capped
+                    #   at the size of the buffer
+                    for i in range(6, 20):
+                        with iseq.acquire(i - 6, 1):
+                            pass
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    log = load_ring_log(ring)
+                    self.assertEqual(log['nbyte_committed'], 20 * frame_nbyte)
+                    self.assertEqual(log['fill'], buf_nframe * frame_nbyte)
+                    self.assertEqual(log['fill_high_water'],
+                                     buf_nframe * frame_nbyte)
+                    self.assertEqual(log['guarantee0_lag'], 7 * frame_nbyte)
+                    self.assertEqual(log['guarantee0_nbyte_read'],
+                                     13 * frame_nbyte)
+                    # A reader blocked on the next frame shows up in the entry
+                    #   while it waits, and in the block seconds afterwards
+                    def reader():
+                        with iseq.acquire(20, 1):
+                            pass
+                    thread = threading.Thread(target=reader)
+                    thread.start()
+                    t0 = time.time()
+                    waiting = 0
+                    while time.time() - t0 < 5:
+                        time.sleep(0.05)
+                        log = load_ring_log(ring, rewrite=False)
+                        waiting = log.get('read_wait_current_secs', 0)
+                        if waiting > 0.2:
+                            break
+                    self.assertGreater(waiting, 0.2)
+                    write_frames(oseq, 20, 1, frame_nbyte)
+                    thread.join()
+                    log = load_ring_log(ring)
+                    self.assertEqual(log['read_wait_current_secs'], 0)
+                    self.assertEqual(log['read_nwait_blocked'], 1)
+                    self.assertGreater(log['read_wait_block_secs'], 0.2)
+        log = load_ring_log(ring)
+        self.assertEqual(log['nguarantee'], 0)
+    def check_wait_policy(self, policy, spin_count):
+        frame_nbyte, nframe, delay = 4096, 6, 0.02
+        ring = Ring(name="test_ring_wait_%s" % policy)
+        ring.set_wait_policy(policy, spin_count)
+        self.assertEqual(ring.wait_policy, (policy, spin_count))
+        errors = []
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header("read", 0, frame_nbyte),
+                                      1, 4) as oseq:
+                # The reader has to wait for each frame, and is woken by the
+                #   commits and finally by the end of the sequence
+                opened = threading.Event()
+                nread  = []
+                def reader():
+                    with ring.open_earliest_sequence(guarantee=True) as iseq:
+                        opened.set()
+                        nread.append(read_all(iseq, 1, frame_nbyte, errors))
+                thread = threading.Thread(target=reader)
+                thread.start()
+                opened.wait()
+                for i in range(nframe):
+                    time.sleep(delay)
+                    write_frames(oseq, i, 1, frame_nbyte)
+            thread.join()
+            self.assertEqual(errors, [])
+            self.assertEqual(nread, [nframe])
+            read_log = load_ring_log(ring)
+            nwait = (read_log['read_nwait_spun'] +
+                     read_log['read_nwait_blocked'])
+            self.assertGreaterEqual(nwait, nframe)
+            self.assertGreater(read_log['read_wait_spin_secs'] +
+                               read_log['read_wait_block_secs'],
+                               nframe * delay / 2)
+            self.assertEqual(read_log['read_wait_current_secs'], 0)
+            # The writer has to wait for space while a guaranteed reader
+            #   holds the (full) buffer
+            with oring.begin_sequence(make_header("write", 1, frame_nbyte),
+                                      1, 4) as oseq:
+                with ring.open_latest_sequence(guarantee=True) as iseq:
+                    for i in range(4):
+                        write_frames(oseq, i, 1, frame_nbyte)
+                    # Nothing can be reserved without waiting
+                    with self.assertRaises(IOError):
+                        oseq.reserve(1, nonblocking=True)
+                    def slow_reader():
+                        # Note: Acquiring frame 1 moves the guarantee past
+                        #         frame 0, which frees the space for frame 4
+                        time.sleep(delay)
+                        with iseq.acquire(1, 1):
+                            pass
+                    thread = threading.Thread(target=slow_reader)
+                    thread.start()
+                    t0 = time.time()
+                    write_frames(oseq, 4, 1, frame_nbyte)
+                    self.assertGreater(time.time() - t0, delay / 2)
+                    thread.join()
+        log = load_ring_log(ring)
+        self.assertGreaterEqual(log['write_nwait_spun'] +
+                                log['write_nwait_blocked'], 1)
+        self.assertEqual(log['write_wait_current_secs'], 0)
+        return log
+    def test_wait_block(self):
+        log = self.check_wait_policy('block', 0)
+        # Blocking waits never spin
+        self.assertEqual(log['read_nwait_spun'], 0)
+        self.assertEqual(log['read_wait_spin_secs'], 0)
+        self.assertEqual(log['write_nwait_spun'], 0)
+        self.assertEqual(log['write_wait_spin_secs'], 0)
+        self.assertGreater(log['read_wait_block_secs'], 0)
+    def test_wait_spin(self):
+        log = self.check_wait_policy('spin', 0)
+        # Spinning waits never block
+        self.assertEqual(log['read_nwait_blocked'], 0)
+        self.assertEqual(log['read_wait_block_secs'], 0)
+        self.assertEqual(log['write_nwait_blocked'], 0)
+        self.assertGreater(log['read_wait_spin_secs'], 0)
+    def test_wait_spin_yield(self):
+        log = self.check_wait_policy('spin_yield', 100)
+        self.assertEqual(log['read_nwait_blocked'], 0)
+        self.assertEqual(log['write_nwait_blocked'], 0)
+        self.assertGreater(log['read_wait_spin_secs'], 0)
+    def test_wait_spin_then_block(self):
+        # The spin budget is far shorter than the waits, so they all end up
+        #   blocking
+        log = self.check_wait_policy('spin_then_block', 100)
+        self.assertGreater(log['read_nwait_blocked'], 0)
+        self.assertGreater(log['read_wait_block_secs'], 0)
+        self.assertGreater(log['read_wait_spin_secs'], 0)
+    def test_acquire_many(self):
+        frame_nbyte, gulp_nframe = 64, 4
+        ring = Ring(name="test_ring_acquire_many")
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      gulp_nframe, 64) as oseq:
+                with ring.open_earliest_sequence(guarantee=True) as iseq:
+                    for i in range(5):
+                        write_frames(oseq, i * gulp_nframe, gulp_nframe,
+                                     frame_nbyte)
+                    # Only the spans that are already available are acquired
+                    ispans = iseq.acquire_many(0, gulp_nframe, 8)
+                    self.assertEqual(len(ispans), 5)
+                    for i, ispan in enumerate(ispans):
+                        self.assertEqual(ispan.frame_offset, i * gulp_nframe)
+                        np.testing.assert_array_equal(
+                            np.array(ispan.data),
+                            make_frames(i * gulp_nframe, gulp_nframe,
+                                        frame_nbyte))
+                    iseq.release_many(ispans)
+                    # All open reads are closed, so the ring can be resized
+                    ring.resize(gulp_nframe * frame_nbyte, 128 * frame_nbyte)
+                    offsets = []
+                    for ispan in iseq.read(gulp_nframe, batch=3):
+                        offsets.append(ispan.frame_offset)
+                        np.testing.assert_array_equal(
+                            np.array(ispan.data),
+                            make_frames(ispan.frame_offset, gulp_nframe,
+                                        frame_nbyte))
+                        if len(offsets) == 5:
+                            break
+                    self.assertEqual(offsets, [0, 4, 8, 12, 16])
+                    ring.resize(gulp_nframe * frame_nbyte, 256 * frame_nbyte)
+    def test_release_many_invalid(self):
+        frame_nbyte, gulp_nframe = 64, 4
+        ring = Ring(name="test_ring_release_many_invalid")
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      gulp_nframe, 64) as oseq:
+                for i in range(4):
+                    write_frames(oseq, i * gulp_nframe, gulp_nframe,
+                                 frame_nbyte)
+                with ring.open_earliest_sequence(guarantee=True) as iseq, \
+                     ring.open_earliest_sequence(guarantee=True) as iseq2:
+                    ispans  = iseq.acquire_many(0, gulp_nframe, 2)
+                    ispans2 = iseq2.acquire_many(0, gulp_nframe, 2)
+                    self.assertEqual((len(ispans), len(ispans2)), (2, 2))
+                    # Spans of another sequence are rejected (by the wrapper
+                    #   and by the library), and nothing is released
+                    with self.assertRaises(ValueError):
+                        iseq.release_many(ispans + ispans2[:1])
+                    objs = (_bf.BFrspan * 2)(ispans[0].obj, ispans2[0].obj)
+                    self.assertEqual(_bf.bfRingSpanReleaseMany(objs, 2),
+                                     _bf.BF_STATUS_INVALID_ARGUMENT)
+                    # As is a span that appears twice
+                    objs = (_bf.BFrspan * 3)(ispans[0].obj, ispans[1].obj,
+                                             ispans[0].obj)
+                    self.assertEqual(_bf.bfRingSpanReleaseMany(objs, 3),
+                                     _bf.BF_STATUS_INVALID_ARGUMENT)
+                    with self.assertRaises(RuntimeError):
+                        iseq.release_many([ispans[0], ispans[1], ispans[0]])
+                    iseq.release_many(ispans)
+                    iseq2.release_many(ispans2)
+                    # Spans that have already been released are rejected
+                    with self.assertRaises(ValueError):
+                        iseq.release_many(ispans)
+                    # The open reads were each closed exactly once
+                    ring.resize(gulp_nframe * frame_nbyte, 128 * frame_nbyte)
+    def test_sequence_lookup(self):
+        # Many short sequences, so that expired ones are recycled (along with
+        #   their name and header storage) for new ones
+        frame_nbyte, buf_nframe, nseq = 4096, 8, 300
+        ring = Ring(name="test_ring_sequence_lookup")
+        def header(i):
+            hdr = make_header("seq%i" % i, 1000 + 10 * i, frame_nbyte)
+            hdr['payload'] = "x" * (i % 37)
+            return hdr
+        with ring.begin_writing() as oring:
+            held = None
+            for i in range(nseq):
+                with oring.begin_sequence(header(i), 1, buf_nframe) as oseq:
+                    write_frames(oseq, 0, 1, frame_nbyte, seed=i)
+                    with ring.open_sequence_at(1000 + 10 * i + 5,
+                                               guarantee=False) as iseq:
+                        self.assertEqual(iseq.header, header(i))
+                    with ring.open_sequence(("seq%i" % i).encode(),
+                                            guarantee=False) as iseq:
+                        self.assertEqual(iseq.time_tag, 1000 + 10 * i)
+                    if i >= 4:
+                        # Earlier sequences are still found by exact and
+                        #   in-between time_tags
+                        for j in (i - 4, i - 1):
+                            with ring.open_sequence_at(1000 + 10 * j,
+                                                       guarantee=False) as iseq:
+                                self.assertEqual(iseq.name, "seq%i" % j)
+                            with ring.open_sequence_at(1000 + 10 * j + 9,
+                                                       guarantee=False) as iseq:
+                                self.assertEqual(iseq.header, header(j))
+                    if i == 100:
+                        # A sequence that is still referenced is never
+                        #   recycled, even once it has expired
+                        held = ring.open_sequence_at(1000 + 10 * i,
+                                                     guarantee=False)
+            # Expired sequences can no longer be found...
+            with self.assertRaises(RuntimeError):
+                ring.open_sequence_at(1000)
+            with self.assertRaises(RuntimeError):
+                ring.open_sequence(b"seq0")
+            self.assertEqual(held.name, "seq100")
+            self.assertEqual(held.header, header(100))
+            held.close()
+            # ...and their names can be reused, unlike live ones
+            with oring.begin_sequence(make_header("seq0", 10**6, frame_nbyte),
+                                      1, buf_nframe) as oseq:
+                write_frames(oseq, 0, 1, frame_nbyte)
+            with self.assertRaises(RuntimeError):
+                oring.begin_sequence(make_header("seq0", 10**6 + 1,
+                                                 frame_nbyte), 1, buf_nframe)
+            # As can time_tags, but not those of live sequences
+            with self.assertRaises(RuntimeError):
+                oring.begin_sequence(make_header("dup", 10**6, frame_nbyte),
+                                     1, buf_nframe)
+            with ring.open_sequence_at(10**6 + 5, guarantee=False) as iseq:
+                self.assertEqual(iseq.name, "seq0")
+    def test_sequence_lookup_unsorted(self):
+        # Untagged and out-of-order time_tags force a linear search until
+        #   such sequences have expired from the ring
+        frame_nbyte, buf_nframe = 4096, 4
+        ring = Ring(name="test_ring_sequence_lookup_unsorted")
+        time_tags = [100, 500, 300, -1, 400, 200]
+        def find(time_tag):
+            with ring.open_sequence_at(time_tag, guarantee=False) as iseq:
+                return iseq.time_tag
+        with ring.begin_writing() as oring:
+            for i, time_tag in enumerate(time_tags):
+                with oring.begin_sequence(make_header("u%i" % i, time_tag,
+                                                      frame_nbyte),
+                                          1, buf_nframe) as oseq:
+                    write_frames(oseq, 0, 1, frame_nbyte)
+            # The live sequences are [300, -1, 400, 200]
+            self.assertEqual(find(250), 200)
+            self.assertEqual(find(350), 300)
+            self.assertEqual(find(1000), 400)
+            with self.assertRaises(RuntimeError):
+                find(150)
+            # Once they have all expired, sorted time_tags are binary
+            #   searched again
+            for i in range(20):
+                with oring.begin_sequence(make_header("s%i" % i, 1000 + i,
+                                                      frame_nbyte),
+                                          1, buf_nframe) as oseq:
+                    write_frames(oseq, 0, 1, frame_nbyte)
+                self.assertEqual(find(1000 + i), 1000 + i)
+                if i >= 2:
+                    self.assertEqual(find(1000 + i - 2), 1000 + i - 2)
+            with self.assertRaises(RuntimeError):
+                find(999)
+    def check_dump(self, ring, time_tag_begin, time_tag_end, expected):
+        with tempfile.NamedTemporaryFile(dir='/tmp') as fh:
+            ring.dump(fh, time_tag_begin, time_tag_end)
+            records = load_dump(fh.name)
+            self.assertEqual(os.path.getsize(fh.name) % 4096, 0)
+        self.assertEqual(len(records), len(expected))
+        for (record, header, ringlets), (hdr, offset, frames) in \
+                zip(records, expected):
+            self.assertEqual(record['data_offset'] % 4096, 0)
+            self.assertEqual(record['record_size'] % 4096, 0)
+            self.assertEqual(record['name'], hdr['name'])
+            self.assertEqual(record['time_tag'], hdr['time_tag'])
+            self.assertEqual(header, hdr)
+            self.assertEqual(record['offset'], offset)
+            self.assertEqual(len(ringlets), len(frames))
+            for data, ringlet in zip(ringlets, frames):
+                self.assertEqual(data, ringlet.tobytes())
+    def test_dump(self):
+        ring = Ring(name="test_ring_dump")
+        frame_nbyte = 1000
+        headers = [make_header("a", 1000, frame_nbyte),
+                   make_header("b", 2000, frame_nbyte, nringlet=2),
+                   make_header("c", 3000, frame_nbyte)]
+        ringlet_frames = lambda nframe, seed: [
+            make_frames(0, nframe, frame_nbyte, seed + 50 * r)
+            for r in range(2)]
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(headers[0], 10, 64) as oseq:
+                write_frames(oseq, 0, 10, frame_nbyte, seed=1)
+            with oring.begin_sequence(headers[1], 10, 64) as oseq:
+                # Note: This spans several chunks of the dump
+                for i in range(3):
+                    with oseq.reserve(10) as ospan:
+                        ospan.data[...] = np.array(
+                            ringlet_frames(30, 2))[:, i*10:(i+1)*10]
+                        ospan.commit(10)
+            with oring.begin_sequence(headers[2], 10, 64) as oseq:
+                write_frames(oseq, 0, 4, frame_nbyte, seed=3)
+                # Sequences are dumped up to the head, including one that
+                #   is still being written
+                a = (headers[0], 0, [make_frames(0, 10, frame_nbyte, 1)])
+                b = (headers[1], 0, ringlet_frames(30, 2))
+                c = (headers[2], 0, [make_frames(0, 4, frame_nbyte, 3)])
+                self.check_dump(ring, 1000, None, [a, b, c])
+                self.check_dump(ring, 2500, None, [b, c])
+                self.check_dump(ring, 1999, 3000, [a, b])
+                self.check_dump(ring, 3000, 3001, [c])
+                # The first time_tag must lie within a sequence
+                with tempfile.TemporaryFile(dir='/tmp') as fh:
+                    with self.assertRaises(RuntimeError):
+                        ring.dump(fh, 999)
+    def test_dump_overwritten(self):
+        # Only the part of a sequence that has not yet been overwritten is
+        #   dumped
+        ring = Ring(name="test_ring_dump_overwritten")
+        frame_nbyte = 1000
+        header = make_header("a", 1000, frame_nbyte)
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(header, 1, 8) as oseq:
+                for i in range(20):
+                    write_frames(oseq, i, 1, frame_nbyte)
+        self.check_dump(ring, 1000, None,
+                        [(header, 12 * frame_nbyte,
+                          [make_frames(12, 8, frame_nbyte)])])
+    def test_set_view(self):
+        # Frames of 8 channels x 16 bytes in 4 ringlets
+        nringlet, nchan, nbyte = 4, 8, 16
+        ring = Ring(name="test_ring_set_view")
+        def make_data(frame_offset, nframe, seed):
+            shape = (nringlet, nframe, nchan, nbyte)
+            index = np.indices(shape)
+            return ((index[0] * 61 + (index[1] + frame_offset) * 7 +
+                     index[2] * 3 + index[3] + seed) % 251).astype(np.uint8)
+        def make_view_header(name, time_tag):
+            return {'name':     name,
+                    'time_tag': time_tag,
+                    '_tensor':  {'dtype':  'u8',
+                                 'shape':  [nringlet, -1, nchan, nbyte],
+                                 'labels': ['pol', 'time', 'freq', 'byte'],
+                                 'scales': [None, [0, 1], [100, 10], None]}}
+        with ring.begin_writing() as oring:
+            for seed, name in enumerate(("first", "second")):
+                with oring.begin_sequence(make_view_header(name, seed),
+                                          4, 32) as oseq:
+                    with oseq.reserve(12) as ospan:
+                        ospan.data[...] = make_data(0, 12, seed)
+                        ospan.commit(12)
+        with ring.open_earliest_sequence(guarantee=True) as iseq:
+            full = make_data(0, 12, 0)
+            # A range of ringlets
+            iseq.set_view(ringlets=slice(1, 3))
+            self.assertEqual(iseq.header['_tensor']['shape'],
+                             [2, -1, nchan, nbyte])
+            with iseq.acquire(4, 4) as ispan:
+                np.testing.assert_array_equal(np.array(ispan.data),
+                                              full[1:3, 4:8])
+            # A sub-band of each frame (with its scale shifted to match)
+            iseq.set_view(frames=slice(2, 5))
+            tensor = iseq.header['_tensor']
+            self.assertEqual(tensor['shape'], [nringlet, -1, 3, nbyte])
+            self.assertEqual(tensor['scales'][2], [120, 10])
+            with iseq.acquire(0, 5) as ispan:
+                self.assertEqual(ispan.nframe, 5)
+                self.assertEqual(ispan._frame_stride_bytes, nchan * nbyte)
+                np.testing.assert_array_equal(np.array(ispan.data),
+                                              full[:, 0:5, 2:5])
+            # Both at once, through batched reads
+            iseq.set_view(ringlets=slice(3, 4), frames=slice(7, 8))
+            nframe = 0
+            for ispan in iseq.read(3, batch=2):
+                np.testing.assert_array_equal(
+                    np.array(ispan.data),
+                    full[3:4, nframe:nframe + 3, 7:8])
+                nframe += ispan.nframe
+                if nframe == 12:
+                    break
+            # The view stays in effect in the next sequence
+            iseq.increment()
+            self.assertEqual(iseq.name, "second")
+            self.assertEqual(iseq.header['_tensor']['shape'], [1, -1, 1, nbyte])
+            with iseq.acquire(2, 2) as ispan:
+                np.testing.assert_array_equal(np.array(ispan.data),
+                                              make_data(0, 12, 1)[3:4, 2:4, 7:8])
+            # Until it is cleared
+            iseq.set_view()
+            self.assertEqual(iseq.header['_tensor']['shape'],
+                             [nringlet, -1, nchan, nbyte])
+            with iseq.acquire(0, 12) as ispan:
+                np.testing.assert_array_equal(np.array(ispan.data),
+                                              make_data(0, 12, 1))
+            for ringlets, frames in ((slice(3, 1), None),
+                                     (slice(0, 4, 2), None),
+                                     (None, slice(4, 4)),
+                                     (None, slice(0, 8, 2))):
+                with self.assertRaises(ValueError):
+                    iseq.set_view(ringlets=ringlets, frames=frames)
+    def check_many_guarantees(self, lockfree):
+        # More guaranteed readers than there are guarantee slots (64), some
+        #   of which are closed and reopened so that slots are reused
+        frame_nbyte, buf_nframe, nreader = 4096, 4, 70
+        ring = Ring(name="test_ring_many_guarantees_%i" % lockfree)
+        ring.lockfree = lockfree
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      1, buf_nframe) as oseq:
+                iseqs = [ring.open_earliest_sequence(guarantee=True)
+                         for _ in range(nreader)]
+                self.assertEqual(load_ring_log(ring)['nguarantee'], nreader)
+                nframe = 0
+                def write_until_blocked():
+                    written = nframe
+                    while True:
+                        try:
+                            with oseq.reserve(1, nonblocking=True) as ospan:
+                                ospan.data[...] = make_frames(written, 1,
+                                                              frame_nbyte)
+                                ospan.commit(1)
+                        except IOError:
+                            return written
+                        written += 1
+                def advance(readers, frame_offset):
+                    for iseq in readers:
+                        with iseq.acquire(frame_offset, 1) as ispan:
+                            np.testing.assert_array_equal(
+                                np.array(ispan.data),
+                                make_frames(frame_offset, 1, frame_nbyte))
+                nframe = write_until_blocked()
+                self.assertEqual(nframe, buf_nframe)
+                # Each reader alone (whether its guarantee is in a slot or
+                #   not) holds up the writer until it moves on
+                for k in (0, 63, 64, nreader - 1):
+                    frame_offset = nframe - buf_nframe + 1
+                    advance(iseqs[:k] + iseqs[k+1:], frame_offset)
+                    self.assertEqual(write_until_blocked(), nframe)
+                    advance(iseqs[k:k+1], frame_offset)
+                    nframe = write_until_blocked()
+                    self.assertEqual(nframe, frame_offset + buf_nframe)
+                # Readers that reuse freed slots (and overflow slots) still
+                #   hold up the writer
+                reopened = list(range(0, 10)) + list(range(64, 68))
+                for k in reopened:
+                    iseqs[k].close()
+                    iseqs[k] = ring.open_earliest_sequence(guarantee=True)
+                self.assertEqual(load_ring_log(ring)['nguarantee'], nreader)
+                frame_offset = nframe - buf_nframe + 1
+                advance([iseq for k, iseq in enumerate(iseqs)
+                         if k not in reopened], frame_offset)
+                self.assertEqual(write_until_blocked(), nframe)
+                advance([iseqs[k] for k in reopened], frame_offset)
+                nframe = write_until_blocked()
+                self.assertEqual(nframe, frame_offset + buf_nframe)
+                # Without any readers, the writer is never held up
+                for iseq in iseqs:
+                    iseq.close()
+                self.assertEqual(load_ring_log(ring)['nguarantee'], 0)
+                for i in range(nframe, nframe + 3 * buf_nframe):
+                    write_frames(oseq, i, 1, frame_nbyte)
+    def test_many_guarantees(self):
+        self.check_many_guarantees(False)
+    def test_many_guarantees_lockfree(self):
+        self.check_many_guarantees(True)
+    def test_shared(self):
+        name = "test_ring_shared_%i" % os.getpid()
+        ring = Ring(name=name, shared=True)
+        # Note: Base rings are not destroyed when garbage-collected, and the
+        #         owner must be destroyed to remove the shared memory.
+        self.addCleanup(_bf.bfRingDestroy, ring.obj)
+        self.assertTrue(ring.shared)
+        reader = Ring.attach(name)
+        self.addCleanup(_bf.bfRingDestroy, reader.obj)
+        self.assertTrue(reader.shared)
+        frame_nbyte, gulp_nframe = 1000, 4
+        errors = []
+        with ring.begin_writing() as oring:
+            header = make_header("shared", 123, frame_nbyte)
+            with oring.begin_sequence(header, gulp_nframe,
+                                      4 * gulp_nframe) as oseq:
+                with reader.open_earliest_sequence(guarantee=True) as iseq:
+                    self.assertEqual(iseq.name, "shared")
+                    self.assertEqual(iseq.time_tag, 123)
+                    self.assertEqual(iseq.header, header)
+                    stepped = SteppedReader(iseq, gulp_nframe, frame_nbyte,
+                                            errors)
+                    for i in range(50):
+                        write_frames(oseq, i * gulp_nframe, gulp_nframe,
+                                     frame_nbyte)
+                        stepped.read((i + 1) * gulp_nframe)
+        self.assertEqual(errors, [])
+        self.assertEqual(stepped.offset, 50 * gulp_nframe)
+        # Only the owner can write or resize
+        with self.assertRaises(RuntimeError):
+            reader.resize(frame_nbyte, 64 * frame_nbyte)
+    def test_shared_dead_reader(self):
+        # A reader process that dies with a span open (and a guarantee) must
+        #   not block the owner forever.
+        name = "test_ring_shared_dead_%i" % os.getpid()
+        ring = Ring(name=name, shared=True)
+        self.addCleanup(_bf.bfRingDestroy, ring.obj)
+        frame_nbyte = 4096
+        with ring.begin_writing() as oring:
+            with oring.begin_sequence(make_header(frame_nbyte=frame_nbyte),
+                                      1, 4) as oseq:
+                write_frames(oseq, 0, 1, frame_nbyte)
+                rfd, wfd = os.pipe()
+                pid = os.fork()
+                if pid == 0:
+                    try:
+                        reader = Ring.attach(name)
+                        iseq = reader.open_earliest_sequence(guarantee=True)
+                        iseq.acquire(0, 1)
+                        os.write(wfd, b"1")
+                    finally:
+                        os.kill(os.getpid(), signal.SIGKILL)
+                os.close(wfd)
+                acquired = os.read(rfd, 1)
+                os.close(rfd)
+                os.waitpid(pid, 0)
+                self.assertEqual(acquired, b"1")
+                resizer = threading.Thread(
+                    target=ring.resize, args=(frame_nbyte, 16 * frame_nbyte))
+                resizer.daemon = True
+                resizer.start()
+                resizer.join(10)
+                self.assertFalse(resizer.is_alive())
+                # Nor can its guarantee hold up the writer
+                for i in range(1, 40):
+                    write_frames(oseq, i, 1, frame_nbyte)
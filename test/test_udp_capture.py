@@ -0,0 +1,517 @@
+
+# Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# * Neither the name of The Bifrost Authors nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Replays generated packet files through UDPCapture, with seeded drops and
+reordering, and checks the per-source stats, the mask and the captured data.
+"""
+
+import unittest
+import ctypes
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+import tempfile
+import numpy as np
+from bifrost.ring import Ring
+from bifrost.udp_capture import UDPCapture
+from bifrost.libbifrost import _bf
+from bifrost.proclog import load_by_pid
+
+NSRC         = 4
+NTIME        = 16  # seqs per buffer
+NBUF         = 12
+NSEQ         = NTIME * NBUF
+PAYLOAD_SIZE = 64
+MASK_SIZE    = (NTIME * NSRC + 63) // 64 * 8  # bytes per buffer
+
+def make_payload(seq, src):
+    return ((np.arange(PAYLOAD_SIZE) + seq * 7 + src * 31) % 251).astype(np.uint8)
+
+def make_packet(seq, src, chan0=0):
+    # The "simple" format: big-endian seq, src, nchan, chan0 and padding
+    hdr = struct.pack('>QHHHH', seq, src, 1, chan0, 0)
+    return hdr + make_payload(seq, src).tobytes()
+
+def make_spead_packet(seq, src, payload=None, heap_size=None,
+                      heap_offset=0, payload_length=None):
+    # SPEAD-64-48, with the heap counter, heap size, heap offset, payload
+    #   length and source id as immediate items
+    if payload is None:
+        payload = make_payload(seq, src).tobytes()
+    items = [(0x0001, seq),
+             (0x0002, len(payload) if heap_size is None else heap_size),
+             (0x0003, heap_offset),
+             (0x0004, len(payload) if payload_length is None else payload_length),
+             (0x4101, src)]
+    hdr = struct.pack('>BBBBHH', 0x53, 4, 2, 6, 0, len(items))
+    for item_id, value in items:
+        hdr += struct.pack('>Q', 1 << 63 | item_id << 48 | value)
+    return hdr + payload
+
+def make_chips_packet(seq, src):
+    # Big-endian and 1-based seq and roach (src), with 32 bytes per channel
+    hdr = struct.pack('>BBBBBBHQ', src + 1, 0, PAYLOAD_SIZE // 32, 1, 0,
+                      NSRC, 0, seq + 1)
+    return hdr + make_payload(seq, src).tobytes()
+
+def write_dump(f, packets, times=None):
+    """Writes a payload dump, with packet i at times[i] ns (default i us)"""
+    f.write(b'BFPKTDMP')
+    for i, pkt in enumerate(packets):
+        time_ns = i * 1000 if times is None else times[i]
+        f.write(struct.pack('<QII', time_ns, len(pkt), 0))
+        f.write(pkt)
+
+def write_pcap(f, packets):
+    f.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+    localhost = b'\x7f\x00\x00\x01'
+    for i, pkt in enumerate(packets):
+        udp = struct.pack('>HHHH', 4015, 4015, 8 + len(pkt), 0) + pkt
+        ip  = struct.pack('>BBHHHBBH4s4s', 0x45, 0, 20 + len(udp), 0, 0,
+                          64, 17, 0, localhost, localhost) + udp
+        eth = b'\x00' * 12 + b'\x08\x00' + ip
+        f.write(struct.pack('<IIII', 0, i, len(eth), len(eth)))
+        f.write(eth)
+
+def sequence_callback(seq0, chan0, nchan, nsrc,
+                      time_tag_ptr, hdr_ptr, hdr_size_ptr):
+    time_tag_ptr[0] = seq0
+    hdr_ptr[0]      = None
+    hdr_size_ptr[0] = 0
+    return 0
+
+# Note: ctypes callbacks must outlive the captures that call them
+SEQUENCE_CALLBACK = _bf.BFudpcapture_sequence_callback(sequence_callback)
+
+def open_capture(name, packets=None, times=None):
+    """Returns a capture that replays packets (by default a single one), its
+    ring and file"""
+    ring = Ring(name=name)
+    f = tempfile.TemporaryFile()
+    write_dump(f, [make_packet(0, 0)] if packets is None else packets, times)
+    f.flush()
+    f.seek(0)
+    capture = UDPCapture(b'simple', f, ring, NSRC, 0, PAYLOAD_SIZE,
+                         NTIME, NTIME, SEQUENCE_CALLBACK)
+    return capture, ring, f
+
+def read_ring(ring, nbyte):
+    """Returns the time tag and the first nbyte bytes of the first sequence"""
+    with ring.open_earliest_sequence(guarantee=True) as seq:
+        with seq.acquire(0, nbyte) as span:
+            data = ctypes.string_at(span._data_ptr, span.size)
+        return seq.time_tag, np.frombuffer(data, dtype=np.uint8)
+
+class UDPCaptureReplayTest(unittest.TestCase):
+    def setUp(self):
+        self.packets = [make_packet(seq, src)
+                        for seq in range(NSEQ)
+                        for src in range(NSRC)]
+        self.expected = np.array([[make_payload(seq, src)
+                                   for src in range(NSRC)]
+                                  for seq in range(NSEQ)])
+    def replay(self, write_file=write_dump, packets=None, **replay_args):
+        with tempfile.TemporaryFile() as f:
+            write_file(f, self.packets if packets is None else packets)
+            f.flush()
+            f.seek(0)
+            return self.replay_files(f, **replay_args)
+    def replay_files(self, f, check_stats=None, fmt=b'simple', window=None,
+                     time_ring=None, poll=None, **replay_args):
+        """Replays the file f (or a list of files and sockets, one per capture
+        thread), calling check_stats(stats) after each recv if given"""
+        ring      = Ring(name="test_replay_data")
+        mask_ring = Ring(name="test_replay_mask")
+        # Large enough to hold (and read) the whole replay at the end
+        ring.resize(NSEQ * NSRC * PAYLOAD_SIZE,
+                    2 * NSEQ * NSRC * PAYLOAD_SIZE)
+        mask_ring.resize(NBUF * MASK_SIZE, 2 * NBUF * MASK_SIZE)
+        callback = _bf.BFudpcapture_sequence_callback(sequence_callback)
+        capture = UDPCapture(fmt, f, ring, NSRC, 0, PAYLOAD_SIZE,
+                             NTIME, NTIME, callback)
+        capture.set_mask_ring(mask_ring)
+        if window is not None:
+            capture.set_reorder_window(window)
+        if time_ring is not None:
+            capture.set_time_ring(time_ring)
+        if poll is not None:
+            capture.set_poll_mode(**poll)
+        if replay_args:
+            capture.set_replay(**replay_args)
+        for _ in range(10 * NBUF):
+            status = capture.recv().value
+            if check_stats is not None:
+                check_stats(capture.source_stats(NSRC))
+            if status == _bf.BF_CAPTURE_ENDED:
+                break
+        else:
+            self.fail("Replay did not end")
+        stats = capture.source_stats(NSRC)
+        time_tag, data = read_ring(ring, NSEQ * NSRC * PAYLOAD_SIZE)
+        mask_time_tag, words = read_ring(mask_ring, NBUF * MASK_SIZE)
+        self.buf_times = capture.buffer_times()
+        # Note: The capture's ProcLogs are removed along with it
+        self.capture_log = load_by_pid(os.getpid())['udp_capture']
+        del capture
+        self.assertEqual(mask_time_tag, time_tag)
+        nseq = len(data) // (NSRC * PAYLOAD_SIZE)
+        self.assertEqual(nseq, NSEQ - time_tag)
+        data = data.reshape(nseq, NSRC, PAYLOAD_SIZE)
+        # Bit (seq - seq0)*nsrc + src of each buffer's little-endian words
+        bits = np.unpackbits(words.reshape(-1, MASK_SIZE),
+                             axis=1, bitorder='little')
+        mask = bits[:, :NTIME * NSRC].reshape(-1, NSRC)[:nseq].astype(bool)
+        return time_tag, stats, mask, data
+    def check_replay(self, time_tag, stats, mask, data):
+        expected = self.expected[time_tag:]
+        nseq = len(data)
+        for src in range(NSRC):
+            nvalid = mask[:, src].sum()
+            self.assertEqual(stats[src]['nvalid'],         nvalid)
+            self.assertEqual(stats[src]['nlate'],          0)
+            self.assertEqual(stats[src]['ngood_bytes'],    nvalid * PAYLOAD_SIZE)
+            self.assertEqual(stats[src]['nmissing_bytes'],
+                             (nseq - nvalid) * PAYLOAD_SIZE)
+        np.testing.assert_equal(data[mask], expected[mask])
+        # Missing packets are zeroed when a mask ring is used
+        np.testing.assert_equal(data[~mask], 0)
+    def test_dump(self):
+        time_tag, stats, mask, data = self.replay()
+        self.assertEqual(time_tag, 0)
+        self.assertTrue(mask.all())
+        self.check_replay(time_tag, stats, mask, data)
+    def test_dump_drop_reorder(self):
+        args = dict(drop_prob=0.05, reorder_prob=0.2, reorder_depth=6, seed=42)
+        time_tag, stats, mask, data = self.replay(**args)
+        self.check_replay(time_tag, stats, mask, data)
+        ndropped = mask.size - mask.sum()
+        self.assertGreater(ndropped, 0)
+        self.assertLess(ndropped, 0.15 * mask.size)
+        # The injection is reproducible for a given seed
+        _, _, mask2, data2 = self.replay(**args)
+        np.testing.assert_equal(mask2, mask)
+        np.testing.assert_equal(data2, data)
+        args['seed'] = 43
+        _, _, mask3, _ = self.replay(**args)
+        self.assertFalse(np.array_equal(mask3, mask))
+    def test_pcap_drop_reorder(self):
+        args = dict(drop_prob=0.05, reorder_prob=0.2, reorder_depth=6, seed=42)
+        time_tag, stats, mask, data = self.replay(write_pcap, **args)
+        self.check_replay(time_tag, stats, mask, data)
+        # The same packets replayed from a dump see the same injection
+        _, _, dump_mask, _ = self.replay(write_dump, **args)
+        np.testing.assert_equal(mask, dump_mask)
+    def test_dump_multi_fd(self):
+        # Each shard replays two of the sources (as with SO_REUSEPORT
+        #   sockets), alongside a socket that never receives anything
+        shards = [[pkt for pkt in self.packets
+                   if struct.unpack('>H', pkt[8:10])[0] // 2 == shard]
+                  for shard in range(2)]
+        files = [tempfile.TemporaryFile() for _ in shards]
+        idle = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        idle.bind(('127.0.0.1', 0))
+        idle.setsockopt(socket.SOL_SOCKET, socket.SO_RCVTIMEO,
+                        struct.pack('ll', 0, 50000))
+        for f in files + [idle]:
+            self.addCleanup(f.close)
+        for f, packets in zip(files, shards):
+            write_dump(f, packets)
+            f.flush()
+            f.seek(0)
+        last = [{'nvalid': 0, 'ngood_bytes': 0}] * NSRC
+        def check_stats(stats):
+            # The totals may be read while the idle thread is still waiting
+            #   for data, but must never go backwards
+            for src in range(NSRC):
+                for key in last[src]:
+                    self.assertGreaterEqual(stats[src][key], last[src][key])
+            last[:] = stats
+        time_tag, stats, mask, data = self.replay_files(files + [idle],
+                                                        check_stats)
+        self.assertEqual(time_tag, 0)
+        self.assertTrue(mask.all())
+        self.check_replay(time_tag, stats, mask, data)
+    def test_spead(self):
+        # Partial heaps, and packets whose heap size or payload length do not
+        #   match their payload, are invalid (and must not reach the data)
+        bad = b'\xff' * PAYLOAD_SIZE
+        packets = []
+        for seq in range(NSEQ):
+            for src in range(NSRC):
+                if seq % 5 == 0 and src == 1:
+                    packets.append(make_spead_packet(seq, src, bad,
+                                                     heap_offset=PAYLOAD_SIZE))
+                    packets.append(make_spead_packet(seq, src, bad,
+                                                     heap_size=2 * PAYLOAD_SIZE))
+                    packets.append(make_spead_packet(seq, src, bad,
+                                                     payload_length=1))
+                packets.append(make_spead_packet(seq, src))
+        ninvalid = 3 * len(range(0, NSEQ, 5))
+        time_tag, stats, mask, data = self.replay(packets=packets, fmt=b'spead')
+        self.assertEqual(time_tag, 0)
+        self.assertTrue(mask.all())
+        self.check_replay(time_tag, stats, mask, data)
+        self.assertEqual(self.capture_log['stats']['ninvalid'], ninvalid)
+    def test_chips(self):
+        # The payloads are scattered by channel, as [time][chan][src][32 bytes]
+        packets = [make_chips_packet(seq, src)
+                   for seq in range(NSEQ)
+                   for src in range(NSRC)]
+        args = dict(drop_prob=0.05, reorder_prob=0.2, reorder_depth=6, seed=42)
+        time_tag, stats, mask, data = self.replay(packets=packets,
+                                                  fmt=b'chips', **args)
+        nseq = len(data)
+        data = data.reshape(nseq, PAYLOAD_SIZE // 32, NSRC, 32)
+        data = data.transpose(0, 2, 1, 3).reshape(nseq, NSRC, PAYLOAD_SIZE)
+        self.assertGreater(mask.size - mask.sum(), 0)
+        self.check_replay(time_tag, stats, mask, data)
+    def test_source_stats_name(self):
+        capture, ring, f = open_capture("test_stats_data")
+        self.addCleanup(f.close)
+        name = capture.source_stats_name().decode()
+        prefix, pid, n = name.rsplit('.', 2)
+        self.assertEqual(prefix, '/bifrost_udp_capture')
+        self.assertEqual(int(pid), os.getpid())
+        self.assertTrue(os.path.exists('/dev/shm' + name))
+        # A table that already exists is skipped rather than taken over
+        taken = '/dev/shm%s.%s.%d' % (prefix, pid, int(n) + 1)
+        with open(taken, 'wb') as t:
+            t.write(b'taken')
+        self.addCleanup(os.remove, taken)
+        capture2, ring2, f2 = open_capture("test_stats_data2")
+        self.addCleanup(f2.close)
+        self.assertEqual(capture2.source_stats_name().decode(),
+                         '%s.%s.%d' % (prefix, pid, int(n) + 2))
+        with open(taken, 'rb') as t:
+            self.assertEqual(t.read(), b'taken')
+        del capture, capture2
+        self.assertFalse(os.path.exists('/dev/shm' + name))
+    def test_source_stats_stale(self):
+        # Tables left behind by processes that have died are removed by the
+        #   next process to create a capture
+        dead = subprocess.Popen(['true'])
+        dead.wait()
+        stale = '/dev/shm/bifrost_udp_capture.%d.0' % dead.pid
+        with open(stale, 'wb') as f:
+            f.write(b'stale')
+        self.addCleanup(lambda: os.path.exists(stale) and os.remove(stale))
+        script = ("from test_udp_capture import open_capture\n"
+                  "capture, ring, f = open_capture('test_stats_stale')\n"
+                  "del capture\n")
+        env = dict(os.environ)
+        env['PYTHONPATH'] = os.pathsep.join(sys.path)
+        subprocess.check_call([sys.executable, '-c', script], env=env)
+        self.assertFalse(os.path.exists(stale))
+    def test_reorder_window(self):
+        # Packets held back by more than a buffer are late with the default
+        #   window of 2 buffers, but are all captured with a wider one
+        args = dict(reorder_prob=0.05, reorder_depth=3 * NTIME * NSRC, seed=42)
+        _, stats, mask, _ = self.replay(**args)
+        nlate = sum(s['nlate'] for s in stats)
+        self.assertGreater(nlate, 0)
+        self.assertEqual(mask.size - mask.sum(), nlate)
+        for window in (5, NBUF):
+            time_tag, stats, mask, data = self.replay(window=window, **args)
+            self.assertEqual(time_tag, 0)
+            self.assertTrue(mask.all())
+            self.check_replay(time_tag, stats, mask, data)
+    def test_time_ring(self):
+        # Replayed packets arrive at the times in the file (packet i of the
+        #   dump at i us), and each buffer gets one entry in the time ring
+        nbyte = ctypes.sizeof(_bf.BFudpcapture_buf_times)
+        time_ring = Ring(name="test_replay_time")
+        time_ring.resize(NBUF * nbyte, 2 * NBUF * nbyte)
+        t0 = int(time.time() * 1e9)
+        time_tag, stats, mask, data = self.replay(time_ring=time_ring)
+        t1 = int(time.time() * 1e9)
+        self.check_replay(time_tag, stats, mask, data)
+        times_time_tag, times = read_ring(time_ring, NBUF * nbyte)
+        self.assertEqual(times_time_tag, time_tag)
+        self.assertEqual(len(times), NBUF * nbyte)
+        times = np.frombuffer(times.tobytes(), dtype=np.uint64).reshape(NBUF, 4)
+        npkt = NTIME * NSRC
+        for buf, (seq0, first, last, commit) in enumerate(times):
+            self.assertEqual(seq0, buf * NTIME)
+            self.assertEqual(first, buf * npkt * 1000)
+            self.assertEqual(last, (buf * npkt + npkt - 1) * 1000)
+            self.assertTrue(t0 <= commit <= t1)
+            if buf:
+                self.assertGreaterEqual(commit, times[buf - 1][3])
+        # buffer_times returns the last buffer committed
+        last = self.buf_times
+        self.assertEqual(
+            [last.seq0, last.first_arrival, last.last_arrival, last.commit_time],
+            list(times[-1]))
+    def replay_loopback(self, poll=None):
+        """Sends the packets to a loopback socket, paced so that they are not
+        dropped, and captures them from it"""
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind(('127.0.0.1', 0))
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVTIMEO,
+                        struct.pack('ll', 0, 100000))
+        self.addCleanup(sock.close)
+        def send():
+            with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as tx:
+                for i, pkt in enumerate(self.packets):
+                    tx.sendto(pkt, sock.getsockname())
+                    if i % NSRC == NSRC - 1:
+                        time.sleep(0.0002)
+        sender = threading.Thread(target=send)
+        sender.start()
+        try:
+            return self.replay_files(sock, poll=poll)
+        finally:
+            sender.join()
+    def test_poll_mode(self):
+        poll = dict(busy=True, backoff_npoll=10, backoff_max_usec=1000)
+        # Replays are unaffected by the poll mode
+        time_tag, stats, mask, data = self.replay(poll=poll)
+        self.assertTrue(mask.all())
+        self.check_replay(time_tag, stats, mask, data)
+        # The last gulp waits out the socket's timeout, in a single blocking
+        #   call by default, or in many (backed-off) empty polls when busy
+        for poll, min_empty, max_empty in ((None, 1, 1), (poll, 20, None)):
+            time_tag, stats, mask, data = self.replay_loopback(poll)
+            self.assertTrue(mask.all())
+            self.check_replay(time_tag, stats, mask, data)
+            perf = self.capture_log['perf']
+            nempty = round(perf['recv_calls'] * (1 - perf['recv_hit_ratio']))
+            self.assertGreaterEqual(nempty, min_empty)
+            if max_empty is not None:
+                self.assertLessEqual(nempty, max_empty)
+    def poll_events(self, capture, until, timeout=10):
+        """Polls the capture's events until one whose status is in until"""
+        events = []
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            event = capture.poll_event()
+            if event is None:
+                time.sleep(0.001)
+                continue
+            events.append(event)
+            if event.status in until:
+                return events
+        self.fail("Timed out waiting for capture events")
+    def test_start_stop(self):
+        # chan0 changes with every buffer, so that each gulp is an event
+        nbuf = 300
+        packets = [make_packet(seq, src, chan0=seq // NTIME)
+                   for seq in range(nbuf * NTIME)
+                   for src in range(NSRC)]
+        # The events of the first nbuf_burst buffers overflow the queue,
+        #   before the rest arrive (and report the events lost) a second later
+        nbuf_burst = 280
+        npkt_burst = nbuf_burst * NTIME * NSRC
+        times = ([0] * npkt_burst +
+                 [1000000000] * (len(packets) - npkt_burst))
+        # The same replay, run synchronously, gives the expected events
+        capture, ring, f = open_capture("test_events_sync", packets)
+        self.addCleanup(f.close)
+        statuses = []
+        for _ in range(2 * nbuf):
+            status = capture.recv().value
+            if status in (_bf.BF_CAPTURE_STARTED, _bf.BF_CAPTURE_CHANGED,
+                          _bf.BF_CAPTURE_ENDED):
+                statuses.append(status)
+            if status == _bf.BF_CAPTURE_ENDED:
+                break
+        del capture
+        self.assertGreater(len(statuses), 256)
+        capture, ring, f = open_capture("test_events", packets, times)
+        self.addCleanup(f.close)
+        capture.set_replay(speed=1)
+        capture.start()
+        # The internal thread owns the capture while it runs
+        self.assertRaises(RuntimeError, capture.recv)
+        self.assertRaises(RuntimeError, capture.set_reorder_window, 3)
+        time.sleep(0.5)
+        events = self.poll_events(capture, (_bf.BF_CAPTURE_ENDED,))
+        nlost = [event.nlost for event in events]
+        self.assertGreater(sum(nlost), 0)
+        self.assertEqual(len(events) + sum(nlost), len(statuses))
+        # Only the first event after the queue was drained reports a loss
+        lost_at = [i for i, n in enumerate(nlost) if n]
+        self.assertEqual(len(lost_at), 1)
+        self.assertEqual([event.status for event in events[:lost_at[0]]],
+                         statuses[:lost_at[0]])
+        self.assertEqual(events[-1].status, _bf.BF_CAPTURE_ENDED)
+        self.assertEqual(events[-1].seq, nbuf * NTIME)
+        # The thread keeps running (idle) until stopped, after which there
+        #   are no more events
+        self.assertIsNone(capture.poll_event())
+        capture.stop()
+        self.assertRaises(StopIteration, capture.poll_event)
+        capture.stop()
+        capture.end()
+    def test_thread_error(self):
+        # A connected socket whose peer has gone fails with ECONNREFUSED
+        tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        tx.bind(('127.0.0.1', 0))
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind(('127.0.0.1', 0))
+        sock.connect(tx.getsockname())
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVTIMEO,
+                        struct.pack('ll', 5, 0))
+        for s in (tx, sock):
+            self.addCleanup(s.close)
+        nbuf = 4
+        ring = Ring(name="test_thread_error")
+        ring.resize(nbuf * NTIME * NSRC * PAYLOAD_SIZE,
+                    2 * nbuf * NTIME * NSRC * PAYLOAD_SIZE)
+        callback = _bf.BFudpcapture_sequence_callback(sequence_callback)
+        capture = UDPCapture(b'simple', sock, ring, NSRC, 0, PAYLOAD_SIZE,
+                             NTIME, NTIME, callback)
+        capture.start()
+        for seq in range(nbuf * NTIME):
+            for src in range(NSRC):
+                tx.sendto(make_packet(seq, src), sock.getsockname())
+        events = self.poll_events(capture, (_bf.BF_CAPTURE_STARTED,))
+        self.assertEqual([event.status for event in events],
+                         [_bf.BF_CAPTURE_STARTED])
+        # Wait for the thread to block on the last (open) buffers
+        time.sleep(0.2)
+        tx.close()
+        sock.send(b'x')
+        events = self.poll_events(capture, (_bf.BF_CAPTURE_ERROR,))
+        self.assertEqual([event.status for event in events],
+                         [_bf.BF_CAPTURE_ERROR])
+        self.assertRaises(StopIteration, capture.poll_event)
+        # The thread has exited by itself, having committed its open buffers,
+        #   and the capture may be used again without stopping it first
+        capture.flush()
+        capture.set_reorder_window(3)
+        time_tag, data = read_ring(ring, nbuf * NTIME * NSRC * PAYLOAD_SIZE)
+        self.assertEqual(time_tag, 0)
+        np.testing.assert_equal(data.reshape(-1, NSRC, PAYLOAD_SIZE),
+                                self.expected[:nbuf * NTIME])
+        capture.stop()
+        capture.end()
+        del capture
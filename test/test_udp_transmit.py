@@ -0,0 +1,118 @@
+
+# Copyright (c) 2016, The Bifrost Authors. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# * Neither the name of The Bifrost Authors nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+# OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Tests UDPTransmit.sendmany over datagram socket pairs, whose small send
+buffers make sends block or fail part-way through.
+"""
+
+import unittest
+import os
+import signal
+import socket
+import threading
+import time
+from bifrost.udp_transmit import UDPTransmit
+from bifrost.proclog import load_by_pid
+
+NPACKET     = 64
+PACKET_SIZE = 256
+
+def make_packets(npacket):
+    return [bytes([i % 256]) * PACKET_SIZE for i in range(npacket)]
+
+class UDPTransmitTest(unittest.TestCase):
+    def setUp(self):
+        self.tx, self.rx = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+        # Note: The kernel limits this to a few packets' worth
+        self.tx.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 1)
+        self.rx.settimeout(5)
+        self.addCleanup(self.tx.close)
+        self.addCleanup(self.rx.close)
+    def sendmany(self, packets):
+        """Sends the packets, and returns the transmit's stats log"""
+        transmit = UDPTransmit(self.tx)
+        transmit.sendmany(packets)
+        # Note: The log is written on the first send (and any that fails),
+        #         and removed along with the transmit
+        stats = load_by_pid(os.getpid())['udp_transmit']['stats']
+        del transmit
+        return stats
+    def recv_queued(self):
+        packets = []
+        self.rx.setblocking(False)
+        try:
+            while True:
+                packets.append(self.rx.recv(PACKET_SIZE))
+        except BlockingIOError:
+            pass
+        return packets
+    def test_sendmany(self):
+        packets = make_packets(4)
+        stats = self.sendmany(packets)
+        self.assertEqual(self.recv_queued(), packets)
+        self.assertEqual(stats['nvalid'],       len(packets))
+        self.assertEqual(stats['nvalid_bytes'], len(packets) * PACKET_SIZE)
+        self.assertEqual(stats['ninvalid'],     0)
+    def test_sendmany_interrupted(self):
+        # A signal that arrives while the send is blocked on the full queue
+        #   makes sendmmsg return early, and the rest must then be retried
+        packets = make_packets(NPACKET)
+        handler = signal.signal(signal.SIGUSR1, lambda signum, frame: None)
+        self.addCleanup(signal.signal, signal.SIGUSR1, handler)
+        sender = threading.get_ident()
+        received = []
+        def interrupt_and_drain():
+            time.sleep(0.2)
+            signal.pthread_kill(sender, signal.SIGUSR1)
+            time.sleep(0.2)
+            while len(received) < len(packets):
+                received.append(self.rx.recv(PACKET_SIZE))
+        drain = threading.Thread(target=interrupt_and_drain)
+        drain.start()
+        try:
+            stats = self.sendmany(packets)
+        finally:
+            drain.join()
+        self.assertEqual(received, packets)
+        self.assertEqual(stats['nvalid'],       len(packets))
+        self.assertEqual(stats['nvalid_bytes'], len(packets) * PACKET_SIZE)
+        self.assertEqual(stats['ninvalid'],     0)
+    def test_sendmany_partial(self):
+        # Without a reader, a non-blocking send fills the queue and then
+        #   fails, and only the packets that did not fit count as invalid
+        self.tx.setblocking(False)
+        packets = make_packets(NPACKET)
+        stats = self.sendmany(packets)
+        received = self.recv_queued()
+        nsent = len(received)
+        self.assertGreater(nsent, 0)
+        self.assertLess(nsent, len(packets))
+        self.assertEqual(received, packets[:nsent])
+        self.assertEqual(stats['nvalid'],         nsent)
+        self.assertEqual(stats['ninvalid'],       len(packets) - nsent)
+        self.assertEqual(stats['ninvalid_bytes'],
+                         (len(packets) - nsent) * PACKET_SIZE)
@@ -13,4 +13,7 @@ coverage run --source=bifrost.ring,bifrost,bifrost.pipeline -m unittest \
   test_serialize \
   test_binary_io \
   test_address \
+  test_ring \
+  test_udp_capture \
+  test_udp_transmit \
   test_scripts
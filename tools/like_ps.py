@@ -169,6 +169,9 @@ def main(args):
                 dtls = ring_details[ring]
                 sz, un = get_best_size(dtls['stride']*dtls['nringlet'])
                 print("    %i: %s on %s of size %.1f %s" % (i, ring, dtls['space'], sz, un))
+                if 'fill_high_water' in dtls:
+                    fsz, fun = get_best_size(dtls['fill_high_water'])
+                    print("       peak fill %.1f %s, writer blocked %.3f s, readers blocked %.3f s" % (fsz, fun, dtls['write_wait_block_secs'], dtls['read_wait_block_secs']))
             except KeyError:
                 print("    %i: %s" % (i, ring))
         print("  Blocks:")